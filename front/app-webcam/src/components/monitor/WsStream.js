@@ -0,0 +1,84 @@
+//sequence, capture time in seconds and microseconds, JPEG length, all big endian
+const WS_META_LEN = 16;
+
+/*
+ * Plays /cam/ws into an <img>. Every frame is acknowledged once the
+ * browser has decoded it, the camera holds back frames while too many
+ * are unacknowledged.
+ */
+export default class WsStream {
+  constructor(img, url, onFrame, onError) {
+    this.img = img;
+    this.onFrame = onFrame;
+    this.onError = onError;
+    this.shown = null;
+    this.loading = null;
+
+    this.img.onload = () => this.frameLoaded();
+    this.img.onerror = () => this.frameLoaded();
+
+    this.socket = new WebSocket(url);
+    this.socket.binaryType = 'arraybuffer';
+    this.socket.onmessage = event => this.frameReceived(event.data);
+    this.socket.onerror = () => this.onError && this.onError(`WebSocket error: ${url}`);
+  }
+
+  frameReceived(data) {
+    if(!(data instanceof ArrayBuffer) || data.byteLength < WS_META_LEN)
+      return;
+
+    const view = new DataView(data);
+    const frame = {
+      seq: view.getUint32(0),
+      timestamp: view.getUint32(4) * 1000 + Math.floor(view.getUint32(8) / 1000),
+      size: view.getUint32(12)
+    };
+    const blob = new Blob([new Uint8Array(data, WS_META_LEN, frame.size)], { type: 'image/jpeg' });
+
+    //a frame still decoding is replaced, acknowledging the newer one covers both
+    if(this.loading)
+      URL.revokeObjectURL(this.loading.url);
+
+    this.loading = { frame: frame, url: URL.createObjectURL(blob) };
+    this.img.src = this.loading.url;
+  }
+
+  frameLoaded() {
+    if(!this.loading)
+      return;
+
+    if(this.shown)
+      URL.revokeObjectURL(this.shown.url);
+    this.shown = this.loading;
+    this.loading = null;
+
+    this.ack(this.shown.frame.seq);
+    if(this.onFrame)
+      this.onFrame(this.shown.frame);
+  }
+
+  ack(seq) {
+    if(this.socket.readyState !== WebSocket.OPEN)
+      return;
+
+    const data = new DataView(new ArrayBuffer(4));
+    data.setUint32(0, seq);
+    this.socket.send(data.buffer);
+  }
+
+  close() {
+    this.socket.onmessage = null;
+    this.socket.onerror = null;
+    this.socket.close();
+
+    this.img.onload = null;
+    this.img.onerror = null;
+    this.img.src = '';
+
+    if(this.loading)
+      URL.revokeObjectURL(this.loading.url);
+    if(this.shown)
+      URL.revokeObjectURL(this.shown.url);
+    this.loading = this.shown = null;
+  }
+}
@@ -0,0 +1,589 @@
+/*
+ * host_camera.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <jpeglib.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_camera.h"
+#include "img_converters.h"
+#include "freertos/FreeRTOS.h"
+
+#include "host.h"
+
+//as long as the driver waits for a frame before giving up
+#define CAMERA_FB_GET_TIMEOUT_MS 4000
+#define CAMERA_DEFAULT_FPS 25
+//frame counter drawn on synthetic frames, one block per bit
+#define CAMERA_COUNTER_BITS 16
+
+typedef struct {
+	camera_fb_t fb;
+	size_t size;
+	bool in_use;
+} host_fb_t;
+
+typedef struct {
+	uint8_t *buf;
+	size_t len;
+	uint16_t width;
+	uint16_t height;
+} host_file_t;
+
+const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+	{   96,   96 },
+	{  160,  120 },
+	{  176,  144 },
+	{  240,  176 },
+	{  240,  240 },
+	{  320,  240 },
+	{  400,  296 },
+	{  480,  320 },
+	{  640,  480 },
+	{  800,  600 },
+	{ 1024,  768 },
+	{ 1280,  720 },
+	{ 1280, 1024 },
+	{ 1600, 1200 },
+	{ 1920, 1080 },
+	{  720, 1280 },
+	{  864, 1536 },
+	{ 2048, 1536 },
+	{ 2560, 1440 },
+	{ 2560, 1600 },
+	{ 1080, 1920 },
+	{ 2560, 1920 },
+};
+
+static host_camera_config_t sim = {
+	.frames_dir = NULL,
+	.fps = CAMERA_DEFAULT_FPS,
+	.still = false,
+};
+
+static sensor_t sensor;
+static uint8_t sensor_regs[0x10000];
+static bool camera_ready = false;
+
+static host_fb_t *fbs = NULL;
+static size_t fb_count = 0;
+static pthread_mutex_t fb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fb_cond = PTHREAD_COND_INITIALIZER;
+
+static host_file_t *files = NULL;
+static size_t file_count = 0;
+static size_t file_next = 0;
+
+static uint8_t *scene = NULL;
+static size_t scene_size = 0;
+static uint32_t frame_count = 0;
+static int64_t next_frame_us = 0;
+
+void host_camera_configure(const host_camera_config_t *config) {
+	sim = *config;
+	if (sim.fps <= 0)
+		sim.fps = CAMERA_DEFAULT_FPS;
+}
+
+static int file_filter(const struct dirent *entry) {
+	const char *ext = strrchr(entry->d_name, '.');
+	return !!ext && (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg"));
+}
+
+static bool file_load(const char *path, host_file_t *file) {
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	FILE *f;
+	long len;
+
+	if (!(f = fopen(path, "rb")))
+		return false;
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	file->buf = malloc(len);
+	file->len = !!file->buf ? fread(file->buf, 1, len, f) : 0;
+	fclose(f);
+	if (!file->len || file->len != (size_t)len) {
+		free(file->buf);
+		return false;
+	}
+
+	//only the header, for the frame size
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, file->buf, file->len);
+	if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+		jpeg_destroy_decompress(&cinfo);
+		free(file->buf);
+		return false;
+	}
+	file->width = cinfo.image_width;
+	file->height = cinfo.image_height;
+	jpeg_destroy_decompress(&cinfo);
+
+	return true;
+}
+
+static esp_err_t files_load(const char *dir) {
+	struct dirent **entries;
+	char path[PATH_MAX];
+	int n;
+
+	if ((n = scandir(dir, &entries, file_filter, alphasort)) < 0) {
+		ESP_LOGE(HOST_TAG, "Can't read %s: %s", dir, strerror(errno));
+		return ESP_FAIL;
+	}
+
+	files = calloc(MAX(n, 1), sizeof(host_file_t));
+	for (int i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+		if (!!files && file_load(path, &files[file_count]))
+			file_count++;
+		else
+			ESP_LOGW(HOST_TAG, "Skipping %s, not a readable JPEG", path);
+		free(entries[i]);
+	}
+	free(entries);
+
+	if (!file_count) {
+		ESP_LOGE(HOST_TAG, "No JPEG frames in %s", dir);
+		return ESP_FAIL;
+	}
+	ESP_LOGI(HOST_TAG, "Replaying %u frames from %s at %d fps", (unsigned)file_count, dir, sim.fps);
+
+	return ESP_OK;
+}
+
+#define SENSOR_SETTER(fn, field) \
+	static int sensor_##fn(sensor_t *s, int val) { \
+		s->status.field = val; \
+		return 0; \
+	}
+
+SENSOR_SETTER(set_contrast, contrast)
+SENSOR_SETTER(set_brightness, brightness)
+SENSOR_SETTER(set_saturation, saturation)
+SENSOR_SETTER(set_sharpness, sharpness)
+SENSOR_SETTER(set_denoise, denoise)
+SENSOR_SETTER(set_colorbar, colorbar)
+SENSOR_SETTER(set_whitebal, awb)
+SENSOR_SETTER(set_gain_ctrl, agc)
+SENSOR_SETTER(set_exposure_ctrl, aec)
+SENSOR_SETTER(set_hmirror, hmirror)
+SENSOR_SETTER(set_vflip, vflip)
+SENSOR_SETTER(set_aec2, aec2)
+SENSOR_SETTER(set_awb_gain, awb_gain)
+SENSOR_SETTER(set_agc_gain, agc_gain)
+SENSOR_SETTER(set_aec_value, aec_value)
+SENSOR_SETTER(set_special_effect, special_effect)
+SENSOR_SETTER(set_wb_mode, wb_mode)
+SENSOR_SETTER(set_ae_level, ae_level)
+SENSOR_SETTER(set_dcw, dcw)
+SENSOR_SETTER(set_bpc, bpc)
+SENSOR_SETTER(set_wpc, wpc)
+SENSOR_SETTER(set_raw_gma, raw_gma)
+SENSOR_SETTER(set_lenc, lenc)
+
+static int sensor_set_quality(sensor_t *s, int quality) {
+	if (quality < 0 || quality > 63)
+		return -1;
+	s->status.quality = quality;
+	return 0;
+}
+
+static int sensor_set_gainceiling(sensor_t *s, gainceiling_t gainceiling) {
+	s->status.gainceiling = gainceiling;
+	return 0;
+}
+
+static int sensor_set_framesize(sensor_t *s, framesize_t framesize) {
+	if (framesize >= FRAMESIZE_INVALID)
+		return -1;
+	s->status.framesize = framesize;
+	return 0;
+}
+
+static int sensor_set_pixformat(sensor_t *s, pixformat_t pixformat) {
+	switch (pixformat) {
+	case PIXFORMAT_JPEG:
+	case PIXFORMAT_RGB565:
+	case PIXFORMAT_YUV422:
+	case PIXFORMAT_GRAYSCALE:
+	case PIXFORMAT_RGB888:
+		s->pixformat = pixformat;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+static int sensor_get_reg(sensor_t *s, int reg, int mask) {
+	return sensor_regs[reg & 0xffff] & mask;
+}
+
+static int sensor_set_reg(sensor_t *s, int reg, int mask, int value) {
+	sensor_regs[reg & 0xffff] = (sensor_regs[reg & 0xffff] & ~mask) | (value & mask);
+	return 0;
+}
+
+static int sensor_set_res_raw(sensor_t *s, int startX, int startY, int endX, int endY, int offsetX, int offsetY,
+		int totalX, int totalY, int outputX, int outputY, bool scale, bool binning) {
+	return 0;
+}
+
+static int sensor_set_pll(sensor_t *s, int bypass, int mul, int sys, int root, int pre, int seld5, int pclken, int pclk) {
+	return 0;
+}
+
+static int sensor_set_xclk(sensor_t *s, int timer, int xclk) {
+	s->xclk_freq_hz = xclk * 1000000;
+	return 0;
+}
+
+/* The defaults the OV2640 driver starts with. */
+static int sensor_init_status(sensor_t *s) {
+	framesize_t framesize = s->status.framesize;
+	uint8_t quality = s->status.quality;
+
+	memset(&s->status, 0, sizeof(camera_status_t));
+	s->status.framesize = framesize;
+	s->status.quality = quality;
+	s->status.awb = 1;
+	s->status.awb_gain = 1;
+	s->status.aec = 1;
+	s->status.agc = 1;
+	s->status.bpc = 0;
+	s->status.wpc = 1;
+	s->status.raw_gma = 1;
+	s->status.lenc = 1;
+	s->status.dcw = 1;
+
+	return 0;
+}
+
+static int sensor_reset(sensor_t *s) {
+	memset(sensor_regs, 0, sizeof(sensor_regs));
+	return sensor_init_status(s);
+}
+
+static void sensor_setup(const camera_config_t *config) {
+	memset(&sensor, 0, sizeof(sensor));
+	sensor.id.MIDH = 0x7f;
+	sensor.id.MIDL = 0xa2;
+	sensor.id.PID = OV2640_PID;
+	sensor.id.VER = 0x42;
+	sensor.slv_addr = 0x30;
+	sensor.pixformat = config->pixel_format;
+	sensor.xclk_freq_hz = config->xclk_freq_hz;
+	sensor.status.framesize = config->frame_size;
+	sensor.status.quality = config->jpeg_quality;
+
+	sensor.init_status = sensor_init_status;
+	sensor.reset = sensor_reset;
+	sensor.set_pixformat = sensor_set_pixformat;
+	sensor.set_framesize = sensor_set_framesize;
+	sensor.set_contrast = sensor_set_contrast;
+	sensor.set_brightness = sensor_set_brightness;
+	sensor.set_saturation = sensor_set_saturation;
+	sensor.set_sharpness = sensor_set_sharpness;
+	sensor.set_denoise = sensor_set_denoise;
+	sensor.set_gainceiling = sensor_set_gainceiling;
+	sensor.set_quality = sensor_set_quality;
+	sensor.set_colorbar = sensor_set_colorbar;
+	sensor.set_whitebal = sensor_set_whitebal;
+	sensor.set_gain_ctrl = sensor_set_gain_ctrl;
+	sensor.set_exposure_ctrl = sensor_set_exposure_ctrl;
+	sensor.set_hmirror = sensor_set_hmirror;
+	sensor.set_vflip = sensor_set_vflip;
+	sensor.set_aec2 = sensor_set_aec2;
+	sensor.set_awb_gain = sensor_set_awb_gain;
+	sensor.set_agc_gain = sensor_set_agc_gain;
+	sensor.set_aec_value = sensor_set_aec_value;
+	sensor.set_special_effect = sensor_set_special_effect;
+	sensor.set_wb_mode = sensor_set_wb_mode;
+	sensor.set_ae_level = sensor_set_ae_level;
+	sensor.set_dcw = sensor_set_dcw;
+	sensor.set_bpc = sensor_set_bpc;
+	sensor.set_wpc = sensor_set_wpc;
+	sensor.set_raw_gma = sensor_set_raw_gma;
+	sensor.set_lenc = sensor_set_lenc;
+	sensor.get_reg = sensor_get_reg;
+	sensor.set_reg = sensor_set_reg;
+	sensor.set_res_raw = sensor_set_res_raw;
+	sensor.set_pll = sensor_set_pll;
+	sensor.set_xclk = sensor_set_xclk;
+
+	sensor_init_status(&sensor);
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config) {
+	if (camera_ready)
+		return ESP_ERR_INVALID_STATE;
+	if (!!sim.frames_dir && !files && files_load(sim.frames_dir) != ESP_OK)
+		return ESP_ERR_CAMERA_NOT_DETECTED;
+
+	fb_count = MAX(config->fb_count, 1);
+	if (!(fbs = calloc(fb_count, sizeof(host_fb_t))))
+		return ESP_ERR_NO_MEM;
+
+	sensor_setup(config);
+	next_frame_us = 0;
+	camera_ready = true;
+
+	if (!sim.frames_dir)
+		ESP_LOGI(HOST_TAG, "Synthetic frames at %d fps%s", sim.fps, sim.still ? ", still" : "");
+
+	return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit(void) {
+	if (!camera_ready)
+		return ESP_ERR_INVALID_STATE;
+
+	pthread_mutex_lock(&fb_lock);
+	for (size_t i = 0; i < fb_count; i++)
+		free(fbs[i].fb.buf);
+	free(fbs);
+	fbs = NULL;
+	fb_count = 0;
+	camera_ready = false;
+	pthread_mutex_unlock(&fb_lock);
+
+	return ESP_OK;
+}
+
+sensor_t *esp_camera_sensor_get(void) {
+	return camera_ready ? &sensor : NULL;
+}
+
+static bool fb_reserve(host_fb_t *hfb, size_t len) {
+	uint8_t *buf;
+
+	if (hfb->size >= len)
+		return true;
+	if (!(buf = realloc(hfb->fb.buf, len)))
+		return false;
+	hfb->fb.buf = buf;
+	hfb->size = len;
+
+	return true;
+}
+
+/*
+ * A gradient with a box sweeping across and the frame count in binary
+ * along the top, in RGB888 as BGR. The box and the count stay put on a
+ * still scene, so every frame is the same.
+ */
+static void scene_draw(uint8_t *bgr, uint16_t width, uint16_t height, uint32_t count) {
+	const camera_status_t *status = &sensor.status;
+	int bright = status->brightness * 24;
+	uint16_t box = MAX(height / 4, 1);
+	uint16_t box_x = sim.still ? (width - box) / 2 : (count * MAX(width / sim.fps / 4, 1)) % MAX(width - box, 1);
+	uint16_t box_y = (height - box) / 2;
+	uint16_t bit_w = MAX(width / CAMERA_COUNTER_BITS, 1);
+
+	for (uint16_t y = 0; y < height; y++) {
+		uint16_t sy = status->vflip ? height - 1 - y : y;
+		for (uint16_t x = 0; x < width; x++) {
+			uint16_t sx = status->hmirror ? width - 1 - x : x;
+			uint8_t *px = bgr + ((size_t)y * width + x) * 3;
+			int r, g, b;
+
+			if (status->colorbar) {
+				static const uint8_t bars[8][3] = {
+					{ 255, 255, 255 }, { 255, 255, 0 }, { 0, 255, 255 }, { 0, 255, 0 },
+					{ 255, 0, 255 }, { 255, 0, 0 }, { 0, 0, 255 }, { 0, 0, 0 },
+				};
+				const uint8_t *bar = bars[sx * 8 / width];
+				r = bar[0];
+				g = bar[1];
+				b = bar[2];
+			} else if (sx >= box_x && sx < box_x + box && sy >= box_y && sy < box_y + box) {
+				r = 240;
+				g = 240;
+				b = 32;
+			} else if (!sim.still && sy < bit_w && sx / bit_w < CAMERA_COUNTER_BITS) {
+				r = g = b = count & (1 << (CAMERA_COUNTER_BITS - 1 - sx / bit_w)) ? 255 : 0;
+			} else {
+				r = sx * 255 / width;
+				g = sy * 255 / height;
+				b = 96;
+			}
+
+			px[0] = MIN(MAX(b + bright, 0), 255);
+			px[1] = MIN(MAX(g + bright, 0), 255);
+			px[2] = MIN(MAX(r + bright, 0), 255);
+		}
+	}
+}
+
+static size_t jpg_append(void *arg, size_t index, const void *data, size_t len) {
+	host_fb_t *hfb = (host_fb_t *)arg;
+
+	if (!fb_reserve(hfb, index + len))
+		return 0;
+	memcpy(hfb->fb.buf + index, data, len);
+	hfb->fb.len = index + len;
+
+	return len;
+}
+
+static bool fb_fill_synthetic(host_fb_t *hfb) {
+	const resolution_info_t *res = &resolution[sensor.status.framesize];
+	size_t pixels = (size_t)res->width * res->height;
+	camera_fb_t *fb = &hfb->fb;
+
+	if (scene_size < pixels * 3) {
+		free(scene);
+		scene_size = 0;
+		if (!(scene = malloc(pixels * 3)))
+			return false;
+		scene_size = pixels * 3;
+	}
+	scene_draw(scene, res->width, res->height, frame_count);
+
+	fb->width = res->width;
+	fb->height = res->height;
+	fb->format = sensor.pixformat;
+	fb->len = 0;
+
+	switch (sensor.pixformat) {
+	case PIXFORMAT_JPEG:
+		//sensor quality runs from 0, best, to 63
+		return fmt2jpg_cb(scene, pixels * 3, res->width, res->height, PIXFORMAT_RGB888, 100 - sensor.status.quality, jpg_append, hfb);
+	case PIXFORMAT_RGB888:
+		if (!fb_reserve(hfb, pixels * 3))
+			return false;
+		memcpy(fb->buf, scene, pixels * 3);
+		fb->len = pixels * 3;
+		return true;
+	case PIXFORMAT_GRAYSCALE:
+		if (!fb_reserve(hfb, pixels))
+			return false;
+		for (size_t i = 0; i < pixels; i++)
+			fb->buf[i] = (29 * scene[i * 3] + 150 * scene[i * 3 + 1] + 77 * scene[i * 3 + 2]) >> 8;
+		fb->len = pixels;
+		return true;
+	case PIXFORMAT_RGB565:
+	case PIXFORMAT_YUV422:
+		if (!fb_reserve(hfb, pixels * 2))
+			return false;
+		for (size_t i = 0; i < pixels; i++) {
+			const uint8_t *px = scene + i * 3;
+			if (sensor.pixformat == PIXFORMAT_RGB565) {
+				uint16_t v = ((px[2] & 0xf8) << 8) | ((px[1] & 0xfc) << 3) | (px[0] >> 3);
+				fb->buf[i * 2] = v >> 8;
+				fb->buf[i * 2 + 1] = v;
+			} else {
+				int y = (29 * px[0] + 150 * px[1] + 77 * px[2]) >> 8;
+				int c = i & 1 ? 128 + (((px[2] - y) * 183) >> 8) : 128 + (((px[0] - y) * 144) >> 8);
+				fb->buf[i * 2] = y;
+				fb->buf[i * 2 + 1] = MIN(MAX(c, 0), 255);
+			}
+		}
+		fb->len = pixels * 2;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool fb_fill_file(host_fb_t *hfb) {
+	const host_file_t *file = &files[file_next];
+
+	file_next = (file_next + 1) % file_count;
+	if (!fb_reserve(hfb, file->len))
+		return false;
+
+	memcpy(hfb->fb.buf, file->buf, file->len);
+	hfb->fb.len = file->len;
+	hfb->fb.width = file->width;
+	hfb->fb.height = file->height;
+	hfb->fb.format = PIXFORMAT_JPEG;
+
+	return true;
+}
+
+/*
+ * Blocks for the frame period, as the sensor does, and for a free buffer
+ * while the application holds all of them. Only the capture task calls it.
+ */
+camera_fb_t *esp_camera_fb_get(void) {
+	int64_t now = esp_timer_get_time();
+	int64_t period_us = 1000000 / sim.fps;
+	struct timespec deadline;
+	host_fb_t *hfb = NULL;
+	bool filled;
+
+	if (!camera_ready)
+		return NULL;
+
+	if (now < next_frame_us) {
+		struct timespec delay = { .tv_sec = (next_frame_us - now) / 1000000, .tv_nsec = ((next_frame_us - now) % 1000000) * 1000 };
+		while (nanosleep(&delay, &delay) && errno == EINTR)
+			;
+	}
+	next_frame_us = MAX(next_frame_us, now) + period_us;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += CAMERA_FB_GET_TIMEOUT_MS / 1000;
+
+	pthread_mutex_lock(&fb_lock);
+	while (!hfb && camera_ready) {
+		for (size_t i = 0; i < fb_count && !hfb; i++) {
+			if (!fbs[i].in_use)
+				hfb = &fbs[i];
+		}
+		if (!hfb && pthread_cond_timedwait(&fb_cond, &fb_lock, &deadline) == ETIMEDOUT)
+			break;
+	}
+	if (!!hfb)
+		hfb->in_use = true;
+	pthread_mutex_unlock(&fb_lock);
+
+	if (!hfb) {
+		ESP_LOGW(HOST_TAG, "Failed to get the frame on time!");
+		return NULL;
+	}
+
+	filled = !!file_count ? fb_fill_file(hfb) : fb_fill_synthetic(hfb);
+	frame_count++;
+	if (!filled) {
+		esp_camera_fb_return(&hfb->fb);
+		return NULL;
+	}
+	//the driver stamps frames from the monotonic timer, not the wall clock
+	int64_t us = esp_timer_get_time();
+	hfb->fb.timestamp.tv_sec = us / 1000000;
+	hfb->fb.timestamp.tv_usec = us % 1000000;
+
+	return &hfb->fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb) {
+	if (!fb)
+		return;
+
+	pthread_mutex_lock(&fb_lock);
+	for (size_t i = 0; i < fb_count; i++) {
+		if (&fbs[i].fb == fb) {
+			fbs[i].in_use = false;
+			pthread_cond_signal(&fb_cond);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&fb_lock);
+}
@@ -0,0 +1,295 @@
+/*
+ * host_esp.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+#include <arpa/inet.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_spi_flash.h"
+#include "esp_partition.h"
+#include "esp_http_server.h"
+#include "esp_camera.h"
+#include "tcpip_adapter.h"
+
+#include "host.h"
+
+#define HOST_FLASH_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+	esp_err_t code;
+	const char *name;
+} host_err_name_t;
+
+#define ERR_NAME(code) { code, #code }
+
+static const host_err_name_t err_names[] = {
+	ERR_NAME(ESP_OK),
+	ERR_NAME(ESP_FAIL),
+	ERR_NAME(ESP_ERR_NO_MEM),
+	ERR_NAME(ESP_ERR_INVALID_ARG),
+	ERR_NAME(ESP_ERR_INVALID_STATE),
+	ERR_NAME(ESP_ERR_INVALID_SIZE),
+	ERR_NAME(ESP_ERR_NOT_FOUND),
+	ERR_NAME(ESP_ERR_NOT_SUPPORTED),
+	ERR_NAME(ESP_ERR_TIMEOUT),
+	ERR_NAME(ESP_ERR_INVALID_RESPONSE),
+	ERR_NAME(ESP_ERR_INVALID_CRC),
+	ERR_NAME(ESP_ERR_INVALID_VERSION),
+	ERR_NAME(ESP_ERR_INVALID_MAC),
+	ERR_NAME(ESP_ERR_HTTPD_HANDLERS_FULL),
+	ERR_NAME(ESP_ERR_HTTPD_HANDLER_EXISTS),
+	ERR_NAME(ESP_ERR_HTTPD_INVALID_REQ),
+	ERR_NAME(ESP_ERR_HTTPD_RESULT_TRUNC),
+	ERR_NAME(ESP_ERR_HTTPD_RESP_HDR),
+	ERR_NAME(ESP_ERR_HTTPD_RESP_SEND),
+	ERR_NAME(ESP_ERR_HTTPD_ALLOC_MEM),
+	ERR_NAME(ESP_ERR_HTTPD_TASK),
+	ERR_NAME(ESP_ERR_CAMERA_NOT_DETECTED),
+	ERR_NAME(ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE),
+	ERR_NAME(ESP_ERR_CAMERA_FAILED_TO_SET_OUT_FORMAT),
+	ERR_NAME(ESP_ERR_CAMERA_NOT_SUPPORTED),
+};
+
+static esp_log_level_t log_level = ESP_LOG_INFO;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct timespec timer_start_time;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+
+static esp_partition_t www_partition;
+static int www_fd = -1;
+
+const char *esp_err_to_name(esp_err_t code) {
+	for (size_t i = 0; i < sizeof(err_names) / sizeof(err_names[0]); i++) {
+		if (err_names[i].code == code)
+			return err_names[i].name;
+	}
+	return "UNKNOWN ERROR";
+}
+
+void _esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *function, const char *expression) {
+	fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nfile: \"%s\" line %d\nfunc: %s\nexpression: %s\n",
+			rc, esp_err_to_name(rc), file, line, file, line, function, expression);
+	abort();
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+	if (!strcmp(tag, "*"))
+		log_level = level;
+}
+
+uint32_t esp_log_timestamp(void) {
+	return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+	va_list args;
+
+	if (level > log_level)
+		return;
+
+	//whole lines, tasks log concurrently
+	va_start(args, format);
+	pthread_mutex_lock(&log_lock);
+	vprintf(format, args);
+	fflush(stdout);
+	pthread_mutex_unlock(&log_lock);
+	va_end(args);
+}
+
+static void timer_start(void) {
+	clock_gettime(CLOCK_MONOTONIC, &timer_start_time);
+}
+
+int64_t esp_timer_get_time(void) {
+	struct timespec now;
+
+	pthread_once(&timer_once, timer_start);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (int64_t)(now.tv_sec - timer_start_time.tv_sec) * 1000000 + (now.tv_nsec - timer_start_time.tv_nsec) / 1000;
+}
+
+void esp_chip_info(esp_chip_info_t *out_info) {
+	memset(out_info, 0, sizeof(esp_chip_info_t));
+	out_info->model = CHIP_ESP32;
+	out_info->features = CHIP_FEATURE_WIFI_BGN;
+	out_info->cores = (uint8_t)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+/*
+ * Locally administered and derived from the process id, so simulated
+ * cameras running side by side get distinct instance names.
+ */
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+	uint32_t pid = (uint32_t)getpid();
+
+	mac[0] = 0x02;
+	mac[1] = 0x00;
+	mac[2] = (uint8_t)type;
+	mac[3] = pid >> 16;
+	mac[4] = pid >> 8;
+	mac[5] = pid;
+
+	return ESP_OK;
+}
+
+void esp_fill_random(void *buf, size_t len) {
+	uint8_t *p = (uint8_t *)buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = getrandom(p, len, 0)) < 0) {
+			if (errno == EINTR)
+				continue;
+			abort();
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+uint32_t esp_random(void) {
+	uint32_t val;
+
+	esp_fill_random(&val, sizeof(val));
+	return val;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+	return (uint32_t)heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
+void esp_restart(void) {
+	ESP_LOGW(HOST_TAG, "esp_restart() called, exiting");
+	exit(EXIT_FAILURE);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+	return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+	return calloc(n, size);
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps) {
+	return realloc(ptr, size);
+}
+
+void heap_caps_free(void *ptr) {
+	free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+	struct sysinfo info;
+
+	if (sysinfo(&info))
+		return 0;
+	return (size_t)info.freeram * info.mem_unit;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+	return heap_caps_get_free_size(caps);
+}
+
+size_t spi_flash_get_chip_size(void) {
+	return HOST_FLASH_SIZE;
+}
+
+esp_err_t host_partition_set_image(const char *path) {
+	struct stat st;
+
+	if ((www_fd = open(path, O_RDONLY)) < 0 || fstat(www_fd, &st)) {
+		ESP_LOGE(HOST_TAG, "Can't open %s: %s", path, strerror(errno));
+		return ESP_FAIL;
+	}
+
+	memset(&www_partition, 0, sizeof(www_partition));
+	www_partition.type = ESP_PARTITION_TYPE_DATA;
+	www_partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+	www_partition.size = (uint32_t)st.st_size;
+	strncpy(www_partition.label, "www", sizeof(www_partition.label) - 1);
+
+	return ESP_OK;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+	if (www_fd < 0 || type != www_partition.type)
+		return NULL;
+	if (!!label && strcmp(label, www_partition.label))
+		return NULL;
+	return &www_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+	if (src_offset + size > partition->size)
+		return ESP_ERR_INVALID_SIZE;
+	return pread(www_fd, dst, size, src_offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+		spi_flash_mmap_memory_t memory, const void **out_ptr, spi_flash_mmap_handle_t *out_handle) {
+	void *ptr;
+
+	if (offset + size > partition->size)
+		return ESP_ERR_INVALID_ARG;
+	//mapped whole, flash mappings are never released while the firmware runs
+	if ((ptr = mmap(NULL, partition->size, PROT_READ, MAP_SHARED, www_fd, 0)) == MAP_FAILED)
+		return ESP_ERR_NO_MEM;
+
+	*out_ptr = (uint8_t *)ptr + offset;
+	*out_handle = 0;
+
+	return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle) {
+}
+
+esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_ip_info_t *ip_info) {
+	memset(ip_info, 0, sizeof(tcpip_adapter_ip_info_t));
+	ip_info->ip.addr = htonl(INADDR_LOOPBACK);
+	ip_info->netmask.addr = htonl(IN_CLASSA_NET);
+
+	return ESP_OK;
+}
+
+#if !HAVE_STRLCPY
+size_t strlcpy(char *dst, const char *src, size_t size) {
+	size_t len = strlen(src);
+
+	if (!!size) {
+		size_t n = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+
+	return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size) {
+	size_t len = strnlen(dst, size);
+
+	if (len == size)
+		return len + strlen(src);
+	return len + strlcpy(dst + len, src, size - len);
+}
+#endif
@@ -0,0 +1,252 @@
+/*
+ * host_freertos.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "host.h"
+
+//libc and libjpeg want far more stack than the firmware gives its tasks
+#define HOST_TASK_MIN_STACK (256 * 1024)
+
+struct host_task {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint32_t notify;
+	TaskFunction_t task_code;
+	void *parameters;
+	char name[16];
+};
+
+struct host_semaphore {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	UBaseType_t count;
+	UBaseType_t max_count;
+};
+
+static __thread struct host_task *current_task = NULL;
+static struct timespec start_time;
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+
+static void host_start_time(void) {
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+static void host_cond_init(pthread_cond_t *cond) {
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static void host_deadline(TickType_t ticks, struct timespec *deadline) {
+	uint64_t ms = (uint64_t)ticks * portTICK_PERIOD_MS;
+
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += ms / 1000;
+	deadline->tv_nsec += (ms % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+/*
+ * Waits on the condition until the predicate holds or the ticks run out,
+ * with the lock held. Returns whether the predicate holds.
+ */
+#define HOST_WAIT(cond, lock, ticks, predicate) ({ \
+		struct timespec __deadline; \
+		int __rc = 0; \
+		if ((ticks) != portMAX_DELAY) \
+			host_deadline(ticks, &__deadline); \
+		while (!(predicate) && __rc != ETIMEDOUT) { \
+			if ((ticks) == portMAX_DELAY) \
+				pthread_cond_wait(cond, lock); \
+			else \
+				__rc = pthread_cond_timedwait(cond, lock, &__deadline); \
+		} \
+		(predicate); \
+	})
+
+static struct host_task *host_task_new(const char *name) {
+	struct host_task *task = calloc(1, sizeof(struct host_task));
+
+	if (!task)
+		return NULL;
+	pthread_mutex_init(&task->lock, NULL);
+	host_cond_init(&task->cond);
+	strncpy(task->name, name, sizeof(task->name) - 1);
+
+	return task;
+}
+
+static void *host_task_entry(void *arg) {
+	struct host_task *task = (struct host_task *)arg;
+
+	current_task = task;
+	pthread_setname_np(pthread_self(), task->name);
+	task->task_code(task->parameters);
+
+	return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+		void *parameters, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id) {
+	struct host_task *task;
+	pthread_attr_t attr;
+	int rc;
+
+	if (!(task = host_task_new(name)))
+		return pdFAIL;
+	task->task_code = task_code;
+	task->parameters = parameters;
+	//the handle is the first thing some tasks get notified through
+	if (!!created_task)
+		*created_task = task;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, MAX(stack_depth, HOST_TASK_MIN_STACK));
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	rc = pthread_create(&task->thread, &attr, host_task_entry, task);
+	pthread_attr_destroy(&attr);
+
+	if (!!rc) {
+		ESP_LOGE(HOST_TAG, "Thread for task %s failed: %s", name, strerror(rc));
+		if (!!created_task)
+			*created_task = NULL;
+		free(task);
+		return pdFAIL;
+	}
+
+	return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+	if (!!task && task != xTaskGetCurrentTaskHandle()) {
+		ESP_LOGE(HOST_TAG, "Deleting another task is not supported");
+		return;
+	}
+	//the task struct stays, handles to it may still be notified
+	pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+	struct timespec deadline;
+
+	host_deadline(MAX(ticks, 1), &deadline);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+		;
+}
+
+TickType_t xTaskGetTickCount(void) {
+	struct timespec now;
+
+	pthread_once(&start_once, host_start_time);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (TickType_t)(((int64_t)(now.tv_sec - start_time.tv_sec) * 1000 + (now.tv_nsec - start_time.tv_nsec) / 1000000) / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+	//threads not made by xTaskCreatePinnedToCore, as main, get one on first use
+	if (!current_task)
+		current_task = host_task_new("main");
+	return current_task;
+}
+
+const char *pcTaskGetTaskName(TaskHandle_t task) {
+	return (!!task ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+	pthread_mutex_lock(&task->lock);
+	task->notify++;
+	pthread_cond_signal(&task->cond);
+	pthread_mutex_unlock(&task->lock);
+
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+	struct host_task *task = xTaskGetCurrentTaskHandle();
+	uint32_t value;
+
+	pthread_mutex_lock(&task->lock);
+	HOST_WAIT(&task->cond, &task->lock, ticks_to_wait, !!task->notify);
+	value = task->notify;
+	if (!!value)
+		task->notify = clear_on_exit ? 0 : value - 1;
+	pthread_mutex_unlock(&task->lock);
+
+	return value;
+}
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux) {
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mux->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+	struct host_semaphore *semaphore = calloc(1, sizeof(struct host_semaphore));
+
+	if (!semaphore)
+		return NULL;
+	pthread_mutex_init(&semaphore->lock, NULL);
+	host_cond_init(&semaphore->cond);
+	semaphore->count = initial_count;
+	semaphore->max_count = max_count;
+
+	return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+	BaseType_t taken;
+
+	pthread_mutex_lock(&semaphore->lock);
+	if ((taken = HOST_WAIT(&semaphore->cond, &semaphore->lock, ticks_to_wait, !!semaphore->count)))
+		semaphore->count--;
+	pthread_mutex_unlock(&semaphore->lock);
+
+	return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+	BaseType_t given = pdFALSE;
+
+	pthread_mutex_lock(&semaphore->lock);
+	if (semaphore->count < semaphore->max_count) {
+		semaphore->count++;
+		pthread_cond_signal(&semaphore->cond);
+		given = pdTRUE;
+	}
+	pthread_mutex_unlock(&semaphore->lock);
+
+	return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+	pthread_mutex_destroy(&semaphore->lock);
+	pthread_cond_destroy(&semaphore->cond);
+	free(semaphore);
+}
@@ -0,0 +1,688 @@
+/*
+ * host_httpd.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "host.h"
+
+//request line and headers, the same limits as the firmware
+#define HTTPD_HEAD_MAX (HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN + 32)
+#define HTTPD_PURGE_BUF_LEN 512
+
+typedef struct {
+	int fd;
+	uint64_t lru;
+	char buf[HTTPD_HEAD_MAX];
+	size_t len;
+} httpd_sess_t;
+
+typedef struct {
+	const char *field;
+	const char *value;
+} httpd_hdr_t;
+
+typedef struct {
+	httpd_config_t config;
+	int listen_fd;
+	httpd_uri_t *handlers;
+	size_t handler_count;
+	httpd_sess_t *sessions;
+	uint64_t lru_counter;
+	volatile bool stop;
+} httpd_data_t;
+
+typedef struct {
+	httpd_sess_t *sess;
+	//header lines of the request, NUL terminated in the session buffer
+	char *headers;
+	//body bytes that came in with the head
+	size_t pending_off;
+	size_t pending_len;
+	size_t remaining;
+	const char *status;
+	const char *type;
+	httpd_hdr_t *resp_hdrs;
+	size_t resp_hdr_count;
+	bool head_sent;
+	bool failed;
+} httpd_req_aux_t;
+
+static const struct {
+	const char *status;
+	const char *msg;
+} err_responses[HTTPD_ERR_CODE_MAX] = {
+	[HTTPD_500_INTERNAL_SERVER_ERROR] = { "500 Internal Server Error", "Server has encountered an unexpected error" },
+	[HTTPD_501_METHOD_NOT_IMPLEMENTED] = { "501 Method Not Implemented", "Request method is not supported by server" },
+	[HTTPD_505_VERSION_NOT_SUPPORTED] = { "505 Version Not Supported", "HTTP version not supported by server" },
+	[HTTPD_400_BAD_REQUEST] = { "400 Bad Request", "Server unable to understand request due to invalid syntax" },
+	[HTTPD_401_UNAUTHORIZED] = { "401 Unauthorized", "Server known the client's identify and it must authenticate itself to get he requested resource" },
+	[HTTPD_403_FORBIDDEN] = { "403 Forbidden", "Server is refusing to give requested resource to client" },
+	[HTTPD_404_NOT_FOUND] = { "404 Not Found", "This URI does not exist" },
+	[HTTPD_405_METHOD_NOT_ALLOWED] = { "405 Method Not Allowed", "Request method for this URI is not handled by server" },
+	[HTTPD_408_REQ_TIMEOUT] = { "408 Request Timeout", "Server closed this connection" },
+	[HTTPD_411_LENGTH_REQUIRED] = { "411 Length Required", "Chunked encoding not supported" },
+	[HTTPD_414_URI_TOO_LONG] = { "414 URI Too Long", "URI is too long" },
+	[HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = { "431 Request Header Fields Too Large", "Header fields are too long" },
+};
+
+static const struct {
+	const char *name;
+	httpd_method_t method;
+} methods[] = {
+	{ "DELETE", HTTP_DELETE },
+	{ "GET", HTTP_GET },
+	{ "HEAD", HTTP_HEAD },
+	{ "POST", HTTP_POST },
+	{ "PUT", HTTP_PUT },
+	{ "CONNECT", HTTP_CONNECT },
+	{ "OPTIONS", HTTP_OPTIONS },
+	{ "TRACE", HTTP_TRACE },
+	{ "PATCH", HTTP_PATCH },
+};
+
+static void httpd_task(void *pvParameters);
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+	httpd_data_t *hd;
+	struct sockaddr_in addr;
+	int on = 1;
+
+	if (!(hd = calloc(1, sizeof(httpd_data_t))))
+		return ESP_ERR_HTTPD_ALLOC_MEM;
+	hd->config = *config;
+	hd->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+	hd->sessions = calloc(config->max_open_sockets, sizeof(httpd_sess_t));
+	if (!hd->handlers || !hd->sessions)
+		goto err_start;
+	for (int i = 0; i < config->max_open_sockets; i++)
+		hd->sessions[i].fd = -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(config->server_port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if ((hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		goto err_start;
+	setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(hd->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(hd->listen_fd, config->backlog_conn)) {
+		ESP_LOGE(HOST_TAG, "HTTP server on port %d: %s", config->server_port, strerror(errno));
+		close(hd->listen_fd);
+		goto err_start;
+	}
+
+	if (xTaskCreatePinnedToCore(httpd_task, "httpd", config->stack_size, hd, config->task_priority, NULL, config->core_id) != pdPASS) {
+		close(hd->listen_fd);
+		free(hd->handlers);
+		free(hd->sessions);
+		free(hd);
+		return ESP_ERR_HTTPD_TASK;
+	}
+
+	*handle = hd;
+	return ESP_OK;
+err_start:
+	free(hd->handlers);
+	free(hd->sessions);
+	free(hd);
+	return ESP_FAIL;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+	httpd_data_t *hd = (httpd_data_t *)handle;
+
+	if (!hd)
+		return ESP_ERR_INVALID_ARG;
+	//the task closes the sessions and frees the server on its way out
+	hd->stop = true;
+	shutdown(hd->listen_fd, SHUT_RDWR);
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+	httpd_data_t *hd = (httpd_data_t *)handle;
+	httpd_uri_t *entry;
+
+	if (!hd || !uri_handler)
+		return ESP_ERR_INVALID_ARG;
+
+	for (size_t i = 0; i < hd->handler_count; i++) {
+		if (hd->handlers[i].method == uri_handler->method && !strcmp(hd->handlers[i].uri, uri_handler->uri))
+			return ESP_ERR_HTTPD_HANDLER_EXISTS;
+	}
+	if (hd->handler_count == hd->config.max_uri_handlers) {
+		ESP_LOGW(HOST_TAG, "No slot left for URI handler %s", uri_handler->uri);
+		return ESP_ERR_HTTPD_HANDLERS_FULL;
+	}
+
+	entry = &hd->handlers[hd->handler_count];
+	*entry = *uri_handler;
+	if (!(entry->uri = strdup(uri_handler->uri)))
+		return ESP_ERR_HTTPD_ALLOC_MEM;
+	hd->handler_count++;
+
+	return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto) {
+	const size_t tpl_len = strlen(uri_template);
+	size_t exact_match_chars = tpl_len;
+	const char last = tpl_len > 0 ? uri_template[tpl_len - 1] : 0;
+	const char prevlast = tpl_len > 1 ? uri_template[tpl_len - 2] : 0;
+	const bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+	const bool quest = last == '?' || (prevlast == '?' && last == '*');
+
+	//"?" with nothing before it is not a valid template
+	if (exact_match_chars < (size_t)(asterisk + quest * 2))
+		return false;
+	exact_match_chars -= asterisk + quest * 2;
+
+	if (match_upto < exact_match_chars)
+		return false;
+
+	if (!quest) {
+		if (!asterisk && match_upto != exact_match_chars)
+			return false;
+		return !strncmp(uri_template, uri_to_match, exact_match_chars);
+	}
+
+	//the character before "?" may be there or not
+	if (match_upto > exact_match_chars && uri_template[exact_match_chars] != uri_to_match[exact_match_chars])
+		return false;
+	if (strncmp(uri_template, uri_to_match, exact_match_chars))
+		return false;
+
+	return asterisk || match_upto <= exact_match_chars + 1;
+}
+
+static bool httpd_send_all(httpd_req_aux_t *aux, const char *buf, size_t len) {
+	ssize_t n;
+
+	while (!aux->failed && len > 0) {
+		if ((n = send(aux->sess->fd, buf, len, MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			aux->failed = true;
+			break;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return !aux->failed;
+}
+
+static bool httpd_send_head(httpd_req_t *r, ssize_t content_len) {
+	httpd_req_aux_t *aux = (httpd_req_aux_t *)r->aux;
+	char head[HTTPD_HEAD_MAX];
+	int len;
+
+	if (content_len >= 0)
+		len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n", aux->status, aux->type, (int)content_len);
+	else
+		len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n", aux->status, aux->type);
+
+	for (size_t i = 0; i < aux->resp_hdr_count && len < (int)sizeof(head); i++)
+		len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n", aux->resp_hdrs[i].field, aux->resp_hdrs[i].value);
+	if (len + 2 >= (int)sizeof(head))
+		return false;
+	len += snprintf(head + len, sizeof(head) - len, "\r\n");
+
+	aux->head_sent = true;
+	return httpd_send_all(aux, head, len);
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+	if (!r || !status)
+		return ESP_ERR_INVALID_ARG;
+	((httpd_req_aux_t *)r->aux)->status = status;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+	if (!r || !type)
+		return ESP_ERR_INVALID_ARG;
+	((httpd_req_aux_t *)r->aux)->type = type;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+	httpd_req_aux_t *aux;
+	httpd_data_t *hd;
+
+	if (!r || !field || !value)
+		return ESP_ERR_INVALID_ARG;
+	aux = (httpd_req_aux_t *)r->aux;
+	hd = (httpd_data_t *)r->handle;
+	if (aux->resp_hdr_count == hd->config.max_resp_headers)
+		return ESP_ERR_HTTPD_RESP_HDR;
+
+	//kept by reference, as the original does, until the response goes out
+	aux->resp_hdrs[aux->resp_hdr_count].field = field;
+	aux->resp_hdrs[aux->resp_hdr_count].value = value;
+	aux->resp_hdr_count++;
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+	httpd_req_aux_t *aux;
+
+	if (!r)
+		return ESP_ERR_INVALID_ARG;
+	aux = (httpd_req_aux_t *)r->aux;
+	if (!buf)
+		buf_len = 0;
+	else if (buf_len == HTTPD_RESP_USE_STRLEN)
+		buf_len = strlen(buf);
+
+	if (!httpd_send_head(r, buf_len) || !httpd_send_all(aux, buf, buf_len))
+		return ESP_ERR_HTTPD_RESP_SEND;
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+	httpd_req_aux_t *aux;
+	char size[12];
+
+	if (!r)
+		return ESP_ERR_INVALID_ARG;
+	aux = (httpd_req_aux_t *)r->aux;
+	if (!buf)
+		buf_len = 0;
+	else if (buf_len == HTTPD_RESP_USE_STRLEN)
+		buf_len = strlen(buf);
+
+	if (!aux->head_sent && !httpd_send_head(r, -1))
+		return ESP_ERR_HTTPD_RESP_SEND;
+
+	snprintf(size, sizeof(size), "%x\r\n", (unsigned)buf_len);
+	if (!httpd_send_all(aux, size, strlen(size)) || !httpd_send_all(aux, buf, buf_len) || !httpd_send_all(aux, "\r\n", 2))
+		return ESP_ERR_HTTPD_RESP_SEND;
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+	if (!req || error >= HTTPD_ERR_CODE_MAX)
+		return ESP_ERR_INVALID_ARG;
+
+	httpd_resp_set_status(req, err_responses[error].status);
+	httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+	return httpd_resp_send(req, !!msg ? msg : err_responses[error].msg, HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+	httpd_req_aux_t *aux;
+	ssize_t n;
+
+	if (!r || !buf)
+		return HTTPD_SOCK_ERR_INVALID;
+	aux = (httpd_req_aux_t *)r->aux;
+	buf_len = MIN(buf_len, aux->remaining);
+	if (!buf_len)
+		return 0;
+
+	if (!!aux->pending_len) {
+		n = MIN(buf_len, aux->pending_len);
+		memcpy(buf, aux->sess->buf + aux->pending_off, n);
+		aux->pending_off += n;
+		aux->pending_len -= n;
+	} else {
+		while ((n = recv(aux->sess->fd, buf, buf_len, 0)) < 0 && errno == EINTR)
+			;
+		if (n < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+		if (!n)
+			return HTTPD_SOCK_ERR_FAIL;
+	}
+	aux->remaining -= n;
+
+	return n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+	return !!r ? ((httpd_req_aux_t *)r->aux)->sess->fd : -1;
+}
+
+static const char *httpd_find_hdr(httpd_req_t *r, const char *field, size_t *val_len) {
+	httpd_req_aux_t *aux = (httpd_req_aux_t *)r->aux;
+	size_t field_len = strlen(field);
+
+	for (const char *line = aux->headers; !!line && *line; ) {
+		const char *end = strstr(line, "\r\n");
+		if (!end)
+			end = line + strlen(line);
+		if ((size_t)(end - line) > field_len && line[field_len] == ':' && !strncasecmp(line, field, field_len)) {
+			const char *val = line + field_len + 1;
+			while (val < end && (*val == ' ' || *val == '\t'))
+				val++;
+			*val_len = end - val;
+			while (*val_len > 0 && (val[*val_len - 1] == ' ' || val[*val_len - 1] == '\t'))
+				(*val_len)--;
+			return val;
+		}
+		line = *end ? end + 2 : end;
+	}
+
+	return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+	size_t len = 0;
+
+	if (!r || !field)
+		return 0;
+	return !!httpd_find_hdr(r, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+	const char *found;
+	size_t len;
+
+	if (!r || !field || !val || !val_size)
+		return ESP_ERR_INVALID_ARG;
+	if (!(found = httpd_find_hdr(r, field, &len)))
+		return ESP_ERR_NOT_FOUND;
+
+	strlcpy(val, found, MIN(len + 1, val_size));
+
+	return len >= val_size ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+	const char *query;
+
+	if (!r || !(query = strchr(r->uri, '?')))
+		return 0;
+	return strlen(query + 1);
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+	const char *query;
+
+	if (!r || !buf || !buf_len)
+		return ESP_ERR_INVALID_ARG;
+	if (!(query = strchr(r->uri, '?')))
+		return ESP_ERR_NOT_FOUND;
+
+	return strlcpy(buf, query + 1, buf_len) >= buf_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+	size_t key_len;
+
+	if (!qry || !key || !val || !val_size)
+		return ESP_ERR_INVALID_ARG;
+	key_len = strlen(key);
+
+	for (const char *pair = qry; !!pair && *pair; ) {
+		const char *end = strchr(pair, '&');
+		size_t pair_len = !!end ? (size_t)(end - pair) : strlen(pair);
+		if (pair_len > key_len && pair[key_len] == '=' && !strncmp(pair, key, key_len)) {
+			size_t len = pair_len - key_len - 1;
+			strlcpy(val, pair + key_len + 1, MIN(len + 1, val_size));
+			return len >= val_size ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+		}
+		pair = !!end ? end + 1 : NULL;
+	}
+
+	return ESP_ERR_NOT_FOUND;
+}
+
+static void httpd_sess_close(httpd_data_t *hd, httpd_sess_t *sess) {
+	if (!!hd->config.close_fn)
+		hd->config.close_fn(hd, sess->fd);
+	else
+		close(sess->fd);
+	sess->fd = -1;
+	sess->len = 0;
+}
+
+static void httpd_sess_accept(httpd_data_t *hd) {
+	httpd_sess_t *sess = NULL, *lru = NULL;
+	struct timeval tv;
+	int fd, on = 1;
+
+	if ((fd = accept(hd->listen_fd, NULL, NULL)) < 0)
+		return;
+
+	for (int i = 0; i < hd->config.max_open_sockets && !sess; i++) {
+		if (hd->sessions[i].fd < 0)
+			sess = &hd->sessions[i];
+		else if (!lru || hd->sessions[i].lru < lru->lru)
+			lru = &hd->sessions[i];
+	}
+	if (!sess && hd->config.lru_purge_enable) {
+		httpd_sess_close(hd, lru);
+		sess = lru;
+	}
+	if (!sess) {
+		close(fd);
+		return;
+	}
+
+	tv.tv_sec = hd->config.recv_wait_timeout;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	tv.tv_sec = hd->config.send_wait_timeout;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	if (!!hd->config.open_fn && hd->config.open_fn(hd, fd) != ESP_OK) {
+		close(fd);
+		return;
+	}
+
+	sess->fd = fd;
+	sess->len = 0;
+	sess->lru = ++hd->lru_counter;
+}
+
+static httpd_uri_t *httpd_find_handler(httpd_data_t *hd, const char *uri, size_t uri_len, int method, httpd_err_code_t *err) {
+	*err = HTTPD_404_NOT_FOUND;
+
+	for (size_t i = 0; i < hd->handler_count; i++) {
+		httpd_uri_t *h = &hd->handlers[i];
+		bool match = !!hd->config.uri_match_fn ? hd->config.uri_match_fn(h->uri, uri, uri_len)
+				: strlen(h->uri) == uri_len && !strncmp(h->uri, uri, uri_len);
+		if (!match)
+			continue;
+		if (h->method == method)
+			return h;
+		*err = HTTPD_405_METHOD_NOT_ALLOWED;
+	}
+
+	return NULL;
+}
+
+static int httpd_parse_method(const char *name, size_t len) {
+	for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		if (strlen(methods[i].name) == len && !strncmp(methods[i].name, name, len))
+			return methods[i].method;
+	}
+	return -1;
+}
+
+/*
+ * Serves the request whose head is complete in the session buffer.
+ * Returns false when the session has to be closed.
+ */
+static bool httpd_process(httpd_data_t *hd, httpd_sess_t *sess, size_t head_len) {
+	httpd_hdr_t resp_hdrs[hd->config.max_resp_headers];
+	httpd_req_aux_t aux = {
+		.sess = sess,
+		.status = HTTPD_200,
+		.type = HTTPD_TYPE_TEXT,
+		.resp_hdrs = resp_hdrs,
+	};
+	httpd_req_t req = {
+		.handle = hd,
+		.aux = &aux,
+	};
+	httpd_err_code_t err = HTTPD_400_BAD_REQUEST;
+	httpd_uri_t *handler;
+	char *line = sess->buf, *sp1, *sp2, *eol;
+	size_t uri_len, consumed;
+	bool keep = true;
+	size_t len;
+	const char *val;
+
+	sess->buf[head_len - 2] = '\0';
+	eol = strstr(line, "\r\n");
+	aux.headers = !!eol ? eol + 2 : NULL;
+	if (!!eol)
+		*eol = '\0';
+
+	if (!(sp1 = strchr(line, ' ')) || !(sp2 = strchr(sp1 + 1, ' ')) || strncmp(sp2 + 1, "HTTP/1.", 7))
+		goto err_request;
+	if ((req.method = httpd_parse_method(line, sp1 - line)) < 0) {
+		err = HTTPD_501_METHOD_NOT_IMPLEMENTED;
+		goto err_request;
+	}
+	uri_len = sp2 - sp1 - 1;
+	if (uri_len > HTTPD_MAX_URI_LEN) {
+		err = HTTPD_414_URI_TOO_LONG;
+		goto err_request;
+	}
+	memcpy((char *)req.uri, sp1 + 1, uri_len);
+	((char *)req.uri)[uri_len] = '\0';
+
+	if (!!httpd_find_hdr(&req, "Transfer-Encoding", &len)) {
+		err = HTTPD_411_LENGTH_REQUIRED;
+		goto err_request;
+	}
+	if (!!(val = httpd_find_hdr(&req, "Content-Length", &len)))
+		req.content_len = strtoul(val, NULL, 10);
+	if (!!(val = httpd_find_hdr(&req, "Connection", &len)) && len == 5 && !strncasecmp(val, "close", 5))
+		keep = false;
+
+	aux.remaining = req.content_len;
+	aux.pending_off = head_len;
+	aux.pending_len = MIN(sess->len - head_len, req.content_len);
+	consumed = head_len + aux.pending_len;
+
+	if (!(handler = httpd_find_handler(hd, req.uri, strcspn(req.uri, "?"), req.method, &err))) {
+		httpd_resp_send_err(&req, err, NULL);
+	} else {
+		req.user_ctx = handler->user_ctx;
+		if (handler->handler(&req) != ESP_OK)
+			keep = false;
+	}
+
+	//whatever of the body the handler left is read and dropped
+	while (keep && !aux.failed && aux.remaining > 0) {
+		char purge[HTTPD_PURGE_BUF_LEN];
+		if (httpd_req_recv(&req, purge, sizeof(purge)) <= 0)
+			keep = false;
+	}
+
+	//the next pipelined request moves to the front
+	memmove(sess->buf, sess->buf + consumed, sess->len - consumed);
+	sess->len -= consumed;
+
+	return keep && !aux.failed;
+err_request:
+	httpd_resp_send_err(&req, err, NULL);
+	return false;
+}
+
+/* Reads what the session has and serves every complete request in it. */
+static bool httpd_sess_read(httpd_data_t *hd, httpd_sess_t *sess) {
+	ssize_t n;
+	char *end;
+
+	if ((n = recv(sess->fd, sess->buf + sess->len, sizeof(sess->buf) - sess->len - 1, 0)) <= 0)
+		return n < 0 && (errno == EINTR || errno == EAGAIN);
+	sess->len += n;
+	sess->lru = ++hd->lru_counter;
+
+	for (;;) {
+		sess->buf[sess->len] = '\0';
+		if (!(end = strstr(sess->buf, "\r\n\r\n"))) {
+			if (sess->len < sizeof(sess->buf) - 1)
+				return true;
+			httpd_req_aux_t aux = { .sess = sess, .type = HTTPD_TYPE_TEXT };
+			httpd_req_t req = { .handle = hd, .aux = &aux };
+			httpd_resp_send_err(&req, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE, NULL);
+			return false;
+		}
+		if (!httpd_process(hd, sess, end + 4 - sess->buf))
+			return false;
+		if (!sess->len)
+			return true;
+	}
+}
+
+static void httpd_task(void *pvParameters) {
+	httpd_data_t *hd = (httpd_data_t *)pvParameters;
+	fd_set read_set;
+	int maxfd, open_count;
+
+	ESP_LOGI(HOST_TAG, "HTTP server on port %d", hd->config.server_port);
+
+	while (!hd->stop) {
+		FD_ZERO(&read_set);
+		maxfd = -1;
+		open_count = 0;
+		for (int i = 0; i < hd->config.max_open_sockets; i++) {
+			if (hd->sessions[i].fd >= 0) {
+				FD_SET(hd->sessions[i].fd, &read_set);
+				maxfd = MAX(maxfd, hd->sessions[i].fd);
+				open_count++;
+			}
+		}
+		//a full server leaves new connections in the backlog
+		if (open_count < hd->config.max_open_sockets || hd->config.lru_purge_enable) {
+			FD_SET(hd->listen_fd, &read_set);
+			maxfd = MAX(maxfd, hd->listen_fd);
+		}
+
+		if (select(maxfd + 1, &read_set, NULL, NULL, NULL) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (int i = 0; i < hd->config.max_open_sockets; i++) {
+			httpd_sess_t *sess = &hd->sessions[i];
+			if (sess->fd >= 0 && FD_ISSET(sess->fd, &read_set) && !httpd_sess_read(hd, sess))
+				httpd_sess_close(hd, sess);
+		}
+		if (FD_ISSET(hd->listen_fd, &read_set))
+			httpd_sess_accept(hd);
+	}
+
+	for (int i = 0; i < hd->config.max_open_sockets; i++) {
+		if (hd->sessions[i].fd >= 0)
+			httpd_sess_close(hd, &hd->sessions[i]);
+	}
+	close(hd->listen_fd);
+	for (size_t i = 0; i < hd->handler_count; i++)
+		free((char *)hd->handlers[i].uri);
+	free(hd->handlers);
+	free(hd->sessions);
+	free(hd);
+
+	vTaskDelete(NULL);
+}
@@ -0,0 +1,239 @@
+/*
+ * host_jpeg.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/param.h>
+#include <jpeglib.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_camera.h"
+#include "esp_jpg_decode.h"
+#include "img_converters.h"
+
+#include "host.h"
+
+//the driver hands the encoded stream to the callback in pieces of this size
+#define JPEG_OUT_CHUNK 1024
+
+typedef struct {
+	struct jpeg_error_mgr mgr;
+	jmp_buf jump;
+} jpeg_error_t;
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+	jpeg_error_t *err = (jpeg_error_t *)cinfo->err;
+	char msg[JMSG_LENGTH_MAX];
+
+	cinfo->err->format_message(cinfo, msg);
+	ESP_LOGD(HOST_TAG, "libjpeg: %s", msg);
+	longjmp(err->jump, 1);
+}
+
+/* One row of a raw frame to the input layout libjpeg is set up for. */
+static void jpeg_convert_row(const uint8_t *src, uint8_t *dst, uint16_t width, pixformat_t format) {
+	switch (format) {
+	case PIXFORMAT_RGB565:
+		for (uint16_t x = 0; x < width; x++, src += 2) {
+			uint16_t px = (src[0] << 8) | src[1];
+			*dst++ = (px >> 8) & 0xf8;
+			*dst++ = (px >> 3) & 0xfc;
+			*dst++ = (px << 3) & 0xf8;
+		}
+		break;
+	case PIXFORMAT_YUV422:
+		for (uint16_t x = 0; x < width; x++) {
+			int y = src[(x & ~1) * 2 + (x & 1) * 2];
+			int u = src[(x & ~1) * 2 + 1] - 128;
+			int v = src[(x & ~1) * 2 + 3] - 128;
+			*dst++ = MIN(MAX(y + ((359 * v) >> 8), 0), 255);
+			*dst++ = MIN(MAX(y - ((88 * u + 183 * v) >> 8), 0), 255);
+			*dst++ = MIN(MAX(y + ((454 * u) >> 8), 0), 255);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static bool jpeg_encode(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+		unsigned char **out, unsigned long *out_len) {
+	struct jpeg_compress_struct cinfo;
+	jpeg_error_t err;
+	size_t src_stride;
+	//set after setjmp(), read after a longjmp()
+	uint8_t * volatile row = NULL;
+
+	switch (format) {
+	case PIXFORMAT_GRAYSCALE:
+		src_stride = width;
+		break;
+	case PIXFORMAT_RGB565:
+	case PIXFORMAT_YUV422:
+		src_stride = width * 2;
+		break;
+	case PIXFORMAT_RGB888:
+		src_stride = width * 3;
+		break;
+	default:
+		ESP_LOGE(HOST_TAG, "JPEG encode of pixformat %d is not supported", format);
+		return false;
+	}
+	if (src_len < src_stride * height)
+		return false;
+
+	*out = NULL;
+	*out_len = 0;
+	cinfo.err = jpeg_std_error(&err.mgr);
+	err.mgr.error_exit = jpeg_error_exit;
+	if (setjmp(err.jump)) {
+		jpeg_destroy_compress(&cinfo);
+		free(row);
+		free(*out);
+		*out = NULL;
+		return false;
+	}
+
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, out, out_len);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	if (format == PIXFORMAT_GRAYSCALE) {
+		cinfo.input_components = 1;
+		cinfo.in_color_space = JCS_GRAYSCALE;
+	} else {
+		cinfo.input_components = 3;
+		//RGB888 frames of the driver are in BGR order
+		cinfo.in_color_space = format == PIXFORMAT_RGB888 ? JCS_EXT_BGR : JCS_RGB;
+	}
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, MIN(MAX(quality, 1), 100), TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+
+	if (format == PIXFORMAT_RGB565 || format == PIXFORMAT_YUV422)
+		row = malloc(width * 3);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW rows[1];
+		uint8_t *line = src + cinfo.next_scanline * src_stride;
+		if (!!row) {
+			jpeg_convert_row(line, row, width, format);
+			line = row;
+		}
+		rows[0] = line;
+		jpeg_write_scanlines(&cinfo, rows, 1);
+	}
+
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(row);
+
+	return true;
+}
+
+bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void *arg) {
+	unsigned char *jpg;
+	unsigned long jpg_len;
+	bool ok = true;
+
+	if (!jpeg_encode(src, src_len, width, height, format, quality, &jpg, &jpg_len))
+		return false;
+
+	for (size_t index = 0; ok && index < jpg_len; index += JPEG_OUT_CHUNK) {
+		size_t len = MIN(jpg_len - index, JPEG_OUT_CHUNK);
+		ok = cb(arg, index, jpg + index, len) == len;
+	}
+	free(jpg);
+
+	return ok;
+}
+
+bool frame2jpg_cb(camera_fb_t *fb, uint8_t quality, jpg_out_cb cb, void *arg) {
+	return fmt2jpg_cb(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, cb, arg);
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t **out, size_t *out_len) {
+	unsigned char *jpg;
+	unsigned long jpg_len;
+
+	if (!jpeg_encode(src, src_len, width, height, format, quality, &jpg, &jpg_len))
+		return false;
+
+	*out = jpg;
+	*out_len = jpg_len;
+
+	return true;
+}
+
+bool frame2jpg(camera_fb_t *fb, uint8_t quality, uint8_t **out, size_t *out_len) {
+	return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+}
+
+/*
+ * The output size is the JPEG size divided by the scale, rounded down as
+ * the driver's decoder does, and every row is written on its own.
+ */
+esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void *arg) {
+	struct jpeg_decompress_struct cinfo;
+	jpeg_error_t err;
+	uint8_t *src = NULL;
+	uint8_t * volatile row = NULL;
+	uint16_t width, height;
+
+	if (!(src = malloc(len)) || reader(arg, 0, src, len) != len) {
+		free(src);
+		return ESP_FAIL;
+	}
+
+	cinfo.err = jpeg_std_error(&err.mgr);
+	err.mgr.error_exit = jpeg_error_exit;
+	if (setjmp(err.jump)) {
+		jpeg_destroy_decompress(&cinfo);
+		free(row);
+		free(src);
+		return ESP_FAIL;
+	}
+
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, src, len);
+	jpeg_read_header(&cinfo, TRUE);
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = 1 << scale;
+	cinfo.out_color_space = JCS_RGB;
+	jpeg_start_decompress(&cinfo);
+
+	width = cinfo.image_width >> scale;
+	height = cinfo.image_height >> scale;
+	row = malloc(cinfo.output_width * 3);
+
+	if (!row) {
+		jpeg_abort_decompress(&cinfo);
+		longjmp(err.jump, 1);
+	}
+	//as the driver, the return of the start call is ignored
+	writer(arg, 0, 0, width, height, NULL);
+
+	while (cinfo.output_scanline < cinfo.output_height) {
+		JSAMPROW rows[1] = { row };
+		uint16_t y = cinfo.output_scanline;
+		jpeg_read_scanlines(&cinfo, rows, 1);
+		if (y < height && !writer(arg, 0, y, width, 1, row)) {
+			jpeg_abort_decompress(&cinfo);
+			longjmp(err.jump, 1);
+		}
+	}
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	free(row);
+	free(src);
+
+	writer(arg, width, height, width, height, NULL);
+
+	return ESP_OK;
+}
@@ -0,0 +1,124 @@
+/*
+ * host_main.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Entry point of the host build, in place of main.c: the same modules start
+ * in the same order, with the simulated camera and no Wi-Fi to connect.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "host.h"
+#include "app_camera.h"
+#include "app_encode.h"
+#include "app_frame.h"
+#include "app_httpd.h"
+#include "app_mcast.h"
+#include "app_mdns.h"
+#include "app_motion.h"
+#include "app_rtsp.h"
+#include "app_thumb.h"
+#include "app_www.h"
+
+static const struct option options[] = {
+	{ "frames", required_argument, NULL, 'f' },
+	{ "fps", required_argument, NULL, 'r' },
+	{ "still", no_argument, NULL, 's' },
+	{ "www", required_argument, NULL, 'w' },
+	{ "mdns-port", required_argument, NULL, 'm' },
+	{ "log-level", required_argument, NULL, 'l' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --frames DIR      replay the .jpg files of DIR, in name order\n"
+		"  --fps N           frames per second of the sensor (default 25)\n"
+		"  --still           synthetic frames without moving parts\n"
+		"  --www IMAGE       serve the web app from an image of tools/www_pack.py\n"
+		"  --mdns-port PORT  mDNS port on the loopback (default 5353)\n"
+		"  --log-level N     0 none .. 5 verbose (default 3)\n", name);
+}
+
+int main(int argc, char *argv[]) {
+	host_camera_config_t camera = { .frames_dir = NULL, .fps = 25, .still = false };
+	const char *www = NULL;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "f:r:sw:m:l:h", options, NULL)) != -1) {
+		switch (opt) {
+		case 'f':
+			camera.frames_dir = optarg;
+			break;
+		case 'r':
+			camera.fps = atoi(optarg);
+			break;
+		case 's':
+			camera.still = true;
+			break;
+		case 'w':
+			www = optarg;
+			break;
+		case 'm':
+			host_mdns_set_port(atoi(optarg));
+			break;
+		case 'l':
+			esp_log_level_set("*", atoi(optarg));
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (camera.fps <= 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	//a viewer going away must fail the send, not end the process
+	signal(SIGPIPE, SIG_IGN);
+
+	host_camera_configure(&camera);
+
+	ESP_ERROR_CHECK(init_camera());
+	ESP_ERROR_CHECK(init_frame_hub());
+	ESP_ERROR_CHECK(init_thumb_cache());
+	ESP_ERROR_CHECK(init_encode_pool());
+	ESP_ERROR_CHECK(init_motion());
+#if CONFIG_CAM_WEB_DEPLOY_SF
+	//without an image every page is a 404, the API is served all the same
+	if (!!www) {
+		ESP_ERROR_CHECK(host_partition_set_image(www));
+		ESP_ERROR_CHECK(init_www());
+	}
+#else
+	(void)www;
+#endif
+	ESP_ERROR_CHECK(init_server(CONFIG_CAM_WEB_MOUNT_POINT));
+#if CONFIG_CAM_RTSP_ENABLE
+	ESP_ERROR_CHECK(init_rtsp_server(CONFIG_CAM_RTSP_PORT));
+#endif
+#if CONFIG_CAM_MCAST_ENABLE
+	ESP_ERROR_CHECK(init_mcast());
+#endif
+	ESP_ERROR_CHECK(app_mdns_main());
+
+	ESP_LOGI(HOST_TAG, "API on http://127.0.0.1:%u, stream on port %d", app_httpd_port(), CONFIG_CAM_STREAM_PORT);
+
+	for (;;)
+		pause();
+
+	return EXIT_SUCCESS;
+}
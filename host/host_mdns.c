@@ -0,0 +1,627 @@
+/*
+ * host_mdns.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mdns.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "host.h"
+
+#define MDNS_GROUP "224.0.0.251"
+#define MDNS_DEFAULT_PORT 5353
+#define MDNS_PACKET_MAX 1460
+#define MDNS_NAME_MAX 256
+#define MDNS_SERVICES_MAX 8
+#define MDNS_TXT_MAX 16
+#define MDNS_TTL_PTR 4500
+#define MDNS_TTL 120
+#define MDNS_CLASS_IN 0x0001
+#define MDNS_CLASS_FLUSH 0x8000
+#define MDNS_FLAGS_RESPONSE 0x8400
+
+typedef struct {
+	char *instance;
+	char *service;
+	char *proto;
+	uint16_t port;
+	mdns_txt_item_t txt[MDNS_TXT_MAX];
+	size_t txt_count;
+} mdns_service_t;
+
+typedef struct {
+	const uint8_t *buf;
+	size_t len;
+	size_t pos;
+} mdns_reader_t;
+
+typedef struct {
+	bool active;
+	char name[MDNS_NAME_MAX];
+	size_t max_results;
+	size_t count;
+	mdns_result_t *results;
+} mdns_query_t;
+
+static uint16_t mdns_port = MDNS_DEFAULT_PORT;
+static int mdns_fd = -1;
+static struct sockaddr_in group_addr;
+
+static char *hostname = NULL;
+static char *instance_name = NULL;
+static mdns_service_t services[MDNS_SERVICES_MAX];
+static size_t service_count = 0;
+static mdns_query_t query;
+
+static pthread_mutex_t mdns_lock = PTHREAD_MUTEX_INITIALIZER;
+static SemaphoreHandle_t query_lock = NULL;
+
+static void mdns_task(void *pvParameters);
+
+void host_mdns_set_port(uint16_t port) {
+	mdns_port = port;
+}
+
+/*
+ * Joins the group on the loopback, where every instance on the host binds
+ * the same port and gets every query and answer.
+ */
+esp_err_t mdns_init(void) {
+	struct sockaddr_in addr;
+	struct ip_mreq mreq;
+	struct in_addr lo = { .s_addr = htonl(INADDR_LOOPBACK) };
+	uint8_t loop = 1, ttl = 255;
+	int on = 1;
+
+	if (mdns_fd >= 0)
+		return ESP_ERR_INVALID_STATE;
+
+	memset(&group_addr, 0, sizeof(group_addr));
+	group_addr.sin_family = AF_INET;
+	group_addr.sin_port = htons(mdns_port);
+	inet_aton(MDNS_GROUP, &group_addr.sin_addr);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(mdns_port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	mreq.imr_multiaddr = group_addr.sin_addr;
+	mreq.imr_interface = lo;
+
+	if ((mdns_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return ESP_FAIL;
+	setsockopt(mdns_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	setsockopt(mdns_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+	if (bind(mdns_fd, (struct sockaddr *)&addr, sizeof(addr))
+			|| setsockopt(mdns_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))
+			|| setsockopt(mdns_fd, IPPROTO_IP, IP_MULTICAST_IF, &lo, sizeof(lo))
+			|| setsockopt(mdns_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop))
+			|| setsockopt(mdns_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl))) {
+		ESP_LOGE(HOST_TAG, "mDNS on port %d: %s", mdns_port, strerror(errno));
+		goto err_init;
+	}
+
+	if (!(query_lock = xSemaphoreCreateMutex()))
+		goto err_init;
+	if (xTaskCreatePinnedToCore(mdns_task, "mdns", 4096, NULL, 5, NULL, tskNO_AFFINITY) != pdPASS)
+		goto err_init;
+
+	ESP_LOGI(HOST_TAG, "mDNS on " MDNS_GROUP ":%d, loopback", mdns_port);
+
+	return ESP_OK;
+err_init:
+	close(mdns_fd);
+	mdns_fd = -1;
+	return ESP_FAIL;
+}
+
+void mdns_free(void) {
+	//the responder task keeps the socket, services simply stop answering
+	pthread_mutex_lock(&mdns_lock);
+	service_count = 0;
+	pthread_mutex_unlock(&mdns_lock);
+}
+
+static esp_err_t mdns_set_str(char **dst, const char *src) {
+	char *copy;
+
+	if (!src)
+		return ESP_ERR_INVALID_ARG;
+	if (!(copy = strdup(src)))
+		return ESP_ERR_NO_MEM;
+
+	pthread_mutex_lock(&mdns_lock);
+	free(*dst);
+	*dst = copy;
+	pthread_mutex_unlock(&mdns_lock);
+
+	return ESP_OK;
+}
+
+esp_err_t mdns_hostname_set(const char *name) {
+	return mdns_set_str(&hostname, name);
+}
+
+esp_err_t mdns_instance_name_set(const char *name) {
+	return mdns_set_str(&instance_name, name);
+}
+
+static mdns_service_t *mdns_service_find(const char *service_type, const char *proto) {
+	for (size_t i = 0; i < service_count; i++) {
+		if (!strcasecmp(services[i].service, service_type) && !strcasecmp(services[i].proto, proto))
+			return &services[i];
+	}
+	return NULL;
+}
+
+static esp_err_t mdns_txt_set(mdns_service_t *service, const char *key, const char *value) {
+	mdns_txt_item_t *item = NULL;
+
+	for (size_t i = 0; i < service->txt_count && !item; i++) {
+		if (!strcmp(service->txt[i].key, key))
+			item = &service->txt[i];
+	}
+	if (!item) {
+		if (service->txt_count == MDNS_TXT_MAX)
+			return ESP_ERR_NO_MEM;
+		item = &service->txt[service->txt_count++];
+		item->key = strdup(key);
+		item->value = NULL;
+	}
+
+	free((char *)item->value);
+	item->value = strdup(!!value ? value : "");
+
+	return !!item->key && !!item->value ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t mdns_service_add(const char *instance, const char *service_type, const char *proto, uint16_t port, mdns_txt_item_t txt[], size_t num_items) {
+	mdns_service_t *service;
+	esp_err_t err = ESP_OK;
+
+	if (!service_type || !proto)
+		return ESP_ERR_INVALID_ARG;
+
+	pthread_mutex_lock(&mdns_lock);
+	if (!!mdns_service_find(service_type, proto)) {
+		err = ESP_ERR_INVALID_ARG;
+	} else if (service_count == MDNS_SERVICES_MAX) {
+		err = ESP_ERR_NO_MEM;
+	} else {
+		service = &services[service_count++];
+		memset(service, 0, sizeof(mdns_service_t));
+		service->instance = !!instance ? strdup(instance) : NULL;
+		service->service = strdup(service_type);
+		service->proto = strdup(proto);
+		service->port = port;
+		for (size_t i = 0; i < num_items && err == ESP_OK; i++)
+			err = mdns_txt_set(service, txt[i].key, txt[i].value);
+	}
+	pthread_mutex_unlock(&mdns_lock);
+
+	return err;
+}
+
+esp_err_t mdns_service_port_set(const char *service_type, const char *proto, uint16_t port) {
+	mdns_service_t *service;
+	esp_err_t err = ESP_ERR_NOT_FOUND;
+
+	pthread_mutex_lock(&mdns_lock);
+	if (!!(service = mdns_service_find(service_type, proto))) {
+		service->port = port;
+		err = ESP_OK;
+	}
+	pthread_mutex_unlock(&mdns_lock);
+
+	return err;
+}
+
+esp_err_t mdns_service_txt_item_set(const char *service_type, const char *proto, const char *key, const char *value) {
+	mdns_service_t *service;
+	esp_err_t err = ESP_ERR_NOT_FOUND;
+
+	if (!key)
+		return ESP_ERR_INVALID_ARG;
+
+	pthread_mutex_lock(&mdns_lock);
+	if (!!(service = mdns_service_find(service_type, proto)))
+		err = mdns_txt_set(service, key, value);
+	pthread_mutex_unlock(&mdns_lock);
+
+	return err;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t val) {
+	*p++ = val >> 8;
+	*p++ = val;
+	return p;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t val) {
+	p = put_u16(p, val >> 16);
+	return put_u16(p, val);
+}
+
+/* Labels of a dotted name, uncompressed. NULL when it does not fit. */
+static uint8_t *put_name(uint8_t *p, const uint8_t *end, const char *name) {
+	while (*name) {
+		size_t len = strcspn(name, ".");
+		if (!len || len > 63 || p + 1 + len >= end)
+			return NULL;
+		*p++ = len;
+		memcpy(p, name, len);
+		p += len;
+		name += len;
+		if (*name == '.')
+			name++;
+	}
+	if (p >= end)
+		return NULL;
+	*p++ = 0;
+	return p;
+}
+
+static uint8_t *put_record(uint8_t *p, const uint8_t *end, const char *name, uint16_t type, uint16_t class, uint32_t ttl, uint8_t **rdlen) {
+	if (!(p = put_name(p, end, name)) || p + 10 > end)
+		return NULL;
+	p = put_u16(p, type);
+	p = put_u16(p, class);
+	p = put_u32(p, ttl);
+	*rdlen = p;
+	return p + 2;
+}
+
+static void end_record(uint8_t *rdlen, uint8_t *p) {
+	put_u16(rdlen, p - rdlen - 2);
+}
+
+/*
+ * PTR to the instance as the answer, its SRV, TXT and the A record of the
+ * host as additional records, all in one packet.
+ */
+static size_t mdns_build_response(uint8_t *buf, const mdns_service_t *service) {
+	const uint8_t *end = buf + MDNS_PACKET_MAX;
+	char type_name[MDNS_NAME_MAX], inst_name[MDNS_NAME_MAX], host_name[MDNS_NAME_MAX];
+	uint8_t *p = buf, *rdlen;
+
+	if (snprintf(type_name, sizeof(type_name), "%s.%s.local", service->service, service->proto) >= (int)sizeof(type_name)
+			|| snprintf(inst_name, sizeof(inst_name), "%s.%s", !!service->instance ? service->instance : instance_name, type_name) >= (int)sizeof(inst_name)
+			|| snprintf(host_name, sizeof(host_name), "%s.local", hostname) >= (int)sizeof(host_name))
+		return 0;
+
+	memset(p, 0, 12);
+	put_u16(p + 2, MDNS_FLAGS_RESPONSE);
+	put_u16(p + 6, 1);
+	put_u16(p + 10, 3);
+	p += 12;
+
+	if (!(p = put_record(p, end, type_name, MDNS_TYPE_PTR, MDNS_CLASS_IN, MDNS_TTL_PTR, &rdlen)) || !(p = put_name(p, end, inst_name)))
+		return 0;
+	end_record(rdlen, p);
+
+	if (!(p = put_record(p, end, inst_name, MDNS_TYPE_SRV, MDNS_CLASS_IN | MDNS_CLASS_FLUSH, MDNS_TTL, &rdlen)) || p + 6 > end)
+		return 0;
+	p = put_u16(p, 0);
+	p = put_u16(p, 0);
+	p = put_u16(p, service->port);
+	if (!(p = put_name(p, end, host_name)))
+		return 0;
+	end_record(rdlen, p);
+
+	if (!(p = put_record(p, end, inst_name, MDNS_TYPE_TXT, MDNS_CLASS_IN | MDNS_CLASS_FLUSH, MDNS_TTL, &rdlen)))
+		return 0;
+	for (size_t i = 0; i < service->txt_count; i++) {
+		size_t len = strlen(service->txt[i].key) + 1 + strlen(service->txt[i].value);
+		if (len > 255 || p + 1 + len > end)
+			return 0;
+		*p++ = len;
+		p += sprintf((char *)p, "%s=%s", service->txt[i].key, service->txt[i].value);
+	}
+	if (!service->txt_count) {
+		if (p >= end)
+			return 0;
+		*p++ = 0;
+	}
+	end_record(rdlen, p);
+
+	if (!(p = put_record(p, end, host_name, MDNS_TYPE_A, MDNS_CLASS_IN | MDNS_CLASS_FLUSH, MDNS_TTL, &rdlen)) || p + 4 > end)
+		return 0;
+	*p++ = 127;
+	*p++ = 0;
+	*p++ = 0;
+	*p++ = 1;
+	end_record(rdlen, p);
+
+	return p - buf;
+}
+
+static bool get_u16(mdns_reader_t *r, uint16_t *val) {
+	if (r->pos + 2 > r->len)
+		return false;
+	*val = (r->buf[r->pos] << 8) | r->buf[r->pos + 1];
+	r->pos += 2;
+	return true;
+}
+
+/* A dotted name, following compression pointers. */
+static bool get_name(mdns_reader_t *r, char *name, size_t size) {
+	size_t pos = r->pos, len = 0;
+	bool jumped = false;
+	int hops = 0;
+
+	for (;;) {
+		if (pos >= r->len)
+			return false;
+		uint8_t label = r->buf[pos];
+		if ((label & 0xc0) == 0xc0) {
+			if (pos + 1 >= r->len || ++hops > 16)
+				return false;
+			if (!jumped)
+				r->pos = pos + 2;
+			jumped = true;
+			pos = ((label & 0x3f) << 8) | r->buf[pos + 1];
+			continue;
+		}
+		if (!label) {
+			if (!jumped)
+				r->pos = pos + 1;
+			break;
+		}
+		if (pos + 1 + label > r->len || len + label + 2 > size)
+			return false;
+		if (!!len)
+			name[len++] = '.';
+		memcpy(name + len, r->buf + pos + 1, label);
+		len += label;
+		pos += 1 + label;
+	}
+	name[len] = '\0';
+
+	return true;
+}
+
+static mdns_result_t *mdns_result_for(const char *inst_name) {
+	size_t label = strcspn(inst_name, ".");
+
+	for (mdns_result_t *result = query.results; !!result; result = result->next) {
+		if (strlen(result->instance_name) == label && !strncmp(result->instance_name, inst_name, label))
+			return result;
+	}
+	return NULL;
+}
+
+static void mdns_result_txt(mdns_result_t *result, mdns_reader_t *r, size_t end) {
+	if (!!result->txt)
+		return;
+	result->txt = calloc(MDNS_TXT_MAX, sizeof(mdns_txt_item_t));
+	while (!!result->txt && r->pos < end && result->txt_count < MDNS_TXT_MAX) {
+		uint8_t len = r->buf[r->pos++];
+		const char *item = (const char *)r->buf + r->pos;
+		const char *eq = memchr(item, '=', len);
+		if (r->pos + len > end)
+			break;
+		r->pos += len;
+		if (!len)
+			continue;
+		mdns_txt_item_t *txt = &result->txt[result->txt_count++];
+		txt->key = strndup(item, !!eq ? (size_t)(eq - item) : len);
+		txt->value = !!eq ? strndup(eq + 1, len - (eq - item) - 1) : NULL;
+	}
+}
+
+/* Merges the records of an answer into the running query, own ones left out. */
+static void mdns_parse_response(const uint8_t *buf, size_t len) {
+	mdns_reader_t r = { .buf = buf, .len = len, .pos = 12 };
+	char name[MDNS_NAME_MAX], target[MDNS_NAME_MAX], own_host[MDNS_NAME_MAX];
+	uint16_t qdcount, records, type, class, rdlen;
+
+	if (len < 12)
+		return;
+	qdcount = (buf[4] << 8) | buf[5];
+	records = ((buf[6] << 8) | buf[7]) + ((buf[8] << 8) | buf[9]) + ((buf[10] << 8) | buf[11]);
+	snprintf(own_host, sizeof(own_host), "%s.local", !!hostname ? hostname : "");
+
+	for (uint16_t i = 0; i < qdcount; i++) {
+		if (!get_name(&r, name, sizeof(name)) || !get_u16(&r, &type) || !get_u16(&r, &class))
+			return;
+	}
+
+	for (uint16_t i = 0; i < records; i++) {
+		size_t rdata;
+		if (!get_name(&r, name, sizeof(name)) || !get_u16(&r, &type) || !get_u16(&r, &class) || r.pos + 4 > len)
+			return;
+		r.pos += 4;
+		if (!get_u16(&r, &rdlen) || r.pos + rdlen > len)
+			return;
+		rdata = r.pos;
+
+		mdns_result_t *result;
+		switch (type) {
+		case MDNS_TYPE_PTR:
+			if (!strcasecmp(name, query.name) && get_name(&r, target, sizeof(target)) && !mdns_result_for(target)
+					&& (!query.max_results || query.count < query.max_results) && !!(result = calloc(1, sizeof(mdns_result_t)))) {
+				result->tcpip_if = TCPIP_ADAPTER_IF_STA;
+				result->ip_protocol = MDNS_IP_PROTOCOL_V4;
+				result->instance_name = strndup(target, strcspn(target, "."));
+				result->next = query.results;
+				query.results = result;
+				query.count++;
+			}
+			break;
+		case MDNS_TYPE_SRV:
+			if (!!(result = mdns_result_for(name)) && !result->hostname && r.pos + 6 <= len) {
+				r.pos += 4;
+				get_u16(&r, &result->port);
+				if (get_name(&r, target, sizeof(target)))
+					result->hostname = strndup(target, strcspn(target, "."));
+			}
+			break;
+		case MDNS_TYPE_TXT:
+			if (!!(result = mdns_result_for(name)))
+				mdns_result_txt(result, &r, rdata + rdlen);
+			break;
+		case MDNS_TYPE_A:
+			for (result = query.results; rdlen == 4 && !!result; result = result->next) {
+				if (!!result->hostname && !result->addr && strlen(name) > strlen(result->hostname)
+						&& !strncasecmp(name, result->hostname, strlen(result->hostname)) && name[strlen(result->hostname)] == '.'
+						&& !!(result->addr = calloc(1, sizeof(mdns_ip_addr_t)))) {
+					result->addr->addr.type = IPADDR_TYPE_V4;
+					memcpy(&result->addr->addr.u_addr.ip4.addr, buf + rdata, 4);
+				}
+			}
+			break;
+		default:
+			break;
+		}
+		r.pos = rdata + rdlen;
+	}
+
+	//answers of this very process, the application lists itself apart
+	for (mdns_result_t **link = &query.results; !!*link; ) {
+		mdns_result_t *result = *link;
+		if (!!result->hostname && !!hostname && !strcasecmp(result->hostname, hostname)) {
+			*link = result->next;
+			result->next = NULL;
+			mdns_query_results_free(result);
+			query.count--;
+		} else
+			link = &result->next;
+	}
+}
+
+/* Answers PTR queries for the services added here. */
+static void mdns_parse_query(const uint8_t *buf, size_t len) {
+	mdns_reader_t r = { .buf = buf, .len = len, .pos = 12 };
+	char name[MDNS_NAME_MAX], type_name[MDNS_NAME_MAX];
+	uint8_t resp[MDNS_PACKET_MAX];
+	uint16_t qdcount, type, class;
+
+	if (len < 12)
+		return;
+	qdcount = (buf[4] << 8) | buf[5];
+
+	for (uint16_t q = 0; q < qdcount; q++) {
+		if (!get_name(&r, name, sizeof(name)) || !get_u16(&r, &type) || !get_u16(&r, &class))
+			return;
+		if (type != MDNS_TYPE_PTR && type != MDNS_TYPE_ANY)
+			continue;
+
+		pthread_mutex_lock(&mdns_lock);
+		for (size_t i = 0; i < service_count && !!hostname && !!instance_name; i++) {
+			snprintf(type_name, sizeof(type_name), "%s.%s.local", services[i].service, services[i].proto);
+			if (strcasecmp(name, type_name))
+				continue;
+			size_t resp_len = mdns_build_response(resp, &services[i]);
+			if (!!resp_len)
+				sendto(mdns_fd, resp, resp_len, 0, (struct sockaddr *)&group_addr, sizeof(group_addr));
+		}
+		pthread_mutex_unlock(&mdns_lock);
+	}
+}
+
+static void mdns_task(void *pvParameters) {
+	uint8_t buf[MDNS_PACKET_MAX];
+	ssize_t len;
+
+	for (;;) {
+		if ((len = recv(mdns_fd, buf, sizeof(buf), 0)) < 12)
+			continue;
+
+		if (buf[2] & 0x80) {
+			pthread_mutex_lock(&mdns_lock);
+			if (query.active)
+				mdns_parse_response(buf, len);
+			pthread_mutex_unlock(&mdns_lock);
+		} else {
+			mdns_parse_query(buf, len);
+		}
+	}
+	vTaskDelete(NULL);
+}
+
+/*
+ * Sends the query and collects answers until the timeout, or until
+ * max_results instances answered when it is not 0.
+ */
+esp_err_t mdns_query_ptr(const char *service_type, const char *proto, uint32_t timeout, size_t max_results, mdns_result_t **results) {
+	uint8_t buf[MDNS_PACKET_MAX], *p = buf;
+	int64_t deadline = esp_timer_get_time() + (int64_t)timeout * 1000;
+	bool done = false;
+
+	if (mdns_fd < 0)
+		return ESP_ERR_INVALID_STATE;
+	if (!service_type || !proto || !results)
+		return ESP_ERR_INVALID_ARG;
+
+	xSemaphoreTake(query_lock, portMAX_DELAY);
+
+	pthread_mutex_lock(&mdns_lock);
+	memset(&query, 0, sizeof(query));
+	snprintf(query.name, sizeof(query.name), "%s.%s.local", service_type, proto);
+	query.max_results = max_results;
+	query.active = true;
+	pthread_mutex_unlock(&mdns_lock);
+
+	memset(p, 0, 12);
+	put_u16(p + 4, 1);
+	p += 12;
+	if (!!(p = put_name(p, buf + sizeof(buf) - 4, query.name))) {
+		p = put_u16(p, MDNS_TYPE_PTR);
+		p = put_u16(p, MDNS_CLASS_IN);
+		sendto(mdns_fd, buf, p - buf, 0, (struct sockaddr *)&group_addr, sizeof(group_addr));
+	}
+
+	while (!done && esp_timer_get_time() < deadline) {
+		vTaskDelay(pdMS_TO_TICKS(10));
+		pthread_mutex_lock(&mdns_lock);
+		done = !!max_results && query.count >= max_results;
+		pthread_mutex_unlock(&mdns_lock);
+	}
+
+	pthread_mutex_lock(&mdns_lock);
+	query.active = false;
+	*results = query.results;
+	query.results = NULL;
+	pthread_mutex_unlock(&mdns_lock);
+
+	xSemaphoreGive(query_lock);
+
+	return ESP_OK;
+}
+
+void mdns_query_results_free(mdns_result_t *results) {
+	while (!!results) {
+		mdns_result_t *next = results->next;
+		free(results->instance_name);
+		free(results->hostname);
+		for (size_t i = 0; i < results->txt_count; i++) {
+			free((char *)results->txt[i].key);
+			free((char *)results->txt[i].value);
+		}
+		free(results->txt);
+		while (!!results->addr) {
+			mdns_ip_addr_t *addr = results->addr->next;
+			free(results->addr);
+			results->addr = addr;
+		}
+		free(results);
+		results = next;
+	}
+}
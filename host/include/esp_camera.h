@@ -0,0 +1,99 @@
+/*
+ * esp_camera.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Host stand-in for the esp32-camera driver. Frames come from the simulated
+ * sensor of host_camera.c, see host.h for its settings.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "driver/ledc.h"
+#include "sensor.h"
+
+//as the driver the project is configured for, see CAM_DRIVER_FB_CONFIG
+#if CONFIG_CAM_DRIVER_FB_CONFIG
+typedef enum {
+	CAMERA_GRAB_WHEN_EMPTY,
+	CAMERA_GRAB_LATEST
+} camera_grab_mode_t;
+
+typedef enum {
+	CAMERA_FB_IN_PSRAM,
+	CAMERA_FB_IN_DRAM
+} camera_fb_location_t;
+#endif
+
+typedef struct {
+	int pin_pwdn;
+	int pin_reset;
+	int pin_xclk;
+	int pin_sscb_sda;
+	int pin_sscb_scl;
+
+	int pin_d7;
+	int pin_d6;
+	int pin_d5;
+	int pin_d4;
+	int pin_d3;
+	int pin_d2;
+	int pin_d1;
+	int pin_d0;
+	int pin_vsync;
+	int pin_href;
+	int pin_pclk;
+
+	int xclk_freq_hz;
+
+	ledc_timer_t ledc_timer;
+	ledc_channel_t ledc_channel;
+
+	pixformat_t pixel_format;
+	framesize_t frame_size;
+
+	int jpeg_quality;
+	size_t fb_count;
+#if CONFIG_CAM_DRIVER_FB_CONFIG
+	camera_fb_location_t fb_location;
+	camera_grab_mode_t grab_mode;
+#endif
+} camera_config_t;
+
+typedef struct {
+	uint8_t *buf;
+	size_t len;
+	size_t width;
+	size_t height;
+	pixformat_t format;
+	struct timeval timestamp;
+} camera_fb_t;
+
+#define ESP_ERR_CAMERA_BASE 0x20000
+#define ESP_ERR_CAMERA_NOT_DETECTED (ESP_ERR_CAMERA_BASE + 1)
+#define ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE (ESP_ERR_CAMERA_BASE + 2)
+#define ESP_ERR_CAMERA_FAILED_TO_SET_OUT_FORMAT (ESP_ERR_CAMERA_BASE + 3)
+#define ESP_ERR_CAMERA_NOT_SUPPORTED (ESP_ERR_CAMERA_BASE + 4)
+
+esp_err_t esp_camera_init(const camera_config_t *config);
+esp_err_t esp_camera_deinit(void);
+camera_fb_t *esp_camera_fb_get(void);
+void esp_camera_fb_return(camera_fb_t *fb);
+sensor_t *esp_camera_sensor_get(void);
+
+#include "img_converters.h"
+
+#ifdef __cplusplus
+}
+#endif
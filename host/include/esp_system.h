@@ -0,0 +1,53 @@
+/*
+ * esp_system.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Host stand-in, the chip is reported as an ESP32 with the cores of the host.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+typedef enum {
+	CHIP_ESP32 = 1,
+} esp_chip_model_t;
+
+#define CHIP_FEATURE_EMB_FLASH (1 << 0)
+#define CHIP_FEATURE_WIFI_BGN (1 << 1)
+#define CHIP_FEATURE_BLE (1 << 4)
+#define CHIP_FEATURE_BT (1 << 5)
+
+typedef struct {
+	esp_chip_model_t model;
+	uint32_t features;
+	uint8_t cores;
+	uint8_t revision;
+} esp_chip_info_t;
+
+typedef enum {
+	ESP_MAC_WIFI_STA,
+	ESP_MAC_WIFI_SOFTAP,
+	ESP_MAC_BT,
+	ESP_MAC_ETH,
+} esp_mac_type_t;
+
+void esp_chip_info(esp_chip_info_t *out_info);
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
+uint32_t esp_get_free_heap_size(void);
+void esp_restart(void) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
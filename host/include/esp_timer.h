@@ -0,0 +1,23 @@
+/*
+ * esp_timer.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Host stand-in, microseconds of the monotonic clock since start.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,19 @@
+/*
+ * esp_vfs.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Host stand-in, paths go straight to the host file system.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "esp_err.h"
+
+#define ESP_VFS_PATH_MAX 15
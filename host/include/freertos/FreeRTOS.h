@@ -0,0 +1,61 @@
+/*
+ * FreeRTOS.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Host stand-in for the ESP-IDF FreeRTOS port. Tasks are threads, priorities
+ * and core affinity are ignored, a critical section is a recursive mutex.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//the port of the IDF brings these in, the application relies on it
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define configMINIMAL_STACK_SIZE 768
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#define PRO_CPU_NUM 0
+#define APP_CPU_NUM 1
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef struct {
+	pthread_mutex_t lock;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(&(mux)->lock)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(&(mux)->lock)
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux);
+
+#ifdef __cplusplus
+}
+#endif
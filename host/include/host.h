@@ -0,0 +1,41 @@
+/*
+ * host.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Settings of the stand-ins only the host build has, set by host_main.c
+ * before the application modules start.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define HOST_TAG "host"
+
+typedef struct {
+	//directory of .jpg files replayed in name order, synthetic frames when NULL
+	const char *frames_dir;
+	//frames per second the sensor delivers
+	int fps;
+	//synthetic frames only, no moving parts
+	bool still;
+} host_camera_config_t;
+
+void host_camera_configure(const host_camera_config_t *config);
+
+/* Backs the www partition with an image made by tools/www_pack.py. */
+esp_err_t host_partition_set_image(const char *path);
+
+void host_mdns_set_port(uint16_t port);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,18 @@
+/*
+ * host_compat.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Included ahead of every source of the host build, for what newlib has
+ * and the host C library may not.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#if !HAVE_STRLCPY
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#endif
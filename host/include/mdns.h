@@ -0,0 +1,79 @@
+/*
+ * mdns.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Host stand-in for the ESP-IDF mDNS responder. Answers and queries go to
+ * 224.0.0.251 on the loopback interface, so simulated cameras on one host
+ * find each other. Only PTR queries are supported.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "tcpip_adapter.h"
+
+#define MDNS_TYPE_A 0x0001
+#define MDNS_TYPE_PTR 0x000C
+#define MDNS_TYPE_TXT 0x0010
+#define MDNS_TYPE_AAAA 0x001C
+#define MDNS_TYPE_SRV 0x0021
+#define MDNS_TYPE_ANY 0x00FF
+
+typedef enum {
+	MDNS_IP_PROTOCOL_V4,
+	MDNS_IP_PROTOCOL_V6,
+	MDNS_IP_PROTOCOL_MAX
+} mdns_ip_protocol_t;
+
+typedef struct {
+	const char *key;
+	const char *value;
+} mdns_txt_item_t;
+
+typedef struct mdns_ip_addr_s {
+	esp_ip_addr_t addr;
+	struct mdns_ip_addr_s *next;
+} mdns_ip_addr_t;
+
+typedef struct mdns_result_s {
+	struct mdns_result_s *next;
+
+	tcpip_adapter_if_t tcpip_if;
+	mdns_ip_protocol_t ip_protocol;
+
+	char *instance_name;
+
+	char *hostname;
+	uint16_t port;
+
+	mdns_txt_item_t *txt;
+	size_t txt_count;
+
+	mdns_ip_addr_t *addr;
+} mdns_result_t;
+
+esp_err_t mdns_init(void);
+void mdns_free(void);
+
+esp_err_t mdns_hostname_set(const char *hostname);
+esp_err_t mdns_instance_name_set(const char *instance_name);
+
+esp_err_t mdns_service_add(const char *instance_name, const char *service_type, const char *proto, uint16_t port, mdns_txt_item_t txt[], size_t num_items);
+esp_err_t mdns_service_port_set(const char *service_type, const char *proto, uint16_t port);
+esp_err_t mdns_service_txt_item_set(const char *service_type, const char *proto, const char *key, const char *value);
+
+esp_err_t mdns_query_ptr(const char *service_type, const char *proto, uint32_t timeout, size_t max_results, mdns_result_t **results);
+void mdns_query_results_free(mdns_result_t *results);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,65 @@
+/*
+ * tcpip_adapter.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Host stand-in, the station interface is the loopback, 127.0.0.1.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct {
+	uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+	uint32_t addr[4];
+	uint8_t zone;
+} esp_ip6_addr_t;
+
+typedef struct {
+	union {
+		esp_ip6_addr_t ip6;
+		esp_ip4_addr_t ip4;
+	} u_addr;
+	uint8_t type;
+} esp_ip_addr_t;
+
+#define IPADDR_TYPE_V4 0U
+#define IPADDR_TYPE_V6 6U
+#define IPADDR_TYPE_ANY 46U
+
+#define esp_ip4_addr1(ipaddr) (((const uint8_t *)(&(ipaddr)->addr))[0])
+#define esp_ip4_addr2(ipaddr) (((const uint8_t *)(&(ipaddr)->addr))[1])
+#define esp_ip4_addr3(ipaddr) (((const uint8_t *)(&(ipaddr)->addr))[2])
+#define esp_ip4_addr4(ipaddr) (((const uint8_t *)(&(ipaddr)->addr))[3])
+
+#define IP2STR(ipaddr) esp_ip4_addr1(ipaddr), esp_ip4_addr2(ipaddr), esp_ip4_addr3(ipaddr), esp_ip4_addr4(ipaddr)
+#define IPSTR "%d.%d.%d.%d"
+
+typedef struct {
+	esp_ip4_addr_t ip;
+	esp_ip4_addr_t netmask;
+	esp_ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+typedef enum {
+	TCPIP_ADAPTER_IF_STA = 0,
+	TCPIP_ADAPTER_IF_AP,
+	TCPIP_ADAPTER_IF_ETH,
+	TCPIP_ADAPTER_IF_MAX
+} tcpip_adapter_if_t;
+
+esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_ip_info_t *ip_info);
+
+#ifdef __cplusplus
+}
+#endif
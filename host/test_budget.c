@@ -0,0 +1,103 @@
+/*
+ * test_budget.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ *
+ * Checks the frame buffer budget against the sizes the camera driver
+ * allocates, across the quality steps those sizes change at.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "sdkconfig.h"
+
+#include "host.h"
+#include "app_budget.h"
+#include "app_fb_pool.h"
+
+#define VGA_PIXELS (640 * 480)
+
+static int failures = 0;
+
+#define CHECK(expr) do { \
+	if (!(expr)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #expr); \
+		failures++; \
+	} \
+} while (0)
+
+static void test_buffer_len(void) {
+#if CONFIG_CAM_DRIVER_FB_CONFIG
+	CHECK(app_fb_pool_buffer_len(FRAMESIZE_VGA, 5) == VGA_PIXELS / 5);
+	CHECK(app_fb_pool_buffer_len(FRAMESIZE_VGA, 12) == VGA_PIXELS / 5);
+#else
+	//two bytes per pixel over 4 up to quality 5, 10 up to 10, 16 above
+	CHECK(app_fb_pool_buffer_len(FRAMESIZE_VGA, 5) == VGA_PIXELS * 2 / 4);
+	CHECK(app_fb_pool_buffer_len(FRAMESIZE_VGA, 6) == VGA_PIXELS * 2 / 10);
+	CHECK(app_fb_pool_buffer_len(FRAMESIZE_VGA, 10) == VGA_PIXELS * 2 / 10);
+	CHECK(app_fb_pool_buffer_len(FRAMESIZE_VGA, 11) == VGA_PIXELS * 2 / 16);
+#endif
+}
+
+static void test_quality_step(void) {
+	//the pool holds two VGA buffers at quality 10, with 100 KB free besides
+	app_budget_t budget = {
+		.heap_free = 100 * 1000,
+		.heap_largest = 100 * 1000,
+		.pool_len = 2 * app_fb_pool_buffer_len(FRAMESIZE_VGA, 10),
+		.fb_count = 2,
+		.psram = true,
+	};
+	app_budget_entry_t entry;
+
+	app_budget_entry(&budget, FRAMESIZE_VGA, 10, &entry);
+	CHECK(entry.quality == 10);
+	CHECK(entry.buffer_len == app_fb_pool_buffer_len(FRAMESIZE_VGA, 10));
+	CHECK(entry.jpeg_len <= entry.buffer_len);
+	CHECK(entry.fits);
+
+#if !CONFIG_CAM_DRIVER_FB_CONFIG
+	//quality 5 is below the step, its buffers are 2.5 times as large and no longer fit
+	app_budget_entry(&budget, FRAMESIZE_VGA, 5, &entry);
+	CHECK(entry.quality == 5);
+	CHECK(entry.buffer_len == VGA_PIXELS * 2 / 4);
+	CHECK(!entry.fits);
+
+	//the estimate at 12 overflows the smaller buffers above the step, 13 is the first that fits
+	app_budget_entry(&budget, FRAMESIZE_VGA, 12, &entry);
+	CHECK(entry.quality == 13);
+	CHECK(entry.buffer_len == VGA_PIXELS * 2 / 16);
+	CHECK(entry.jpeg_len <= entry.buffer_len);
+	CHECK(entry.fits);
+
+	//no value from 6 to 7 fits the buffers of the middle step
+	app_budget_entry(&budget, FRAMESIZE_VGA, 6, &entry);
+	CHECK(entry.quality == 8);
+	CHECK(entry.fits);
+#endif
+}
+
+int main(void) {
+	host_camera_config_t camera = { .frames_dir = NULL, .fps = 25, .still = true };
+	camera_config_t config = {
+		.pixel_format = PIXFORMAT_JPEG,
+		.frame_size = FRAMESIZE_VGA,
+		.jpeg_quality = 10,
+	};
+
+	host_camera_configure(&camera);
+	if (init_fb_pool(&config) != ESP_OK) {
+		fprintf(stderr, "init_fb_pool failed\n");
+		return EXIT_FAILURE;
+	}
+
+	test_buffer_len();
+	test_quality_step();
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
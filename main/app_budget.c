@@ -0,0 +1,91 @@
+/*
+ * app_budget.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "app_common.h"
+#include "app_camera.h"
+#include "app_fb_pool.h"
+#include "app_budget.h"
+
+/*
+ * JPEG size model: a fixed header (quantization and Huffman tables) plus
+ * about one byte per pixel divided by the quality value, a rough fit of
+ * OV2640 output. The headroom covers detailed scenes.
+ */
+#define BUDGET_JPEG_HEADER_LEN 700
+#define BUDGET_JPEG_HEADROOM_PCT 150
+//left to WiFi, lwIP and the HTTP servers when the buffers live in internal RAM
+#define BUDGET_INTERNAL_RESERVE (48 * 1024)
+
+void app_budget_snapshot(app_budget_t *budget) {
+	app_fb_pool_stats_t stats;
+	app_fb_pool_stats(&stats);
+
+	uint32_t caps = stats.psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+	budget->heap_free = heap_caps_get_free_size(caps);
+	budget->heap_largest = heap_caps_get_largest_free_block(caps);
+	budget->pool_len = stats.count * stats.buffer_len;
+	budget->fb_count = stats.count;
+	budget->psram = stats.psram;
+
+	if (!budget->psram)
+		budget->heap_free = budget->heap_free > BUDGET_INTERNAL_RESERVE ? budget->heap_free - BUDGET_INTERNAL_RESERVE : 0;
+}
+
+static size_t budget_jpeg_len(size_t pixels, int quality) {
+	return BUDGET_JPEG_HEADER_LEN + pixels * BUDGET_JPEG_HEADROOM_PCT / 100 / quality;
+}
+
+void app_budget_entry(const app_budget_t *budget, framesize_t framesize, int quality, app_budget_entry_t *entry) {
+	size_t pixels = (size_t)resolution[framesize].width * resolution[framesize].height;
+
+	//the buffers shrink in steps as the quality value grows, so check each value against its own buffers
+	while (quality < MAX_QUALITY && budget_jpeg_len(pixels, quality) > app_fb_pool_buffer_len(framesize, quality))
+		quality++;
+
+	size_t buffer_len = app_fb_pool_buffer_len(framesize, quality);
+
+	entry->framesize = framesize;
+	entry->quality = quality;
+	entry->buffer_len = buffer_len;
+	entry->jpeg_len = budget_jpeg_len(pixels, quality);
+
+	//the current buffers are freed before the new ones are allocated
+	size_t available = budget->heap_free + budget->pool_len;
+	size_t largest = MAX(budget->heap_largest, budget->pool_len ? budget->pool_len / budget->fb_count : 0);
+	entry->fits = framesize <= APP_FB_POOL_MAX_FRAMESIZE && budget->fb_count * buffer_len <= available && buffer_len <= largest;
+}
+
+esp_err_t app_budget_plan(framesize_t *framesize, int *quality) {
+	app_budget_t budget;
+	app_budget_entry_t entry;
+	framesize_t planned = *framesize;
+
+	app_budget_snapshot(&budget);
+
+	for (;;) {
+		app_budget_entry(&budget, planned, *quality, &entry);
+		if (entry.fits)
+			break;
+		APP_ERROR_CHECK_WITH_MSG(planned > MIN_FRAMESIZE, "No framesize fits the frame buffer budget", err_plan);
+		planned--;
+	}
+
+	if (planned != *framesize || entry.quality != *quality)
+		ESP_LOGW(APP_BUDGET_TAG, "framesize %d -> %d, quality %d -> %d", *framesize, planned, *quality, entry.quality);
+
+	*framesize = planned;
+	*quality = entry.quality;
+
+	return ESP_OK;
+err_plan:
+	return ESP_ERR_NO_MEM;
+}
@@ -5,12 +5,59 @@
  *      Author: ceanm
  */
 
+#include <string.h>
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_system.h"
 #include "esp_camera.h"
 
 #include "app_common.h"
 #include "app_camera.h"
+#include "app_fb_pool.h"
+
+#define STATUS_FIELD(field) \
+    .status = offsetof(camera_status_t, field), \
+    .status_size = sizeof(((camera_status_t *)0)->field)
+
+#define CONTROL(field, lo, hi, set_fn) \
+    { .name = #field, .min = lo, .max = hi, .setter = offsetof(sensor_t, set_fn), STATUS_FIELD(field) }
+
+#define CONTROL_BOOL(field, set_fn) CONTROL(field, 0, 1, set_fn)
+
+typedef int (*control_setter_t)(sensor_t *sensor, int val);
+
+static uint32_t settings_version = 0;
+
+/*
+ * Automatic modes go before the manual values they gate, and framesize goes
+ * last because it reprograms the window and the DSP scaler.
+ */
+static const app_camera_control_t controls[] = {
+    CONTROL_BOOL(awb, set_whitebal),
+    CONTROL_BOOL(awb_gain, set_awb_gain),
+    CONTROL(wb_mode, MIN_WB_MODE, MAX_WB_MODE, set_wb_mode),
+    CONTROL_BOOL(agc, set_gain_ctrl),
+    CONTROL_BOOL(aec, set_exposure_ctrl),
+    CONTROL_BOOL(aec2, set_aec2),
+    CONTROL(agc_gain, MIN_AGC_GAIN, MAX_AGC_GAIN, set_agc_gain),
+    CONTROL(gainceiling, MIN_GAINCEILING, MAX_GAINCEILING, set_gainceiling),
+    CONTROL(aec_value, MIN_AEC_VALUE, MAX_AEC_VALUE, set_aec_value),
+    CONTROL(ae_level, MIN_AE_LEVEL, MAX_AE_LEVEL, set_ae_level),
+    CONTROL(contrast, MIN_CONTRAST, MAX_CONTRAST, set_contrast),
+    CONTROL(brightness, MIN_BRIGHTNESS, MAX_BRIGHTNESS, set_brightness),
+    CONTROL(saturation, MIN_SATURATION, MAX_SATURATION, set_saturation),
+    CONTROL(special_effect, MIN_SPECIAL_EFFECT, MAX_SPECIAL_EFFECT, set_special_effect),
+    CONTROL_BOOL(colorbar, set_colorbar),
+    CONTROL_BOOL(hmirror, set_hmirror),
+    CONTROL_BOOL(vflip, set_vflip),
+    CONTROL_BOOL(dcw, set_dcw),
+    CONTROL_BOOL(bpc, set_bpc),
+    CONTROL_BOOL(wpc, set_wpc),
+    CONTROL_BOOL(raw_gma, set_raw_gma),
+    CONTROL_BOOL(lenc, set_lenc),
+    CONTROL(quality, MIN_QUALITY, MAX_QUALITY, set_quality),
+    { .name = "framesize", .min = MIN_FRAMESIZE, .max = APP_FB_POOL_MAX_FRAMESIZE, .jpeg_only = true, .setter = offsetof(sensor_t, set_framesize), STATUS_FIELD(framesize) },
+};
 
 esp_err_t init_camera(void) {
     camera_config_t config;
@@ -34,13 +81,12 @@ esp_err_t init_camera(void) {
     config.pin_reset = RESET_GPIO_NUM;
     config.xclk_freq_hz = 20000000;
     config.pixel_format = PIXFORMAT_JPEG;
-    //init with high specs to pre-allocate larger buffers
+    //buffers are sized for this and reallocated when the framesize changes
     config.frame_size = FRAMESIZE_VGA;
     config.jpeg_quality = 10;
-    config.fb_count = 2;
 
-    // camera init
-    APP_ERROR_CHECK_WITH_MSG(esp_camera_init(&config) == ESP_OK, "Camera init failed with error", err_init);
+    // camera init, buffer count and placement come from the pool
+    APP_ERROR_CHECK(init_fb_pool(&config) == ESP_OK, err_init);
 
     sensor_t * s = esp_camera_sensor_get();
     s->set_vflip(s, 1);//flip it back
@@ -49,11 +95,80 @@ esp_err_t init_camera(void) {
         s->set_brightness(s, 1);//up the blightness just a bit
         s->set_saturation(s, -2);//lower the saturation
     }
-    //drop down frame size for higher initial frame rate
-    s->set_framesize(s, FRAMESIZE_VGA);
     s->set_xclk(s, LEDC_TIMER_0, 10);
 
+    //random start so versions cached by clients before a reboot never match
+    settings_version = esp_random();
+
     return ESP_OK;
 err_init:
     return ESP_FAIL;
 }
+
+uint32_t app_camera_settings_version(void) {
+    return __atomic_load_n(&settings_version, __ATOMIC_RELAXED);
+}
+
+void app_camera_settings_changed(void) {
+    __atomic_fetch_add(&settings_version, 1, __ATOMIC_RELAXED);
+}
+
+const app_camera_control_t *app_camera_controls(size_t *count) {
+    *count = sizeof(controls) / sizeof(controls[0]);
+    return controls;
+}
+
+int app_camera_control_find(const char *name) {
+    for (size_t i = 0; i < sizeof(controls) / sizeof(controls[0]); i++)
+        if (!strcmp(controls[i].name, name))
+            return (int)i;
+
+    return -1;
+}
+
+bool app_camera_control_valid(const sensor_t *sensor, const app_camera_control_t *control, int val) {
+    if (control->jpeg_only && sensor->pixformat != PIXFORMAT_JPEG)
+        return false;
+
+    return val >= control->min && val <= control->max;
+}
+
+static int control_read(const camera_status_t *status, const app_camera_control_t *control) {
+    const uint8_t *field = (const uint8_t *)status + control->status;
+    //only the controls with a negative range are kept in signed fields
+    bool is_signed = control->min < 0;
+
+    switch (control->status_size) {
+    case sizeof(uint8_t):
+        return is_signed ? *(const int8_t *)field : *field;
+    case sizeof(uint16_t):
+        return is_signed ? *(const int16_t *)field : *(const uint16_t *)field;
+    default:
+        return *(const int *)field;
+    }
+}
+
+int app_camera_control_get(const sensor_t *sensor, const app_camera_control_t *control) {
+    return control_read(&sensor->status, control);
+}
+
+int app_camera_control_set(sensor_t *sensor, const app_camera_control_t *control, int val) {
+    //the frame buffers are sized for the framesize and quality, a change goes through the pool
+    if (control->setter == offsetof(sensor_t, set_framesize))
+        return app_fb_pool_resize((framesize_t)val) == ESP_OK ? 0 : -1;
+    if (control->setter == offsetof(sensor_t, set_quality))
+        return app_fb_pool_set_quality(val) == ESP_OK ? 0 : -1;
+
+    control_setter_t set = *(const control_setter_t *)((const uint8_t *)sensor + control->setter);
+
+    return set(sensor, val);
+}
+
+void app_camera_restore(sensor_t *sensor, const camera_status_t *status) {
+    for (size_t i = 0; i < sizeof(controls) / sizeof(controls[0]); i++) {
+        int val = control_read(status, &controls[i]);
+
+        if (app_camera_control_get(sensor, &controls[i]) != val)
+            app_camera_control_set(sensor, &controls[i], val);
+    }
+}
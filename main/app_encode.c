@@ -0,0 +1,247 @@
+/*
+ * app_encode.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <string.h>
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_camera.h"
+#include "esp_jpg_decode.h"
+#include "img_converters.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#include "app_common.h"
+#include "app_metrics.h"
+#include "app_encode.h"
+
+//first guess for the JPEG size, a buffer that overflows is doubled and the frame encoded again
+#define ENCODE_INITIAL_BYTES_PER_8_PIXELS 2
+#define ENCODE_BENCHMARK_FRAMES 10
+
+static portMUX_TYPE encode_mux = portMUX_INITIALIZER_UNLOCKED;
+//serializes the encoders, taken only when the frame has no finished buffer yet
+static SemaphoreHandle_t encode_lock = NULL;
+static app_encoded_t encoded_pool[CONFIG_CAM_ENCODE_BUFFERS];
+static SemaphoreHandle_t decode_lock = NULL;
+
+#if CONFIG_CAM_ENCODE_BENCHMARK
+static void encode_benchmark(void);
+#endif
+
+esp_err_t init_encode_pool(void) {
+	memset(encoded_pool, 0, sizeof(encoded_pool));
+
+	APP_ERROR_CHECK_WITH_MSG(!!(encode_lock = xSemaphoreCreateMutex()), "xSemaphoreCreateMutex() Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(!!(decode_lock = xSemaphoreCreateMutex()), "xSemaphoreCreateMutex() Failed", err_init);
+
+#if CONFIG_CAM_ENCODE_BENCHMARK
+	encode_benchmark();
+#endif
+
+	return ESP_OK;
+err_init:
+	return ESP_FAIL;
+}
+
+static size_t encode_write(void *arg, size_t index, const void *data, size_t len) {
+	app_encoded_t *encoded = (app_encoded_t *)arg;
+
+	//a short write makes the encoder give up, the caller grows the buffer
+	if (index + len > encoded->size)
+		return 0;
+
+	memcpy(encoded->buf + index, data, len);
+	encoded->len = index + len;
+
+	return len;
+}
+
+static bool encode_reserve(app_encoded_t *encoded, size_t size) {
+	if (encoded->size >= size)
+		return true;
+
+	free(encoded->buf);
+	encoded->size = 0;
+	encoded->buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+	if (!encoded->buf)
+		encoded->buf = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+	if (!encoded->buf)
+		return false;
+
+	encoded->size = size;
+	return true;
+}
+
+static esp_err_t encode_frame(camera_fb_t *fb, app_encoded_t *encoded) {
+	//raw RGB888 is the most a JPEG of the frame can take
+	size_t max_size = fb->width * fb->height * 3;
+	size_t size = MAX(encoded->size, fb->width * fb->height * ENCODE_INITIAL_BYTES_PER_8_PIXELS / 8);
+
+	for (;;) {
+		APP_ERROR_CHECK_WITH_MSG(encode_reserve(encoded, size), "No memory for the JPEG buffer", err_encode);
+
+		encoded->len = 0;
+		if (frame2jpg_cb(fb, CONFIG_CAM_ENCODE_QUALITY, encode_write, encoded))
+			return ESP_OK;
+
+		APP_ERROR_CHECK_WITH_MSG(encoded->size < max_size, "JPEG compression failed", err_encode);
+		size = MIN(encoded->size * 2, max_size);
+	}
+err_encode:
+	encoded->len = 0;
+	return ESP_FAIL;
+}
+
+/* A finished JPEG of the frame with a reference taken, call with encode_mux held. */
+static app_encoded_t *encode_lookup(uint32_t seq) {
+	for (int i = 0; i < CONFIG_CAM_ENCODE_BUFFERS; i++) {
+		if (encoded_pool[i].seq == seq && !!encoded_pool[i].len) {
+			encoded_pool[i].refs++;
+			return &encoded_pool[i];
+		}
+	}
+	return NULL;
+}
+
+const app_encoded_t *app_encode_acquire(app_frame_t *frame) {
+	app_encoded_t *encoded = NULL;
+	app_encoded_t *free_entry = NULL;
+
+	//a frame already encoded is handed out without waiting on a running encoder
+	portENTER_CRITICAL(&encode_mux);
+	encoded = encode_lookup(frame->seq);
+	portEXIT_CRITICAL(&encode_mux);
+	if (!!encoded)
+		return encoded;
+
+	xSemaphoreTake(encode_lock, portMAX_DELAY);
+
+	//the encoder just done may have been working on this very frame
+	portENTER_CRITICAL(&encode_mux);
+	if (!(encoded = encode_lookup(frame->seq))) {
+		for (int i = 0; i < CONFIG_CAM_ENCODE_BUFFERS; i++) {
+			if (!encoded_pool[i].refs && (!free_entry || free_entry->seq > encoded_pool[i].seq))
+				free_entry = &encoded_pool[i];
+		}
+		//the oldest idle buffer is taken over before the lock is dropped
+		if (!!free_entry) {
+			free_entry->refs = 1;
+			free_entry->seq = 0;
+		}
+	}
+	portEXIT_CRITICAL(&encode_mux);
+
+	if (!!encoded || !free_entry) {
+		xSemaphoreGive(encode_lock);
+		return encoded;
+	}
+
+	int64_t encode_start = esp_timer_get_time();
+	if (encode_frame(frame->fb, free_entry) != ESP_OK) {
+		app_encode_release(free_entry);
+		xSemaphoreGive(encode_lock);
+		return NULL;
+	}
+	app_metrics_observe(APP_METRICS_JPEG_ENCODE, esp_timer_get_time() - encode_start);
+
+	portENTER_CRITICAL(&encode_mux);
+	free_entry->seq = frame->seq;
+	portEXIT_CRITICAL(&encode_mux);
+	xSemaphoreGive(encode_lock);
+
+	return free_entry;
+}
+
+void app_encode_release(const app_encoded_t *encoded) {
+	if (!encoded)
+		return;
+
+	portENTER_CRITICAL(&encode_mux);
+	((app_encoded_t *)encoded)->refs--;
+	portEXIT_CRITICAL(&encode_mux);
+}
+
+esp_err_t app_encode_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void *arg) {
+	esp_err_t err;
+
+	xSemaphoreTake(decode_lock, portMAX_DELAY);
+	err = esp_jpg_decode(len, scale, reader, writer, arg);
+	xSemaphoreGive(decode_lock);
+
+	return err;
+}
+
+#if CONFIG_CAM_ENCODE_BENCHMARK
+static uint32_t benchmark_fps_x10(int64_t elapsed_us) {
+	return elapsed_us > 0 ? (uint32_t)(ENCODE_BENCHMARK_FRAMES * 10000000LL / elapsed_us) : 0;
+}
+
+/*
+ * Encodes a synthetic RGB565 frame at QVGA and VGA, once through
+ * frame2jpg() with a fresh output buffer per frame and once into a
+ * pooled buffer, and logs the frame rate of each path.
+ */
+static void encode_benchmark(void) {
+	static const struct {
+		const char *name;
+		uint16_t width;
+		uint16_t height;
+	} sizes[] = {
+		{ "QVGA", 320, 240 },
+		{ "VGA", 640, 480 },
+	};
+	app_encoded_t encoded = { 0 };
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		camera_fb_t fb = {
+			.width = sizes[s].width,
+			.height = sizes[s].height,
+			.format = PIXFORMAT_RGB565,
+			.len = sizes[s].width * sizes[s].height * 2
+		};
+
+		if (!(fb.buf = heap_caps_malloc(fb.len, MALLOC_CAP_SPIRAM)) && !(fb.buf = heap_caps_malloc(fb.len, MALLOC_CAP_8BIT))) {
+			ESP_LOGW(APP_ENCODE_TAG, "%s: no memory for a test frame", sizes[s].name);
+			continue;
+		}
+
+		//gradients with a fine pattern on top, flat frames would encode unrealistically fast
+		for (size_t y = 0; y < fb.height; y++) {
+			for (size_t x = 0; x < fb.width; x++) {
+				uint16_t px = ((x * 31 / fb.width) << 11) | ((y * 63 / fb.height) << 5) | ((x ^ y) & 0x1f);
+				fb.buf[(y * fb.width + x) * 2] = px >> 8;
+				fb.buf[(y * fb.width + x) * 2 + 1] = px & 0xff;
+			}
+		}
+
+		int64_t start = esp_timer_get_time();
+		for (int i = 0; i < ENCODE_BENCHMARK_FRAMES; i++) {
+			uint8_t *jpg = NULL;
+			size_t jpg_len;
+			if (frame2jpg(&fb, CONFIG_CAM_ENCODE_QUALITY, &jpg, &jpg_len))
+				free(jpg);
+		}
+		uint32_t malloc_fps = benchmark_fps_x10(esp_timer_get_time() - start);
+
+		start = esp_timer_get_time();
+		for (int i = 0; i < ENCODE_BENCHMARK_FRAMES; i++)
+			encode_frame(&fb, &encoded);
+		uint32_t pooled_fps = benchmark_fps_x10(esp_timer_get_time() - start);
+
+		ESP_LOGI(APP_ENCODE_TAG, "%s q%d: malloc %u.%u fps, pooled %u.%u fps, %u bytes", sizes[s].name, CONFIG_CAM_ENCODE_QUALITY,
+				malloc_fps / 10, malloc_fps % 10, pooled_fps / 10, pooled_fps % 10, encoded.len);
+
+		free(fb.buf);
+	}
+
+	free(encoded.buf);
+}
+#endif
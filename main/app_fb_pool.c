@@ -0,0 +1,173 @@
+/*
+ * app_fb_pool.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <string.h>
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_camera.h"
+#include "sdkconfig.h"
+
+#include "app_common.h"
+#include "app_camera.h"
+#include "app_frame.h"
+#include "app_fb_pool.h"
+
+#define FB_POOL_PAUSE_TIMEOUT_MS 2000
+
+//kept to restart the driver with the same pins and clock
+static camera_config_t pool_config;
+static bool pool_psram = false;
+static uint32_t pool_resizes = 0;
+
+/* Same sizes as the driver, which picks them once at init. */
+size_t app_fb_pool_buffer_len(framesize_t framesize, int quality) {
+	size_t pixels = (size_t)resolution[framesize].width * resolution[framesize].height;
+
+	switch (pool_config.pixel_format) {
+	case PIXFORMAT_JPEG:
+		break;
+	case PIXFORMAT_GRAYSCALE:
+		return pixels;
+	case PIXFORMAT_RGB888:
+		return pixels * 3;
+	default:
+		return pixels * 2;
+	}
+
+#if CONFIG_CAM_DRIVER_FB_CONFIG
+	//a fifth of the pixel count, whatever the quality
+	(void)quality;
+	return pixels / 5;
+#else
+	//two bytes per pixel over a compression bound that steps with the quality
+	return pixels * 2 / (quality > 10 ? 16 : quality > 5 ? 10 : 4);
+#endif
+}
+
+esp_err_t init_fb_pool(const camera_config_t *config) {
+	pool_config = *config;
+	pool_config.fb_count = CONFIG_CAM_FB_COUNT;
+	pool_config.frame_size = MIN(config->frame_size, APP_FB_POOL_MAX_FRAMESIZE);
+
+#if CONFIG_CAM_DRIVER_FB_CONFIG
+#if CONFIG_CAM_FB_IN_PSRAM
+	pool_psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM) > 0;
+	if (!pool_psram)
+		ESP_LOGW(APP_FB_POOL_TAG, "No PSRAM found, frame buffers go to internal RAM");
+#endif
+	pool_config.fb_location = pool_psram ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM;
+#if CONFIG_CAM_FB_GRAB_LATEST
+	pool_config.grab_mode = CAMERA_GRAB_LATEST;
+#else
+	pool_config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
+#endif
+#else
+	//older drivers pick PSRAM on their own whenever there is some
+	pool_psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM) > 0;
+#endif
+
+	APP_ERROR_CHECK_WITH_MSG(esp_camera_init(&pool_config) == ESP_OK, "Camera init failed with error", err_init);
+
+	ESP_LOGI(APP_FB_POOL_TAG, "%u x %u bytes in %s", (unsigned)pool_config.fb_count, (unsigned)app_fb_pool_buffer_len(pool_config.frame_size, pool_config.jpeg_quality), pool_psram ? "PSRAM" : "DRAM");
+
+	return ESP_OK;
+err_init:
+	return ESP_FAIL;
+}
+
+static esp_err_t fb_pool_restart(framesize_t framesize, int quality) {
+	pool_config.frame_size = framesize;
+	pool_config.jpeg_quality = quality;
+
+	esp_camera_deinit();
+	return esp_camera_init(&pool_config);
+}
+
+static esp_err_t fb_pool_reconfigure(framesize_t framesize, int quality) {
+	sensor_t *sensor = esp_camera_sensor_get();
+	esp_err_t ret = ESP_OK;
+
+	camera_status_t status = sensor->status;
+	int xclk_freq_hz = sensor->xclk_freq_hz;
+	framesize_t old_framesize = pool_config.frame_size;
+	int old_quality = status.quality;
+
+	APP_ERROR_CHECK_WITH_MSG(app_frame_pause(FB_POOL_PAUSE_TIMEOUT_MS) == ESP_OK, "Frame buffers busy, not resizing", err_resize);
+
+	int64_t start = esp_timer_get_time();
+	if (fb_pool_restart(framesize, quality) != ESP_OK) {
+		ESP_LOGW(APP_FB_POOL_TAG, "No room for %u x %u bytes, keeping framesize %d quality %d", (unsigned)pool_config.fb_count, (unsigned)app_fb_pool_buffer_len(framesize, quality), old_framesize, old_quality);
+		ret = ESP_ERR_NO_MEM;
+		APP_ERROR_CHECK_WITH_MSG(fb_pool_restart(old_framesize, old_quality) == ESP_OK, "Camera init failed with error", err_restart);
+	}
+
+	//the driver came back with default settings
+	sensor = esp_camera_sensor_get();
+	status.framesize = pool_config.frame_size;
+	status.quality = pool_config.jpeg_quality;
+	app_camera_restore(sensor, &status);
+	if (sensor->xclk_freq_hz != xclk_freq_hz)
+		sensor->set_xclk(sensor, pool_config.ledc_timer, xclk_freq_hz / 1000000);
+
+	if (ret == ESP_OK) {
+		pool_resizes++;
+		ESP_LOGI(APP_FB_POOL_TAG, "Resized to %u x %u bytes in %ums", (unsigned)pool_config.fb_count, (unsigned)app_fb_pool_buffer_len(framesize, quality), (uint32_t)((esp_timer_get_time() - start) / 1000));
+	}
+
+	app_frame_resume();
+
+	return ret;
+err_restart:
+	app_frame_resume();
+err_resize:
+	return ESP_FAIL;
+}
+
+esp_err_t app_fb_pool_resize(framesize_t framesize) {
+	sensor_t *sensor = esp_camera_sensor_get();
+
+	APP_ERROR_CHECK_WITH_MSG(framesize <= APP_FB_POOL_MAX_FRAMESIZE, "Frame size above the pool maximum", err_resize);
+
+	if (framesize == pool_config.frame_size)
+		return sensor->set_framesize(sensor, framesize) ? ESP_FAIL : ESP_OK;
+
+	return fb_pool_reconfigure(framesize, sensor->status.quality);
+err_resize:
+	return ESP_FAIL;
+}
+
+esp_err_t app_fb_pool_set_quality(int quality) {
+	sensor_t *sensor = esp_camera_sensor_get();
+
+	if (app_fb_pool_buffer_len(pool_config.frame_size, quality) != app_fb_pool_buffer_len(pool_config.frame_size, pool_config.jpeg_quality))
+		return fb_pool_reconfigure(pool_config.frame_size, quality);
+
+	APP_ERROR_CHECK(!sensor->set_quality(sensor, quality), err_quality);
+	pool_config.jpeg_quality = quality;
+
+	return ESP_OK;
+err_quality:
+	return ESP_FAIL;
+}
+
+void app_fb_pool_stats(app_fb_pool_stats_t *stats) {
+	stats->count = pool_config.fb_count;
+	stats->in_use = app_frame_held();
+	stats->framesize = pool_config.frame_size;
+	stats->max_framesize = APP_FB_POOL_MAX_FRAMESIZE;
+	stats->buffer_len = app_fb_pool_buffer_len(pool_config.frame_size, pool_config.jpeg_quality);
+	stats->psram = pool_psram;
+#if CONFIG_CAM_DRIVER_FB_CONFIG
+	stats->latest_only = pool_config.grab_mode == CAMERA_GRAB_LATEST;
+#else
+	stats->latest_only = false;
+#endif
+	stats->resizes = pool_resizes;
+}
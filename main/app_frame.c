@@ -0,0 +1,437 @@
+/*
+ * app_frame.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <string.h>
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "app_common.h"
+#include "app_encode.h"
+#include "app_frame.h"
+#include "app_metrics.h"
+#include "app_spsc.h"
+
+//one slot per driver buffer plus the one being published
+#define FRAME_POOL_SIZE (CONFIG_CAM_FB_COUNT + 1)
+#define FRAME_PAUSE_POLL_MS 10
+#define FRAME_STATS_PERIOD_US (10 * 1000000)
+
+typedef struct {
+	app_frame_cb_t cb;
+	void *arg;
+} frame_listener_t;
+
+//running totals, each one written by a single stage
+typedef struct {
+	uint32_t captured;
+	uint32_t processed;
+	uint64_t capture_us;
+	uint64_t stall_us;
+	uint64_t process_us;
+} frame_stats_t;
+
+static portMUX_TYPE hub_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static app_frame_t frame_pool[FRAME_POOL_SIZE];
+static app_frame_t *latest_frame = NULL;
+static uint32_t frame_seq = 0;
+//only the process task numbers frames, dropped ones leave a gap
+static uint32_t next_seq = 0;
+//driver buffers out of the camera, counted from esp_camera_fb_get() to esp_camera_fb_return()
+static int frames_held = 0;
+static bool capturing = false;
+static bool paused = false;
+//keeps ETags from a previous boot from matching a new frame with the same sequence
+static uint32_t boot_id = 0;
+
+static frame_listener_t listeners[APP_FRAME_MAX_LISTENERS];
+static int listeners_count = 0;
+
+//captured driver buffers on their way from the capture core to the process core
+static camera_fb_t *capture_slots[CONFIG_CAM_PIPELINE_DEPTH];
+static app_spsc_t capture_queue;
+
+static frame_stats_t frame_stats;
+
+static TaskHandle_t capture_task_handle = NULL;
+static TaskHandle_t process_task_handle = NULL;
+
+static void capture_task(void *pvParameters);
+static void process_task(void *pvParameters);
+
+esp_err_t init_frame_hub(void) {
+	memset(frame_pool, 0, sizeof(frame_pool));
+	memset(listeners, 0, sizeof(listeners));
+	memset(&frame_stats, 0, sizeof(frame_stats));
+	app_spsc_init(&capture_queue, (void **)capture_slots, CONFIG_CAM_PIPELINE_DEPTH);
+	boot_id = esp_random();
+
+	APP_ERROR_CHECK_WITH_MSG(xTaskCreatePinnedToCore(process_task, "frame-process", configMINIMAL_STACK_SIZE * 4, NULL, 5, &process_task_handle, APP_FRAME_PROCESS_CORE) == pdPASS, "xTaskCreatePinnedToCore() process task Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(xTaskCreatePinnedToCore(capture_task, "frame-hub", configMINIMAL_STACK_SIZE * 3, NULL, 5, &capture_task_handle, APP_FRAME_CAPTURE_CORE) == pdPASS, "xTaskCreatePinnedToCore() capture task Failed", err_init);
+
+	return ESP_OK;
+err_init:
+	return ESP_FAIL;
+}
+
+esp_err_t app_frame_subscribe(app_frame_cb_t cb, void *arg) {
+	bool added = false;
+
+	portENTER_CRITICAL(&hub_mux);
+	if (listeners_count < APP_FRAME_MAX_LISTENERS) {
+		listeners[listeners_count].cb = cb;
+		listeners[listeners_count].arg = arg;
+		listeners_count++;
+		added = true;
+	}
+	portEXIT_CRITICAL(&hub_mux);
+
+	APP_ERROR_CHECK_WITH_MSG(added, "Too many frame listeners", err_subscribe);
+
+	//wake up the capture task, it sleeps while nobody is listening
+	xTaskNotifyGive(capture_task_handle);
+
+	return ESP_OK;
+err_subscribe:
+	return ESP_FAIL;
+}
+
+void app_frame_unsubscribe(app_frame_cb_t cb, void *arg) {
+	portENTER_CRITICAL(&hub_mux);
+	for (int i = 0; i < listeners_count; i++) {
+		if (listeners[i].cb == cb && listeners[i].arg == arg) {
+			listeners[i] = listeners[--listeners_count];
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&hub_mux);
+}
+
+app_frame_t *app_frame_acquire(void) {
+	app_frame_t *frame;
+
+	portENTER_CRITICAL(&hub_mux);
+	frame = latest_frame;
+	if (!!frame)
+		frame->refs++;
+	portEXIT_CRITICAL(&hub_mux);
+
+	return frame;
+}
+
+static void frame_return(camera_fb_t *fb) {
+	int held;
+
+	esp_camera_fb_return(fb);
+
+	portENTER_CRITICAL(&hub_mux);
+	held = --frames_held;
+	portEXIT_CRITICAL(&hub_mux);
+
+	app_metrics_set(APP_METRICS_FB_IN_USE, held);
+}
+
+void app_frame_release(app_frame_t *frame) {
+	camera_fb_t *fb = NULL;
+
+	if (!frame)
+		return;
+
+	portENTER_CRITICAL(&hub_mux);
+	if (!--frame->refs) {
+		fb = frame->fb;
+		frame->fb = NULL;
+	}
+	portEXIT_CRITICAL(&hub_mux);
+
+	if (!!fb)
+		frame_return(fb);
+}
+
+int app_frame_held(void) {
+	int held;
+
+	portENTER_CRITICAL(&hub_mux);
+	held = frames_held;
+	portEXIT_CRITICAL(&hub_mux);
+
+	return held;
+}
+
+esp_err_t app_frame_pause(uint32_t timeout_ms) {
+	app_frame_t *old_frame;
+	bool idle;
+
+	portENTER_CRITICAL(&hub_mux);
+	paused = true;
+	old_frame = latest_frame;
+	latest_frame = NULL;
+	portEXIT_CRITICAL(&hub_mux);
+
+	app_frame_release(old_frame);
+
+	//readers still sending an older frame keep its buffer until they are done
+	int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+	for (;;) {
+		portENTER_CRITICAL(&hub_mux);
+		idle = !capturing && !frames_held;
+		portEXIT_CRITICAL(&hub_mux);
+
+		if (idle)
+			return ESP_OK;
+
+		APP_ERROR_CHECK_WITH_MSG(esp_timer_get_time() < deadline, "Frame buffers still in use", err_pause);
+		vTaskDelay(MAX(1, FRAME_PAUSE_POLL_MS / portTICK_PERIOD_MS));
+	}
+err_pause:
+	app_frame_resume();
+	return ESP_ERR_TIMEOUT;
+}
+
+void app_frame_resume(void) {
+	portENTER_CRITICAL(&hub_mux);
+	paused = false;
+	portEXIT_CRITICAL(&hub_mux);
+
+	xTaskNotifyGive(capture_task_handle);
+}
+
+uint32_t app_frame_latest_seq(void) {
+	uint32_t seq;
+
+	portENTER_CRITICAL(&hub_mux);
+	seq = frame_seq;
+	portEXIT_CRITICAL(&hub_mux);
+
+	return seq;
+}
+
+uint32_t app_frame_age_ms(const app_frame_t *frame) {
+	//the driver stamps frames from esp_timer, not the wall clock SNTP sets
+	int64_t age_us = esp_timer_get_time() - ((int64_t)frame->fb->timestamp.tv_sec * 1000000 + frame->fb->timestamp.tv_usec);
+	return age_us > 0 ? age_us / 1000 : 0;
+}
+
+size_t app_frame_etag(const app_frame_t *frame, const char *suffix, char *etag, size_t len) {
+	return snprintf(etag, len, "\"%08x-%u%s\"", boot_id, frame->seq, !!suffix ? suffix : "");
+}
+
+static void frame_wait_ready(void *arg) {
+	xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+/*
+ * Returns the cached frame when it is recent enough, otherwise keeps
+ * the capture task running until a fresh one is published. Freshness
+ * comes from the driver timestamp, the driver may hand out frames it
+ * queued while nobody was listening.
+ */
+app_frame_t *app_frame_get(uint32_t max_age_ms, uint32_t timeout_ms) {
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+	int64_t deadline, now;
+
+	app_frame_t *frame = app_frame_acquire();
+	if (!!frame && app_frame_age_ms(frame) <= max_age_ms)
+		return frame;
+	app_frame_release(frame);
+	frame = NULL;
+
+	APP_ERROR_CHECK(app_frame_subscribe(frame_wait_ready, task) == ESP_OK, err_get);
+
+	deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+	while ((now = esp_timer_get_time()) < deadline) {
+		ulTaskNotifyTake(pdTRUE, MAX(1, (deadline - now) / 1000 / portTICK_PERIOD_MS));
+
+		frame = app_frame_acquire();
+		if (!!frame && app_frame_age_ms(frame) <= max_age_ms)
+			break;
+		app_frame_release(frame);
+		frame = NULL;
+	}
+
+	app_frame_unsubscribe(frame_wait_ready, task);
+
+	return frame;
+err_get:
+	return NULL;
+}
+
+static app_frame_t *frame_alloc(void) {
+	app_frame_t *frame = NULL;
+
+	portENTER_CRITICAL(&hub_mux);
+	for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+		if (!frame_pool[i].refs && !frame_pool[i].fb) {
+			frame = &frame_pool[i];
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&hub_mux);
+
+	return frame;
+}
+
+/*
+ * Work done once per frame before any reader sees it. Raw frames are
+ * encoded here, so senders find the JPEG ready in the encode pool.
+ */
+static void frame_process(app_frame_t *frame) {
+	if (frame->fb->format != PIXFORMAT_JPEG)
+		app_encode_release(app_encode_acquire(frame));
+}
+
+static void frame_publish(camera_fb_t *fb) {
+	frame_listener_t current[APP_FRAME_MAX_LISTENERS];
+	int count;
+	app_frame_t *old_frame;
+
+	app_frame_t *frame = frame_alloc();
+	if (!frame) {
+		ESP_LOGW(APP_FRAME_TAG, "No free frame slot, dropping frame");
+		frame_return(fb);
+		return;
+	}
+
+	//only this task takes slots, nobody sees the frame until latest_frame points at it
+	frame->fb = fb;
+	frame->seq = ++next_seq;
+	//the hub keeps one reference until a newer frame replaces it
+	frame->refs = 1;
+
+	frame_process(frame);
+
+	portENTER_CRITICAL(&hub_mux);
+	//a pause started while this frame was in the pipeline, its buffer goes straight back
+	if (paused) {
+		portEXIT_CRITICAL(&hub_mux);
+		app_frame_release(frame);
+		return;
+	}
+	frame_seq = frame->seq;
+	frame->published_us = esp_timer_get_time();
+	old_frame = latest_frame;
+	latest_frame = frame;
+
+	count = listeners_count;
+	memcpy(current, listeners, count * sizeof(frame_listener_t));
+	portEXIT_CRITICAL(&hub_mux);
+
+	app_frame_release(old_frame);
+
+	for (int i = 0; i < count; i++)
+		current[i].cb(current[i].arg);
+}
+
+static void capture_task(void *pvParameters) {
+	camera_fb_t *fb;
+	bool capture;
+	int held;
+
+	for (;;) {
+		portENTER_CRITICAL(&hub_mux);
+		capture = capturing = listeners_count && !paused;
+		portEXIT_CRITICAL(&hub_mux);
+
+		if (!capture) {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
+		}
+
+		int64_t wait_start = esp_timer_get_time();
+		fb = esp_camera_fb_get();
+		int64_t wait_end = esp_timer_get_time();
+		app_metrics_observe(APP_METRICS_CAPTURE_WAIT, wait_end - wait_start);
+
+		portENTER_CRITICAL(&hub_mux);
+		capturing = false;
+		held = frames_held += !!fb;
+		portEXIT_CRITICAL(&hub_mux);
+
+		app_metrics_set(APP_METRICS_FB_IN_USE, held);
+
+		if (!fb) {
+			ESP_LOGE(APP_FRAME_TAG, "Camera capture failed");
+			vTaskDelay(100 / portTICK_PERIOD_MS);
+			continue;
+		}
+
+		frame_stats.captured++;
+		frame_stats.capture_us += wait_end - wait_start;
+		app_metrics_add(APP_METRICS_FRAMES_CAPTURED, 1);
+
+		//a full queue means the process core is behind, capturing more would only queue stale frames
+		while (!app_spsc_push(&capture_queue, fb))
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		frame_stats.stall_us += esp_timer_get_time() - wait_end;
+
+		xTaskNotifyGive(process_task_handle);
+	}
+	vTaskDelete(NULL);
+}
+
+static uint32_t stats_fps_x10(uint32_t frames, int64_t elapsed_us) {
+	return elapsed_us > 0 ? (uint32_t)(frames * 10000000LL / elapsed_us) : 0;
+}
+
+static uint32_t stats_avg_us(uint64_t total_us, uint32_t frames) {
+	return frames ? (uint32_t)(total_us / frames) : 0;
+}
+
+static void frame_log_stats(const frame_stats_t *last, int64_t elapsed_us) {
+	frame_stats_t now = frame_stats;
+	uint32_t captured = now.captured - last->captured;
+	uint32_t processed = now.processed - last->processed;
+	uint32_t capture_fps = stats_fps_x10(captured, elapsed_us);
+	uint32_t process_fps = stats_fps_x10(processed, elapsed_us);
+
+	ESP_LOGI(APP_FRAME_TAG, "Pipeline: capture %u.%u fps (wait %uus, stall %uus), process %u.%u fps (%uus)",
+			capture_fps / 10, capture_fps % 10, stats_avg_us(now.capture_us - last->capture_us, captured), stats_avg_us(now.stall_us - last->stall_us, captured),
+			process_fps / 10, process_fps % 10, stats_avg_us(now.process_us - last->process_us, processed));
+}
+
+/*
+ * Second pipeline stage, pinned to the core the capture task does not
+ * use. While it works on frame N the capture task is already filling
+ * the buffer for N+1 and the senders are still writing N-1.
+ */
+static void process_task(void *pvParameters) {
+	frame_stats_t last = { 0 };
+	int64_t stats_start = esp_timer_get_time();
+	camera_fb_t *fb;
+
+	for (;;) {
+		if (!(fb = app_spsc_pop(&capture_queue))) {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
+		}
+		//a slot is free again
+		xTaskNotifyGive(capture_task_handle);
+
+		int64_t start = esp_timer_get_time();
+		frame_publish(fb);
+		int64_t end = esp_timer_get_time();
+
+		frame_stats.processed++;
+		frame_stats.process_us += end - start;
+		app_metrics_observe(APP_METRICS_FRAME_PROCESS, end - start);
+		app_metrics_add(APP_METRICS_FRAMES_PROCESSED, 1);
+
+		if (end - stats_start >= FRAME_STATS_PERIOD_US) {
+			frame_log_stats(&last, end - stats_start);
+			last = frame_stats;
+			stats_start = end;
+		}
+	}
+	vTaskDelete(NULL);
+}
@@ -6,6 +6,7 @@
  */
 
 #include <stdarg.h>
+#include <sys/param.h>
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_spi_flash.h"
@@ -17,38 +18,79 @@
 
 #include "app_common.h"
 #include "app_httpd_common.h"
+#include "app_budget.h"
 #include "app_camera.h"
+#include "app_encode.h"
+#include "app_fb_pool.h"
+#include "app_frame.h"
 #include "app_httpd.h"
+#include "app_json.h"
 #include "app_mdns.h"
+#include "app_metrics.h"
+#include "app_motion.h"
+#include "app_rtsp.h"
+#include "app_stream.h"
+#include "app_thumb.h"
+#include "app_www.h"
 
 #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
 
-#define PART_BOUNDARY "123456789000000000000987654321"
-static const char *_STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
-static const char *_STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n\r\n";
+#define CAPTURE_DEFAULT_MAX_AGE_MS 200
+#define CAPTURE_TIMEOUT_MS 3000
+#define THUMBNAIL_DEFAULT_SCALE JPG_SCALE_4X
 
-static httpd_handle_t stream_httpd = NULL;
-static httpd_handle_t camera_httpd = NULL;
+#define ERR_MSG_INVALID_VALUE "Invalid value"
+#define ERR_MSG_NO_BUDGET "Not enough memory for the frame buffers"
+#define ERR_MSG_INVALID_JSON "Invalid JSON"
+
+#define JSON_RESP_BUF_LEN 768
 
-//static int64_t last_frame = 0;
+/*
+ * lwIP sockets of the servers, each with its listening and internal
+ * ones. The HTTP server gets what is left, up to the IDF default of 7
+ * connections, and the build stops when the UI would get fewer than 3.
+ * esp_http_server keeps a listening, a control and a message socket.
+ */
+#define SOCKETS_HTTPD_OWN 3
+#define SOCKETS_STREAM (3 + CONFIG_CAM_STREAM_MAX_CLIENTS)
+#if CONFIG_CAM_RTSP_ENABLE
+#define SOCKETS_RTSP (4 + CONFIG_CAM_RTSP_MAX_CLIENTS)
+#else
+#define SOCKETS_RTSP 0
+#endif
+#if CONFIG_CAM_MCAST_ENABLE
+#define SOCKETS_MCAST 1
+#else
+#define SOCKETS_MCAST 0
+#endif
+#define SOCKETS_HTTPD_LEFT (CONFIG_LWIP_MAX_SOCKETS - SOCKETS_HTTPD_OWN - SOCKETS_STREAM - SOCKETS_RTSP - SOCKETS_MCAST)
+#define HTTPD_MAX_OPEN_SOCKETS MIN(SOCKETS_HTTPD_LEFT, 7)
+
+#if SOCKETS_HTTPD_LEFT < 3
+#error "Not enough LWIP_MAX_SOCKETS for the HTTP server, lower CAM_STREAM_MAX_CLIENTS or CAM_RTSP_MAX_CLIENTS"
+#endif
+_Static_assert(SOCKETS_HTTPD_LEFT >= 1 && HTTPD_MAX_OPEN_SOCKETS <= CONFIG_LWIP_MAX_SOCKETS - SOCKETS_HTTPD_OWN,
+	"httpd_start rejects max_open_sockets above LWIP_MAX_SOCKETS - 3");
+
+static httpd_handle_t camera_httpd = NULL;
+static uint16_t server_port = 0;
 
 static esp_err_t system_info_handler(httpd_req_t *req);
 static esp_err_t cam_status_handler(httpd_req_t *req);
-static esp_err_t cam_stream_handler(httpd_req_t *req);
 static esp_err_t cam_capture_handler(httpd_req_t *req);
+static esp_err_t cam_thumbnail_handler(httpd_req_t *req);
 static esp_err_t cam_cmd_handler(httpd_req_t *req);
+static esp_err_t cam_budget_handler(httpd_req_t *req);
 static esp_err_t cam_xclk_handler(httpd_req_t *req);
 static esp_err_t cam_reg_handler(httpd_req_t *req);
 static esp_err_t cam_greg_handler(httpd_req_t *req);
 static esp_err_t cam_pll_handler(httpd_req_t *req);
 static esp_err_t cam_win_handler(httpd_req_t *req);
 static esp_err_t mdns_handler(httpd_req_t *req);
-
-typedef struct {
-    httpd_req_t *req;
-    size_t len;
-} jpg_chunking_t;
+static esp_err_t stream_clients_handler(httpd_req_t *req);
+static esp_err_t metrics_handler(httpd_req_t *req);
+static esp_err_t motion_handler(httpd_req_t *req);
+static esp_err_t motion_config_handler(httpd_req_t *req);
 
 esp_err_t init_server(const char *base_path) {
 	rest_server_context_t *rest_context = NULL;
@@ -58,18 +100,20 @@ esp_err_t init_server(const char *base_path) {
 	strlcpy(rest_context->base_path, base_path, sizeof(rest_context->base_path));
 
 	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-	config.max_uri_handlers = 12;
+	config.max_uri_handlers = 20;
+	config.max_open_sockets = HTTPD_MAX_OPEN_SOCKETS;
 
 	config.uri_match_fn = httpd_uri_match_wildcard;
 
 	ESP_LOGI(APP_HTTPD_TAG, "Starting HTTP Server");
 	APP_ERROR_CHECK_WITH_MSG(httpd_start(&camera_httpd, &config) == ESP_OK, "Start web server failed", err_init);
+	server_port = config.server_port;
 
 	 /* URI handler for getting web server files */
 	httpd_uri_t common_uri = {
 		.uri = "/*",
 		.method = HTTP_GET,
-		.handler = common_handler,
+		.handler = app_www_handler,
 		.user_ctx = rest_context
 	};
 
@@ -95,6 +139,13 @@ esp_err_t init_server(const char *base_path) {
 		.user_ctx = NULL
 	};
 
+	httpd_uri_t cam_thumbnail_uri = {
+		.uri = "/api/v1/cam/thumbnail",
+		.method = HTTP_GET,
+		.handler = cam_thumbnail_handler,
+		.user_ctx = NULL
+	};
+
 	httpd_uri_t cam_cmd_uri = {
 		.uri = "/api/v1/cam/control",
 		.method = HTTP_POST,
@@ -102,6 +153,13 @@ esp_err_t init_server(const char *base_path) {
 		.user_ctx = rest_context
 	};
 
+	httpd_uri_t cam_budget_uri = {
+		.uri = "/api/v1/cam/budget",
+		.method = HTTP_GET,
+		.handler = cam_budget_handler,
+		.user_ctx = NULL
+	};
+
 	httpd_uri_t cam_xclk_uri = {
 		.uri = "/api/v1/cam/xclk",
 		.method = HTTP_POST,
@@ -144,31 +202,54 @@ esp_err_t init_server(const char *base_path) {
 		.user_ctx = NULL
 	};
 
+	httpd_uri_t stream_clients_uri = {
+		.uri = "/api/v1/stream/clients",
+		.method = HTTP_GET,
+		.handler = stream_clients_handler,
+		.user_ctx = NULL
+	};
+
+	httpd_uri_t metrics_uri = {
+		.uri = "/api/v1/metrics",
+		.method = HTTP_GET,
+		.handler = metrics_handler,
+		.user_ctx = NULL
+	};
+
+	httpd_uri_t motion_uri = {
+		.uri = "/api/v1/motion",
+		.method = HTTP_GET,
+		.handler = motion_handler,
+		.user_ctx = NULL
+	};
+
+	httpd_uri_t motion_config_uri = {
+		.uri = "/api/v1/motion",
+		.method = HTTP_POST,
+		.handler = motion_config_handler,
+		.user_ctx = NULL
+	};
+
 	httpd_register_uri_handler(camera_httpd, &system_info_uri);
 	httpd_register_uri_handler(camera_httpd, &cam_status_uri);
 	httpd_register_uri_handler(camera_httpd, &cam_capture_uri);
+	httpd_register_uri_handler(camera_httpd, &cam_thumbnail_uri);
 	httpd_register_uri_handler(camera_httpd, &cam_cmd_uri);
+	httpd_register_uri_handler(camera_httpd, &cam_budget_uri);
 	httpd_register_uri_handler(camera_httpd, &cam_xclk_uri);
 	httpd_register_uri_handler(camera_httpd, &cam_reg_uri);
 	httpd_register_uri_handler(camera_httpd, &cam_greg_uri);
 	httpd_register_uri_handler(camera_httpd, &cam_pll_uri);
 	httpd_register_uri_handler(camera_httpd, &cam_win_uri);
 	httpd_register_uri_handler(camera_httpd, &mdns_uri);
+	httpd_register_uri_handler(camera_httpd, &stream_clients_uri);
+	httpd_register_uri_handler(camera_httpd, &metrics_uri);
+	httpd_register_uri_handler(camera_httpd, &motion_uri);
+	httpd_register_uri_handler(camera_httpd, &motion_config_uri);
 
 	httpd_register_uri_handler(camera_httpd, &common_uri);
 
-	config.server_port += 1;
-	config.ctrl_port += 1;
-	APP_ERROR_CHECK_WITH_MSG(httpd_start(&stream_httpd, &config) == ESP_OK, "Start stream server failed", err_init);
-
-	httpd_uri_t cam_stream_uri = {
-		.uri = "/cam/stream",
-		.method = HTTP_GET,
-		.handler = cam_stream_handler,
-		.user_ctx = NULL
-	};
-
-	httpd_register_uri_handler(stream_httpd, &cam_stream_uri);
+	APP_ERROR_CHECK_WITH_MSG(init_stream_server(CONFIG_CAM_STREAM_PORT) == ESP_OK, "Start stream server failed", err_init);
 
 	return ESP_OK;
 err_init:
@@ -177,185 +258,215 @@ err_init:
 	return ESP_FAIL;
 }
 
-static void get_chip_info(esp_chip_info_t *chip_info, cJSON *resp_json_data) {
-    cJSON *chip = cJSON_CreateObject();
-    cJSON_AddStringToObject(chip, "name", CHIP_NAME);
-    cJSON_AddNumberToObject(chip, "cores", chip_info->cores);
+uint16_t app_httpd_port(void) {
+	return server_port;
+}
 
-    char* features = malloc(11);
-    strcpy(features, "WiFi");
+static int get_query_int(httpd_req_t *req, const char *key, int default_val) {
+	char query[64], val[16];
 
-    if(chip_info->features & CHIP_FEATURE_BT)
-        strcat(features, "/BT");
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK)
+		return default_val;
+	if (httpd_query_key_value(query, key, val, sizeof(val)) != ESP_OK)
+		return default_val;
 
-    if(chip_info->features & CHIP_FEATURE_BLE)
-        strcat(features, "/BLE");
+	return atoi(val);
+}
 
-    cJSON_AddStringToObject(chip, "features", features);
-    free(features);
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+	char if_none_match[APP_FRAME_ETAG_LEN + 8];
 
-    cJSON_AddNumberToObject(chip, "revision", chip_info->revision);
+	if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) != ESP_OK)
+		return false;
 
-    cJSON_AddItemToObject(resp_json_data, "chip", chip);
+	return !strcmp(if_none_match, etag);
 }
 
-static void get_flash_info(esp_chip_info_t *chip_info, cJSON *resp_json_data) {
-    cJSON *flash = cJSON_CreateObject();
-
-    char flash_size[7];
-    sprintf(flash_size, "%dMB", spi_flash_get_chip_size() / (1024 * 1024));
-    cJSON_AddStringToObject(flash, "size", flash_size);
+static esp_err_t resp_send_not_modified(httpd_req_t *req, const char *etag) {
+	httpd_resp_set_status(req, "304 Not Modified");
+	httpd_resp_set_hdr(req, "ETag", etag);
+	httpd_resp_set_hdr(req, HTTP_HEAD_ALLOW_ORIGIN, "*");
+	return httpd_resp_send(req, NULL, 0);
+}
 
-    cJSON_AddStringToObject(flash, "type", (chip_info->features & CHIP_FEATURE_EMB_FLASH) ? "embedded" : "external");
+static esp_err_t json_resp_flush(void *arg, const char *data, size_t len) {
+	return httpd_resp_send_chunk((httpd_req_t *)arg, data, len);
+}
 
-    cJSON_AddItemToObject(resp_json_data, "flash", flash);
+static void json_resp_start(httpd_req_t *req, app_json_t *json, char *buf, size_t size) {
+	httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+	httpd_resp_set_hdr(req, HTTP_HEAD_ALLOW_ORIGIN, "*");
+	app_json_init(json, buf, size, json_resp_flush, req);
 }
 
-static esp_err_t system_info_handler(httpd_req_t *req) {
-	esp_chip_info_t chip_info;
-	esp_chip_info(&chip_info);
+/*
+ * Bodies that fit the request buffer go out with a Content-Length, larger
+ * ones were already switched to chunked encoding by the first flush.
+ */
+static esp_err_t resp_send_json_writer(httpd_req_t *req, app_json_t *json) {
+	esp_err_t resp;
 
-	cJSON *resp_json_data = cJSON_CreateObject();
-	get_chip_info(&chip_info, resp_json_data);
-	get_flash_info(&chip_info, resp_json_data);
+	APP_ERROR_CHECK_WITH_MSG((resp = app_json_end(json)) == ESP_OK, "JSON serialization failed", err_json);
 
-	esp_err_t resp = resp_send_json_data_ok(req, resp_json_data);
+	if (!json->flushed)
+		return httpd_resp_send(req, json->buf, json->len);
 
-	cJSON_Delete(resp_json_data);
+	APP_ERROR_CHECK((resp = httpd_resp_send_chunk(req, json->buf, json->len)) == ESP_OK, err_json);
+	return httpd_resp_send_chunk(req, NULL, 0);
+err_json:
+	if (!json->flushed)
+		resp = resp_send_json_message(req, _500_INTERNAL_SERVER_ERROR, ERR_MSG_SOMETHING_WRONG);
 	return resp;
 }
 
-static esp_err_t cam_status_handler(httpd_req_t *req) {
-	sensor_t *sensor = esp_camera_sensor_get();
+static void get_chip_info(esp_chip_info_t *chip_info, app_json_t *json) {
+    app_json_object_start(json, "chip");
+    app_json_string(json, "name", CHIP_NAME);
+    app_json_int(json, "cores", chip_info->cores);
 
-	cJSON *resp_json_data = cJSON_CreateObject();
-
-	cJSON_AddStringToObject(resp_json_data, "board", CAM_BOARD);
-	cJSON_AddNumberToObject(resp_json_data, "xclk", sensor->xclk_freq_hz / 1000000);
-	cJSON_AddNumberToObject(resp_json_data, "pixformat", sensor->pixformat);
-	cJSON_AddNumberToObject(resp_json_data, "framesize", sensor->status.framesize);
-	cJSON_AddNumberToObject(resp_json_data, "quality", sensor->status.quality);
-	cJSON_AddNumberToObject(resp_json_data, "brightness", sensor->status.brightness);
-	cJSON_AddNumberToObject(resp_json_data, "contrast", sensor->status.contrast);
-	cJSON_AddNumberToObject(resp_json_data, "saturation", sensor->status.saturation);
-	cJSON_AddNumberToObject(resp_json_data, "sharpness", sensor->status.sharpness);
-	cJSON_AddNumberToObject(resp_json_data, "special_effect", sensor->status.special_effect);
-	cJSON_AddNumberToObject(resp_json_data, "wb_mode", sensor->status.wb_mode);
-	cJSON_AddNumberToObject(resp_json_data, "awb", sensor->status.awb);
-	cJSON_AddNumberToObject(resp_json_data, "awb_gain", sensor->status.awb_gain);
-	cJSON_AddNumberToObject(resp_json_data, "aec", sensor->status.aec);
-	cJSON_AddNumberToObject(resp_json_data, "aec2", sensor->status.aec2);
-	cJSON_AddNumberToObject(resp_json_data, "ae_level", sensor->status.ae_level);
-	cJSON_AddNumberToObject(resp_json_data, "aec_value", sensor->status.aec_value);
-	cJSON_AddNumberToObject(resp_json_data, "agc", sensor->status.agc);
-	cJSON_AddNumberToObject(resp_json_data, "agc_gain", sensor->status.agc_gain);
-	cJSON_AddNumberToObject(resp_json_data, "gainceiling", sensor->status.gainceiling);
-	cJSON_AddNumberToObject(resp_json_data, "bpc", sensor->status.bpc);
-	cJSON_AddNumberToObject(resp_json_data, "wpc", sensor->status.wpc);
-	cJSON_AddNumberToObject(resp_json_data, "raw_gma", sensor->status.raw_gma);
-	cJSON_AddNumberToObject(resp_json_data, "lenc", sensor->status.lenc);
-	cJSON_AddNumberToObject(resp_json_data, "hmirror", sensor->status.hmirror);
-	cJSON_AddNumberToObject(resp_json_data, "dcw", sensor->status.dcw);
-	cJSON_AddNumberToObject(resp_json_data, "colorbar", sensor->status.colorbar);
-	cJSON_AddNumberToObject(resp_json_data, "led_intensity", -1);
-
-	esp_err_t resp = resp_send_json_data_ok(req, resp_json_data);
+    char features[11] = "WiFi";
 
-	cJSON_Delete(resp_json_data);
-	return resp;
-}
+    if(chip_info->features & CHIP_FEATURE_BT)
+        strcat(features, "/BT");
 
-static esp_err_t cam_stream_handler(httpd_req_t *req) {
-	esp_err_t resp;
-	camera_fb_t *fb = NULL;
-	struct timeval _timestamp;
+    if(chip_info->features & CHIP_FEATURE_BLE)
+        strcat(features, "/BLE");
 
-	size_t _jpg_buf_len = 0;
-	uint8_t *_jpg_buf = NULL;
-	char *part_buf[128];
+    app_json_string(json, "features", features);
+    app_json_int(json, "revision", chip_info->revision);
 
-//	if (!last_frame)
-//		last_frame = esp_timer_get_time();
+    app_json_object_end(json);
+}
 
-	APP_ERROR_CHECK_WITH_MSG(httpd_resp_set_type(req, _STREAM_CONTENT_TYPE) == ESP_OK, "Stream content type invalid", err_stream_with_resp);
+static void get_flash_info(esp_chip_info_t *chip_info, app_json_t *json) {
+    app_json_object_start(json, "flash");
 
-	httpd_resp_set_hdr(req, HTTP_HEAD_ALLOW_ORIGIN, "*");
-	httpd_resp_set_hdr(req, "X-Framerate", "60");
+    char flash_size[7];
+    sprintf(flash_size, "%dMB", (int)(spi_flash_get_chip_size() / (1024 * 1024)));
+    app_json_string(json, "size", flash_size);
 
-	while (true) {
-		fb = esp_camera_fb_get();
-		APP_ERROR_CHECK_WITH_MSG(!!fb, "Camera capture failed", err_stream_with_resp);
+    app_json_string(json, "type", (chip_info->features & CHIP_FEATURE_EMB_FLASH) ? "embedded" : "external");
 
-		_timestamp.tv_sec = fb->timestamp.tv_sec;
-		_timestamp.tv_usec = fb->timestamp.tv_usec;
-		if (fb->format != PIXFORMAT_JPEG) {
-			bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-			APP_ERROR_CHECK_WITH_MSG(jpeg_converted, "JPEG compression failed", err_stream_with_resp);
-		} else {
-			_jpg_buf_len = fb->len;
-			_jpg_buf = fb->buf;
-		}
+    app_json_object_end(json);
+}
 
-		APP_ERROR_CHECK_WITH_MSG((resp = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY))) == ESP_OK, "Error sending chunk", err_stream);
+static void get_fb_pool_info(app_json_t *json) {
+    app_fb_pool_stats_t stats;
+    app_fb_pool_stats(&stats);
+
+    app_json_object_start(json, "fb_pool");
+    app_json_int(json, "count", stats.count);
+    app_json_int(json, "in_use", stats.in_use);
+    app_json_int(json, "framesize", stats.framesize);
+    app_json_int(json, "max_framesize", stats.max_framesize);
+    app_json_int(json, "buffer_len", stats.buffer_len);
+    app_json_string(json, "location", stats.psram ? "psram" : "dram");
+    app_json_bool(json, "latest_only", stats.latest_only);
+    app_json_int(json, "resizes", stats.resizes);
+    app_json_object_end(json);
+}
 
-		size_t hlen = snprintf((char *)part_buf, 128, _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
-		APP_ERROR_CHECK_WITH_MSG((resp = httpd_resp_send_chunk(req, (const char *)part_buf, hlen)) == ESP_OK, "Error sending chunk (part buffer)", err_stream);
+static esp_err_t system_info_handler(httpd_req_t *req) {
+	esp_chip_info_t chip_info;
+	esp_chip_info(&chip_info);
 
-		APP_ERROR_CHECK_WITH_MSG((resp = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len)) == ESP_OK, "Error sending chunk (jpg buffer)", err_stream);
+	app_json_t json;
+	char buf[JSON_RESP_BUF_LEN];
+	json_resp_start(req, &json, buf, sizeof(buf));
 
-		_jpg_buf = NULL;
-		esp_camera_fb_return(fb);
-		fb = NULL;
+	app_json_object_start(&json, NULL);
+	get_chip_info(&chip_info, &json);
+	get_flash_info(&chip_info, &json);
+	get_fb_pool_info(&json);
+	app_json_object_end(&json);
 
-//		int64_t fr_end = esp_timer_get_time();
+	return resp_send_json_writer(req, &json);
+}
 
-//		int64_t frame_time = fr_end - last_frame;
-//		last_frame = fr_end;
-//		frame_time /= 1000;
-//        uint32_t avg_frame_time = ra_filter_run(&ra_filter, frame_time);
-//        ESP_LOGI(
-//        	TAG,
-//        	"MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps)",
-//             (uint32_t)(_jpg_buf_len),
-//             (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time,
-//             avg_frame_time, 1000.0 / avg_frame_time
-//        );
-	}
+static esp_err_t render_status(app_json_t *json) {
+	sensor_t *sensor = esp_camera_sensor_get();
 
-//	last_frame = 0;
+	app_json_object_start(json, NULL);
+	app_json_string(json, "board", CAM_BOARD);
+	app_json_int(json, "xclk", sensor->xclk_freq_hz / 1000000);
+	app_json_int(json, "pixformat", sensor->pixformat);
+	app_json_int(json, "sharpness", sensor->status.sharpness);
 
-	resp = ESP_OK;
-	return resp;
-err_stream_with_resp:
-	resp = resp_send_json_message(req, _500_INTERNAL_SERVER_ERROR, ERR_MSG_SOMETHING_WRONG);
-err_stream:
-	if (!!fb) esp_camera_fb_return(fb);
-	return resp;
+	//every writable control reports its current value
+	size_t count;
+	const app_camera_control_t *controls = app_camera_controls(&count);
+	for (size_t i = 0; i < count; i++)
+		app_json_int(json, controls[i].name, app_camera_control_get(sensor, &controls[i]));
+
+	app_json_int(json, "led_intensity", -1);
+	app_json_object_end(json);
+
+	return app_json_end(json);
 }
 
-static size_t jpg_encode_stream(void *arg, size_t index, const void *data, size_t len) {
-    jpg_chunking_t *j = (jpg_chunking_t *)arg;
-    if (!index)
-        j->len = 0;
+/*
+ * The body only changes through the control handlers, so it is rendered
+ * once per settings version and revalidated with the version as ETag.
+ */
+static esp_err_t cam_status_handler(httpd_req_t *req) {
+	static char status_body[JSON_RESP_BUF_LEN];
+	static size_t status_len = 0;
+	static uint32_t status_version = 0;
+
+	char etag[12];
+	uint32_t version = app_camera_settings_version();
+
+	if (!status_len || status_version != version) {
+		app_json_t json;
+		app_json_init(&json, status_body, sizeof(status_body), NULL, NULL);
+		status_len = 0;
+		APP_ERROR_CHECK_WITH_MSG(render_status(&json) == ESP_OK, "Error rendering camera status", err_status);
+		status_len = json.len;
+		status_version = version;
+	}
+
+	snprintf(etag, sizeof(etag), "\"%08x\"", version);
+	if (etag_matches(req, etag))
+		return resp_send_not_modified(req, etag);
 
-    if (httpd_resp_send_chunk(j->req, (const char *)data, len) != ESP_OK)
-        return 0;
+	httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+	httpd_resp_set_hdr(req, HTTP_HEAD_ALLOW_ORIGIN, "*");
+	httpd_resp_set_hdr(req, "Access-Control-Expose-Headers", "ETag");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+	httpd_resp_set_hdr(req, "ETag", etag);
 
-    j->len += len;
-    return len;
+	return httpd_resp_send(req, status_body, status_len);
+err_status:
+	return resp_send_json_message(req, _500_INTERNAL_SERVER_ERROR, ERR_MSG_SOMETHING_WRONG);
 }
 
 static esp_err_t cam_capture_handler(httpd_req_t *req) {
 	esp_err_t resp;
 	int64_t fr_start = esp_timer_get_time();
+	char etag[APP_FRAME_ETAG_LEN];
+
+	int max_age_ms = get_query_int(req, "max_age_ms", CAPTURE_DEFAULT_MAX_AGE_MS);
+
+	//served from the frame hub, a running stream is never interrupted
+	app_frame_t *frame = app_frame_get(MAX(max_age_ms, 0), CAPTURE_TIMEOUT_MS);
+
+	APP_ERROR_CHECK_WITH_MSG(!!frame, "Camera capture failed", err_capture_with_resp);
 
-	camera_fb_t *fb = esp_camera_fb_get();
+	camera_fb_t *fb = frame->fb;
 
-	APP_ERROR_CHECK_WITH_MSG(!!fb, "Camera capture failed", err_capture_with_resp);
+	app_frame_etag(frame, NULL, etag, sizeof(etag));
+	if (etag_matches(req, etag)) {
+		resp = resp_send_not_modified(req, etag);
+		app_frame_release(frame);
+		return resp;
+	}
 
 	httpd_resp_set_type(req, CONTENT_TYPE_IMAGE_JPEG);
 	httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
 	httpd_resp_set_hdr(req, HTTP_HEAD_ALLOW_ORIGIN, "*");
+	httpd_resp_set_hdr(req, "Access-Control-Expose-Headers", "ETag, X-Timestamp");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+	httpd_resp_set_hdr(req, "ETag", etag);
 
 	char ts[32];
 	snprintf(ts, 32, "%ld.%06ld", fb->timestamp.tv_sec, fb->timestamp.tv_usec);
@@ -366,13 +477,16 @@ static esp_err_t cam_capture_handler(httpd_req_t *req) {
 		fb_len = fb->len;
 		APP_ERROR_CHECK_WITH_MSG((resp = httpd_resp_send(req, (const char *)fb->buf, fb->len)) == ESP_OK, ERR_MSG_SOMETHING_WRONG, err_capture);
 	} else {
-		jpg_chunking_t jchunk = {req, 0};
-		APP_ERROR_CHECK_WITH_MSG(frame2jpg_cb(fb, 80, jpg_encode_stream, &jchunk), "Error when converting camera frame buffer to JPEG", err_capture_with_resp);
-		resp = httpd_resp_send_chunk(req, NULL, 0);
-		fb_len = jchunk.len;
+		const app_encoded_t *encoded = app_encode_acquire(frame);
+		APP_ERROR_CHECK_WITH_MSG(!!encoded, "Error when converting camera frame buffer to JPEG", err_capture_with_resp);
+		fb_len = encoded->len;
+		resp = httpd_resp_send(req, (const char *)encoded->buf, encoded->len);
+		app_encode_release(encoded);
 	}
-	esp_camera_fb_return(fb);
-	fb = NULL;
+	app_metrics_add(APP_METRICS_FRAMES_SERVED, 1);
+	app_metrics_add(APP_METRICS_BYTES_SENT, fb_len);
+	app_frame_release(frame);
+	frame = NULL;
 
 	int64_t fr_end = esp_timer_get_time();
 	ESP_LOGI(APP_HTTPD_TAG, "JPG: %uB %ums", (uint32_t)(fb_len), (uint32_t)((fr_end - fr_start) / 1000));
@@ -381,59 +495,118 @@ static esp_err_t cam_capture_handler(httpd_req_t *req) {
 err_capture_with_resp:
 	resp = resp_send_json_message(req, _500_INTERNAL_SERVER_ERROR, ERR_MSG_SOMETHING_WRONG);
 err_capture:
-	if (!!fb) esp_camera_fb_return(fb);
+	if (!!frame) app_frame_release(frame);
 	return resp;
 }
 
-static void setSensorIntVal(sensor_t *sensor, cJSON *resp_json_err, cJSON *resp_json_data, const char* attr, int* val, bool *hasError, int (*f)(sensor_t*, int)) {
-	if(*val != JSON_INT_ATTR_NOTFOUND) {
-		if (!(*f)(sensor, *val))
-			cJSON_AddNumberToObject(resp_json_data, attr, *val);
-		else {
-			cJSON_AddStringToObject(resp_json_err, attr, ERR_MSG_SOMETHING_WRONG);
-			*hasError = true;
-		}
+static jpg_scale_t get_query_scale(httpd_req_t *req) {
+	char query[64], val[8];
+
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK)
+		return THUMBNAIL_DEFAULT_SCALE;
+	if (httpd_query_key_value(query, "scale", val, sizeof(val)) != ESP_OK)
+		return THUMBNAIL_DEFAULT_SCALE;
+
+	if (!strcmp(val, "1/2"))
+		return JPG_SCALE_2X;
+	if (!strcmp(val, "1/4"))
+		return JPG_SCALE_4X;
+	if (!strcmp(val, "1/8"))
+		return JPG_SCALE_8X;
+
+	return JPG_SCALE_NONE;
+}
+
+static esp_err_t cam_thumbnail_handler(httpd_req_t *req) {
+	esp_err_t resp;
+	char etag[APP_FRAME_ETAG_LEN];
+	char suffix[4];
+	const app_thumb_t *thumb = NULL;
+	app_frame_t *frame = NULL;
+
+	jpg_scale_t scale = get_query_scale(req);
+	if (scale == JPG_SCALE_NONE)
+		return resp_send_json_message(req, _400_BAD_REQUEST, "scale must be 1/2, 1/4 or 1/8");
+
+	int max_age_ms = get_query_int(req, "max_age_ms", CAPTURE_DEFAULT_MAX_AGE_MS);
+
+	frame = app_frame_get(MAX(max_age_ms, 0), CAPTURE_TIMEOUT_MS);
+	APP_ERROR_CHECK_WITH_MSG(!!frame, "Camera capture failed", err_thumbnail);
+
+	//each scale is a different representation of the same frame
+	snprintf(suffix, sizeof(suffix), "-t%u", 1 << scale);
+	app_frame_etag(frame, suffix, etag, sizeof(etag));
+	if (etag_matches(req, etag)) {
+		resp = resp_send_not_modified(req, etag);
+		app_frame_release(frame);
+		return resp;
 	}
+
+	//only the first poll of a frame sequence pays for the decode and encode
+	APP_ERROR_CHECK_WITH_MSG(!!(thumb = app_thumb_acquire(frame, scale)), "Thumbnail encode failed", err_thumbnail);
+	app_frame_release(frame);
+	frame = NULL;
+
+	httpd_resp_set_type(req, CONTENT_TYPE_IMAGE_JPEG);
+	httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=thumbnail.jpg");
+	httpd_resp_set_hdr(req, HTTP_HEAD_ALLOW_ORIGIN, "*");
+	httpd_resp_set_hdr(req, "Access-Control-Expose-Headers", "ETag");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+	httpd_resp_set_hdr(req, "ETag", etag);
+
+	resp = httpd_resp_send(req, (const char *)thumb->buf, thumb->len);
+	app_metrics_add(APP_METRICS_BYTES_SENT, thumb->len);
+	app_thumb_release(thumb);
+
+	return resp;
+err_thumbnail:
+	if (!!frame) app_frame_release(frame);
+	return resp_send_json_message(req, _500_INTERNAL_SERVER_ERROR, ERR_MSG_SOMETHING_WRONG);
 }
 
 static esp_err_t cam_cmd_handler(httpd_req_t *req) {
 	esp_err_t resp;
+	cJSON *req_json_data = NULL;
 	cJSON *resp_json_err = NULL;
-	cJSON *resp_json_data = NULL;
 	char *buf;
 
+	size_t count;
+	const app_camera_control_t *controls = app_camera_controls(&count);
+	int vals[count];
+	uint32_t requested = 0;
+	int writes = 0;
+	bool framesize_written = false;
+
 	APP_ERROR_CHECK_WITH_MSG(!!(buf = getBuffer(req, &resp)), ERR_MSG_REQ_JSON_DATA_LOADING_BUFFER, err_cmd);
 
-	cJSON *req_json_data = cJSON_Parse(buf);
+	int64_t parse_start = esp_timer_get_time();
+	//a body that does not parse is no request to apply nothing
+	if (!(req_json_data = cJSON_Parse(buf)) || !cJSON_IsObject(req_json_data)) {
+		resp = resp_send_json_message(req, _400_BAD_REQUEST, ERR_MSG_INVALID_JSON);
+		APP_ERROR(err_cmd);
+	}
 	sensor_t *sensor = esp_camera_sensor_get();
-	
+
 	bool hasError = false;
 	resp_json_err = cJSON_CreateObject();
 
-	int framesize = getAttrIntVal(req_json_data, resp_json_err, "framesize", VAL_BETWEEN, sensor->pixformat == PIXFORMAT_JPEG, &hasError, 2, MIN_FRAMESIZE, MAX_FRAMESIZE);
-	int quality = getAttrIntVal(req_json_data, resp_json_err, "quality", VAL_BETWEEN, true, &hasError, 2, MIN_QUALITY, MAX_QUALITY);
-	int contrast = getAttrIntVal(req_json_data, resp_json_err, "contrast", VAL_BETWEEN, true, &hasError, 2, MIN_CONTRAST, MAX_CONTRAST);
-	int brightness = getAttrIntVal(req_json_data, resp_json_err, "brightness", VAL_BETWEEN, true, &hasError, 2, MIN_BRIGHTNESS, MAX_BRIGHTNESS);
-	int saturation = getAttrIntVal(req_json_data, resp_json_err, "saturation", VAL_BETWEEN, true, &hasError, 2, MIN_SATURATION, MAX_SATURATION);
-	int gainceiling = getAttrIntVal(req_json_data, resp_json_err, "gainceiling", VAL_BETWEEN, true, &hasError, 2, MIN_GAINCEILING, MAX_GAINCEILING);
-	int colorbar = getAttrIntVal(req_json_data, resp_json_err, "colorbar", VAL_BOOL, true, &hasError, 0);
-	int awb = getAttrIntVal(req_json_data, resp_json_err, "awb", VAL_BOOL, true, &hasError, 0);
-	int agc = getAttrIntVal(req_json_data, resp_json_err, "agc", VAL_BOOL, true, &hasError, 0);
-	int aec = getAttrIntVal(req_json_data, resp_json_err, "aec", VAL_BOOL, true, &hasError, 0);
-	int hmirror = getAttrIntVal(req_json_data, resp_json_err, "hmirror", VAL_BOOL, true, &hasError, 0);
-	int vflip = getAttrIntVal(req_json_data, resp_json_err, "vflip", VAL_BOOL, true, &hasError, 0);
-	int awb_gain = getAttrIntVal(req_json_data, resp_json_err, "awb_gain", VAL_BOOL, true, &hasError, 0);
-	int agc_gain = getAttrIntVal(req_json_data, resp_json_err, "agc_gain", VAL_BETWEEN, true, &hasError, 2, MIN_AGC_GAIN, MAX_AGC_GAIN);
-	int aec_value = getAttrIntVal(req_json_data, resp_json_err, "aec_value", VAL_BETWEEN, true, &hasError, 2, MIN_AEC_VALUE, MAX_AEC_VALUE);
-	int aec2 = getAttrIntVal(req_json_data, resp_json_err, "aec2", VAL_BOOL, true, &hasError, 0);
-	int dcw = getAttrIntVal(req_json_data, resp_json_err, "dcw", VAL_BOOL, true, &hasError, 0);
-	int bpc = getAttrIntVal(req_json_data, resp_json_err, "bpc", VAL_BOOL, true, &hasError, 0);
-	int wpc = getAttrIntVal(req_json_data, resp_json_err, "wpc", VAL_BOOL, true, &hasError, 0);
-	int raw_gma = getAttrIntVal(req_json_data, resp_json_err, "raw_gma", VAL_BOOL, true, &hasError, 0);
-	int lenc = getAttrIntVal(req_json_data, resp_json_err, "lenc", VAL_BOOL, true, &hasError, 0);
-	int special_effect = getAttrIntVal(req_json_data, resp_json_err, "special_effect", VAL_BETWEEN, true, &hasError, 2, MIN_SPECIAL_EFFECT, MAX_SPECIAL_EFFECT);
-	int wb_mode = getAttrIntVal(req_json_data, resp_json_err, "wb_mode", VAL_BETWEEN, true, &hasError, 2, MIN_WB_MODE, MAX_WB_MODE);
-	int ae_level = getAttrIntVal(req_json_data, resp_json_err, "ae_level", VAL_BETWEEN, true, &hasError, 2, MIN_AE_LEVEL, MAX_AE_LEVEL);
+	//one pass over the request, each attribute is matched against the control table
+	cJSON *attr;
+	cJSON_ArrayForEach(attr, req_json_data) {
+		int i = app_camera_control_find(attr->string);
+		if (i < 0)
+			continue;
+
+		int val = cJSON_IsBool(attr) ? cJSON_IsTrue(attr) : attr->valueint;
+		if (!(cJSON_IsNumber(attr) || cJSON_IsBool(attr)) || !app_camera_control_valid(sensor, &controls[i], val)) {
+			cJSON_AddStringToObject(resp_json_err, attr->string, ERR_MSG_INVALID_VALUE);
+			hasError = true;
+			continue;
+		}
+
+		vals[i] = val;
+		requested |= 1U << i;
+	}
 
 	cJSON_Delete(req_json_data);
 	req_json_data = NULL;
@@ -443,56 +616,54 @@ static esp_err_t cam_cmd_handler(httpd_req_t *req) {
 		APP_ERROR(err_cmd);
 	}
 
-	resp_json_data = cJSON_CreateObject();
+	//framesize and quality are planned together against the frame buffer budget
+	int fs = app_camera_control_find("framesize");
+	int q = app_camera_control_find("quality");
+	if (requested & ((1U << fs) | (1U << q))) {
+		framesize_t framesize = (requested & (1U << fs)) ? (framesize_t)vals[fs] : sensor->status.framesize;
+		int quality = (requested & (1U << q)) ? vals[q] : sensor->status.quality;
+
+		if (app_budget_plan(&framesize, &quality) != ESP_OK) {
+			cJSON_AddStringToObject(resp_json_err, controls[fs].name, ERR_MSG_NO_BUDGET);
+			resp = resp_send_json_data(req, resp_json_err, _400_BAD_REQUEST);
+			APP_ERROR(err_cmd);
+		}
 
-	//Resolution
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "framesize", &framesize, &hasError, sensor->set_framesize);
-	//Quality
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "quality", &quality, &hasError, sensor->set_quality);
-	//Contrast
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "contrast", &contrast, &hasError, sensor->set_contrast);
-	//Brightness
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "brightness", &brightness, &hasError, sensor->set_brightness);
-	//Saturation
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "saturation", &saturation, &hasError, sensor->set_saturation);
-	//Gain Ceiling
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "gainceiling", &gainceiling, &hasError, sensor->set_gainceiling);
-	//Color Bar
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "colorbar", &colorbar, &hasError, sensor->set_colorbar);
-	//AWB
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "awb", &awb, &hasError, sensor->set_whitebal);
-	//AGC
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "agc", &agc, &hasError, sensor->set_gain_ctrl);
-	//AEC SENSOR
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "aec", &aec, &hasError, sensor->set_exposure_ctrl);
-	//H-Mirror
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "hmirror", &hmirror, &hasError, sensor->set_hmirror);
-	//V-Flip
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "vflip", &vflip, &hasError, sensor->set_vflip);
-	//AWB Gain
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "awb_gain", &awb_gain, &hasError, sensor->set_awb_gain);
-	//Gain
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "agc_gain", &agc_gain, &hasError, sensor->set_agc_gain);
-	//Exposure
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "aec_value", &aec_value, &hasError, sensor->set_aec_value);
-	//AEC DSP
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "aec2", &aec2, &hasError, sensor->set_aec2);
-	//DCW (Downsize EN)
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "dcw", &dcw, &hasError, sensor->set_dcw);
-	//BPC
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "bpc", &bpc, &hasError, sensor->set_bpc);
-	//WPC
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "wpc", &wpc, &hasError, sensor->set_wpc);
-	//Raw GMA
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "raw_gma", &raw_gma, &hasError, sensor->set_raw_gma);
-	//Lens Correction
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "lenc", &lenc, &hasError, sensor->set_lenc);
-	//Special Effect
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "special_effect", &special_effect, &hasError, sensor->set_special_effect);
-	//WB Mode
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "wb_mode", &wb_mode, &hasError, sensor->set_wb_mode);
-	//AE Level
-	setSensorIntVal(sensor, resp_json_err, resp_json_data, "ae_level", &ae_level, &hasError, sensor->set_ae_level);
+		//downgraded values are applied and reported in place of the requested ones
+		vals[fs] = framesize;
+		vals[q] = quality;
+		requested |= (1U << fs) | (1U << q);
+	}
+
+	int64_t apply_start = esp_timer_get_time();
+
+	//table order is the apply order, controls already at the requested value cost no SCCB traffic
+	for (size_t i = 0; i < count; i++) {
+		if (!(requested & (1U << i)))
+			continue;
+
+		if (app_camera_control_get(sensor, &controls[i]) != vals[i]) {
+			writes++;
+			if (app_camera_control_set(sensor, &controls[i], vals[i])) {
+				cJSON_AddStringToObject(resp_json_err, controls[i].name, ERR_MSG_SOMETHING_WRONG);
+				hasError = true;
+				continue;
+			}
+			framesize_written |= (int)i == fs;
+		}
+	}
+
+	if (writes)
+		app_camera_settings_changed();
+
+	//the pool restarted the driver, the sensor is looked up again
+	if (framesize_written)
+		app_mdns_update_framesize(esp_camera_sensor_get()->status.framesize);
+
+	int64_t apply_end = esp_timer_get_time();
+	app_metrics_observe(APP_METRICS_CONTROL_APPLY, apply_end - parse_start);
+	app_metrics_add(APP_METRICS_SENSOR_WRITES, writes);
+	ESP_LOGI(APP_HTTPD_TAG, "CTRL: %d writes, parse %uus, apply %uus", writes, (uint32_t)(apply_start - parse_start), (uint32_t)(apply_end - apply_start));
 
 	if(hasError) {
 		resp = resp_send_json_data(req, resp_json_err, _500_INTERNAL_SERVER_ERROR);
@@ -502,18 +673,67 @@ static esp_err_t cam_cmd_handler(httpd_req_t *req) {
 	cJSON_Delete(resp_json_err);
 	resp_json_err = NULL;
 
-	resp = resp_send_json_data_ok(req, resp_json_data);
+	app_json_t json;
+	char json_buf[JSON_RESP_BUF_LEN];
+	json_resp_start(req, &json, json_buf, sizeof(json_buf));
 
-	cJSON_Delete(resp_json_data);
-	resp_json_data = NULL;
+	//the applied values, downgrades by the budget included
+	app_json_object_start(&json, NULL);
+	for (size_t i = 0; i < count; i++) {
+		if (requested & (1U << i))
+			app_json_int(&json, controls[i].name, vals[i]);
+	}
+	app_json_object_end(&json);
 
-	return resp;
+	return resp_send_json_writer(req, &json);
 err_cmd:
+	if(!!req_json_data) cJSON_Delete(req_json_data);
 	if(!!resp_json_err) cJSON_Delete(resp_json_err);
-	if(!!resp_json_data) cJSON_Delete(resp_json_data);
 	return resp;
 }
 
+/*
+ * Exposes the budget model so the UI only offers framesizes whose
+ * buffers fit, at the current quality or at ?quality=.
+ */
+static esp_err_t cam_budget_handler(httpd_req_t *req) {
+	sensor_t *sensor = esp_camera_sensor_get();
+	app_budget_t budget;
+	app_budget_entry_t entry;
+
+	int quality = get_query_int(req, "quality", sensor->status.quality);
+	if (quality < MIN_QUALITY || quality > MAX_QUALITY)
+		return resp_send_json_message(req, _400_BAD_REQUEST, ERR_MSG_INVALID_VALUE);
+
+	app_budget_snapshot(&budget);
+
+	app_json_t json;
+	char buf[JSON_RESP_BUF_LEN];
+	json_resp_start(req, &json, buf, sizeof(buf));
+
+	app_json_object_start(&json, NULL);
+	app_json_int(&json, "fb_count", budget.fb_count);
+	app_json_string(&json, "location", budget.psram ? "psram" : "dram");
+	app_json_int(&json, "heap_free", budget.heap_free);
+	app_json_int(&json, "heap_largest", budget.heap_largest);
+	app_json_int(&json, "quality", quality);
+	app_json_array_start(&json, "framesizes");
+	for (int i = MIN_FRAMESIZE; i <= APP_FB_POOL_MAX_FRAMESIZE; i++) {
+		app_budget_entry(&budget, i, quality, &entry);
+		app_json_object_start(&json, NULL);
+		app_json_int(&json, "framesize", entry.framesize);
+		app_json_int(&json, "buffer_len", entry.buffer_len);
+		app_json_int(&json, "jpeg_len", entry.jpeg_len);
+		app_json_int(&json, "quality", entry.quality);
+		app_json_bool(&json, "fits", entry.fits);
+		app_json_object_end(&json);
+	}
+	app_json_array_end(&json);
+	app_json_object_end(&json);
+
+	return resp_send_json_writer(req, &json);
+}
+
 static esp_err_t cam_xclk_handler(httpd_req_t *req) {
 	esp_err_t resp;
 	cJSON *resp_json_err = NULL;
@@ -548,6 +768,7 @@ static esp_err_t cam_xclk_handler(httpd_req_t *req) {
 	resp_json_data = cJSON_CreateObject();
 	sensor_t *sensor = esp_camera_sensor_get();
 
+	app_camera_settings_changed();
 	if (!sensor->set_xclk(sensor, LEDC_TIMER_0, xclk))
 		cJSON_AddNumberToObject(resp_json_data, "xclk", xclk);
 	else {
@@ -591,6 +812,7 @@ static esp_err_t cam_reg_handler(httpd_req_t *req) {
 	resp_json_data = cJSON_CreateObject();
 	sensor_t *sensor = esp_camera_sensor_get();
 
+	app_camera_settings_changed();
 	if (!sensor->set_reg(sensor, reg, mask, val)) {
 		cJSON_AddNumberToObject(resp_json_data, "reg", reg);
 		cJSON_AddNumberToObject(resp_json_data, "mask", mask);
@@ -686,6 +908,7 @@ static esp_err_t cam_pll_handler(httpd_req_t *req) {
 	resp_json_data = cJSON_CreateObject();
 	sensor_t *sensor = esp_camera_sensor_get();
 
+	app_camera_settings_changed();
 	if (!sensor->set_pll(sensor, bypass, mul, sys, root, pre, seld5, pclken, pclk)) {
 		cJSON_AddNumberToObject(resp_json_data, "bypass", bypass);
 		cJSON_AddNumberToObject(resp_json_data, "mul", mul);
@@ -751,6 +974,7 @@ static esp_err_t cam_win_handler(httpd_req_t *req) {
 	resp_json_data = cJSON_CreateObject();
 	sensor_t *s = esp_camera_sensor_get();
 
+	app_camera_settings_changed();
 	if (!s->set_res_raw(s, startX, startY, endX, endY, offsetX, offsetY, totalX, totalY, outputX, outputY, scale, binning)) {
 		cJSON_AddNumberToObject(resp_json_data, "sx", startX);
 		cJSON_AddNumberToObject(resp_json_data, "sy", startY);
@@ -783,9 +1007,254 @@ err_win:
 }
 
 static esp_err_t mdns_handler(httpd_req_t *req) {
-	cJSON* items = cJSON_CreateArray();
-	app_mdns_query(items);
-	esp_err_t resp = resp_send_json_data_ok(req, items);
-	cJSON_Delete(items);
+	esp_err_t resp;
+	char etag[12];
+
+	const app_mdns_snapshot_t *snapshot = app_mdns_snapshot_acquire();
+	if (!snapshot)
+		return resp_send_json_message(req, _500_INTERNAL_SERVER_ERROR, ERR_MSG_SOMETHING_WRONG);
+
+	snprintf(etag, sizeof(etag), "\"%08x\"", snapshot->version);
+	if (etag_matches(req, etag)) {
+		app_mdns_snapshot_release(snapshot);
+		return resp_send_not_modified(req, etag);
+	}
+
+	httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+	httpd_resp_set_hdr(req, HTTP_HEAD_ALLOW_ORIGIN, "*");
+	httpd_resp_set_hdr(req, "Access-Control-Expose-Headers", "ETag");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+	httpd_resp_set_hdr(req, "ETag", etag);
+
+	resp = httpd_resp_send(req, snapshot->body, snapshot->len);
+	app_mdns_snapshot_release(snapshot);
+
+	return resp;
+}
+
+/* Viewers of the stream engine followed by the RTSP sessions. */
+static esp_err_t stream_clients_handler(httpd_req_t *req) {
+	static const char *transports[] = {
+		[APP_STREAM_MJPEG] = "mjpeg",
+		[APP_STREAM_WS] = "ws",
+		[APP_STREAM_RTSP_UDP] = "rtsp-udp",
+		[APP_STREAM_RTSP_TCP] = "rtsp-tcp"
+	};
+	app_stream_client_info_t infos[CONFIG_CAM_STREAM_MAX_CLIENTS + CONFIG_CAM_RTSP_MAX_CLIENTS];
+	char ip[16];
+
+	int count = app_stream_get_clients(infos, CONFIG_CAM_STREAM_MAX_CLIENTS);
+	count += app_rtsp_get_clients(infos + count, CONFIG_CAM_RTSP_MAX_CLIENTS);
+
+	app_json_t json;
+	char buf[JSON_RESP_BUF_LEN];
+	json_resp_start(req, &json, buf, sizeof(buf));
+
+	app_json_array_start(&json, NULL);
+	for (int i = 0; i < count; i++) {
+		uint8_t *addr = (uint8_t *)&infos[i].ip;
+		sprintf(ip, "%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
+
+		app_json_object_start(&json, NULL);
+		app_json_string(&json, "ip", ip);
+		app_json_int(&json, "port", infos[i].port);
+		app_json_int(&json, "uptime_ms", infos[i].uptime_ms);
+		app_json_fixed(&json, "fps", (int64_t)(infos[i].fps * 100 + 0.5f), 2);
+		app_json_int(&json, "latency_ms", infos[i].latency_ms);
+		app_json_int(&json, "queue_bytes", infos[i].queue_bytes);
+		app_json_int(&json, "frames_sent", infos[i].frames_sent);
+		app_json_int(&json, "frames_dropped", infos[i].frames_dropped);
+		app_json_int(&json, "frames_spilled", infos[i].frames_spilled);
+		app_json_int(&json, "bytes_sent", infos[i].bytes_sent);
+		app_json_string(&json, "mode", infos[i].static_mode ? "static" : "full");
+		app_json_string(&json, "transport", transports[infos[i].transport]);
+		if (infos[i].transport == APP_STREAM_WS) {
+			app_json_int(&json, "ack_ms", infos[i].ack_ms);
+			app_json_int(&json, "unacked", infos[i].ws_pending);
+		}
+		app_json_int(&json, "frames_suppressed", infos[i].frames_suppressed);
+		app_json_int(&json, "bytes_saved", infos[i].bytes_saved);
+		app_json_object_end(&json);
+	}
+	app_json_array_end(&json);
+
+	return resp_send_json_writer(req, &json);
+}
+
+typedef struct {
+	httpd_req_t *req;
+	size_t len;
+	char buf[1024];
+} metrics_chunking_t;
+
+static esp_err_t metrics_write(void *arg, const char *data, size_t len) {
+	metrics_chunking_t *m = (metrics_chunking_t *)arg;
+
+	if (m->len + len > sizeof(m->buf)) {
+		APP_ERROR_CHECK(httpd_resp_send_chunk(m->req, m->buf, m->len) == ESP_OK, err_write);
+		m->len = 0;
+	}
+
+	memcpy(m->buf + m->len, data, len);
+	m->len += len;
+
+	return ESP_OK;
+err_write:
+	return ESP_FAIL;
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req) {
+	esp_err_t resp;
+	metrics_chunking_t *m = NULL;
+
+	APP_ERROR_CHECK_WITH_MSG(!!(m = malloc(sizeof(metrics_chunking_t))), "No memory for metrics buffer", err_metrics_with_resp);
+	m->req = req;
+	m->len = 0;
+
+	httpd_resp_set_type(req, "text/plain; version=0.0.4");
+	httpd_resp_set_hdr(req, HTTP_HEAD_ALLOW_ORIGIN, "*");
+
+	APP_ERROR_CHECK_WITH_MSG((resp = app_metrics_render(metrics_write, m)) == ESP_OK, "Error sending metrics", err_metrics);
+	if (!!m->len)
+		APP_ERROR_CHECK_WITH_MSG((resp = httpd_resp_send_chunk(req, m->buf, m->len)) == ESP_OK, "Error sending metrics", err_metrics);
+	resp = httpd_resp_send_chunk(req, NULL, 0);
+
+	free(m);
+	return resp;
+err_metrics_with_resp:
+	resp = resp_send_json_message(req, _500_INTERNAL_SERVER_ERROR, ERR_MSG_SOMETHING_WRONG);
+err_metrics:
+	if (!!m) free(m);
+	return resp;
+}
+
+static void render_motion_config(app_json_t *json, const app_motion_config_t *config) {
+	app_json_bool(json, "enabled", config->enabled);
+	app_json_int(json, "threshold", config->threshold);
+	app_json_int(json, "trigger", config->trigger);
+	app_json_int(json, "hold_ms", config->hold_ms);
+}
+
+/*
+ * Last analysed frame and the recorded events, only those newer than
+ * ?since= when given. Pushed events are on the stream port at
+ * /motion/events.
+ */
+static esp_err_t motion_handler(httpd_req_t *req) {
+	app_motion_config_t config;
+	app_motion_status_t status;
+	app_motion_event_t events[APP_MOTION_EVENTS];
+
+	app_motion_get_config(&config);
+	app_motion_get_status(&status);
+	int count = app_motion_get_events(get_query_int(req, "since", 0), events, APP_MOTION_EVENTS);
+
+	app_json_t json;
+	char buf[JSON_RESP_BUF_LEN];
+	json_resp_start(req, &json, buf, sizeof(buf));
+
+	app_json_object_start(&json, NULL);
+	render_motion_config(&json, &config);
+	app_json_int(&json, "seq", status.seq);
+	app_json_int(&json, "uptime_ms", status.uptime_ms);
+	app_json_int(&json, "score", status.score);
+	app_json_bool(&json, "active", status.active);
+	app_json_int(&json, "changed", status.changed);
+	app_json_array_start(&json, "box");
+	app_json_int(&json, NULL, status.box.x0);
+	app_json_int(&json, NULL, status.box.y0);
+	app_json_int(&json, NULL, status.box.x1);
+	app_json_int(&json, NULL, status.box.y1);
+	app_json_array_end(&json);
+	app_json_array_start(&json, "grid");
+	app_json_int(&json, NULL, APP_MOTION_GRID_W);
+	app_json_int(&json, NULL, APP_MOTION_GRID_H);
+	app_json_array_end(&json);
+	app_json_array_start(&json, "rows");
+	for (int i = 0; i < APP_MOTION_GRID_H; i++)
+		app_json_int(&json, NULL, status.rows[i]);
+	app_json_array_end(&json);
+	app_json_int(&json, "frames", status.frames);
+	app_json_int(&json, "skipped", status.skipped);
+	app_json_int(&json, "analyse_us", status.analyse_us);
+	app_json_array_start(&json, "events");
+	for (int i = 0; i < count; i++)
+		app_motion_event_json(&json, NULL, &events[i]);
+	app_json_array_end(&json);
+	app_json_object_end(&json);
+
+	return resp_send_json_writer(req, &json);
+}
+
+static esp_err_t motion_config_handler(httpd_req_t *req) {
+	esp_err_t resp;
+	cJSON *req_json_data = NULL;
+	cJSON *resp_json_err = NULL;
+	app_motion_config_t config;
+	char *buf;
+
+	APP_ERROR_CHECK_WITH_MSG(!!(buf = getBuffer(req, &resp)), ERR_MSG_REQ_JSON_DATA_LOADING_BUFFER, err_motion);
+
+	req_json_data = cJSON_Parse(buf);
+	resp_json_err = cJSON_CreateObject();
+	bool hasError = false;
+
+	//attributes left out keep their current value
+	app_motion_get_config(&config);
+
+	cJSON *attr;
+	cJSON_ArrayForEach(attr, req_json_data) {
+		bool valid;
+		if (!strcmp(attr->string, "enabled")) {
+			if ((valid = cJSON_IsBool(attr)))
+				config.enabled = cJSON_IsTrue(attr);
+		} else if (!strcmp(attr->string, "threshold")) {
+			if ((valid = cJSON_IsNumber(attr) && attr->valueint >= 1 && attr->valueint <= 255))
+				config.threshold = attr->valueint;
+		} else if (!strcmp(attr->string, "trigger")) {
+			if ((valid = cJSON_IsNumber(attr) && attr->valueint >= 1 && attr->valueint <= 100))
+				config.trigger = attr->valueint;
+		} else if (!strcmp(attr->string, "hold_ms")) {
+			if ((valid = cJSON_IsNumber(attr) && attr->valueint >= 0 && attr->valueint <= 60000))
+				config.hold_ms = attr->valueint;
+		} else {
+			continue;
+		}
+
+		if (!valid) {
+			cJSON_AddStringToObject(resp_json_err, attr->string, ERR_MSG_INVALID_VALUE);
+			hasError = true;
+		}
+	}
+
+	cJSON_Delete(req_json_data);
+	req_json_data = NULL;
+
+	if(hasError) {
+		resp = resp_send_json_data(req, resp_json_err, _400_BAD_REQUEST);
+		APP_ERROR(err_motion);
+	}
+
+	cJSON_Delete(resp_json_err);
+	resp_json_err = NULL;
+
+	if (app_motion_set_config(&config) != ESP_OK) {
+		resp = resp_send_json_message(req, _500_INTERNAL_SERVER_ERROR, ERR_MSG_SOMETHING_WRONG);
+		APP_ERROR(err_motion);
+	}
+
+	app_json_t json;
+	char json_buf[JSON_RESP_BUF_LEN];
+	json_resp_start(req, &json, json_buf, sizeof(json_buf));
+
+	app_motion_get_config(&config);
+	app_json_object_start(&json, NULL);
+	render_motion_config(&json, &config);
+	app_json_object_end(&json);
+
+	return resp_send_json_writer(req, &json);
+err_motion:
+	if(!!req_json_data) cJSON_Delete(req_json_data);
+	if(!!resp_json_err) cJSON_Delete(resp_json_err);
 	return resp;
 }
@@ -0,0 +1,174 @@
+/*
+ * app_json.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "app_common.h"
+#include "app_json.h"
+
+static const char hex[] = "0123456789abcdef";
+
+void app_json_init(app_json_t *json, char *buf, size_t size, app_json_flush_t flush, void *arg) {
+	json->buf = buf;
+	json->size = size;
+	json->len = 0;
+	json->flush = flush;
+	json->arg = arg;
+	json->flushed = false;
+	json->depth = 0;
+	json->has_items = 0;
+	json->err = ESP_OK;
+}
+
+static void json_write(app_json_t *json, const char *data, size_t len) {
+	while (json->err == ESP_OK && len > 0) {
+		if (json->len == json->size) {
+			if (!json->flush) {
+				json->err = ESP_ERR_NO_MEM;
+				return;
+			}
+			if ((json->err = json->flush(json->arg, json->buf, json->len)) != ESP_OK)
+				return;
+			json->len = 0;
+			json->flushed = true;
+		}
+
+		size_t n = json->size - json->len;
+		if (n > len)
+			n = len;
+		memcpy(json->buf + json->len, data, n);
+		json->len += n;
+		data += n;
+		len -= n;
+	}
+}
+
+static void json_write_escaped(app_json_t *json, const char *str) {
+	char esc[6] = { '\\', 'u', '0', '0' };
+	const char *run = str;
+
+	json_write(json, "\"", 1);
+	for (; *str; str++) {
+		unsigned char c = *str;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		json_write(json, run, str - run);
+		run = str + 1;
+		if (c == '"' || c == '\\') {
+			esc[1] = c;
+			json_write(json, esc, 2);
+		} else {
+			esc[1] = 'u';
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xf];
+			json_write(json, esc, 6);
+		}
+	}
+	json_write(json, run, str - run);
+	json_write(json, "\"", 1);
+}
+
+static void json_key(app_json_t *json, const char *key) {
+	uint8_t bit = 1 << json->depth;
+
+	if (json->has_items & bit)
+		json_write(json, ",", 1);
+	json->has_items |= bit;
+
+	if (!!key) {
+		json_write_escaped(json, key);
+		json_write(json, ":", 1);
+	}
+}
+
+static void json_open(app_json_t *json, const char *key, char c) {
+	if (json->depth + 1 >= APP_JSON_MAX_DEPTH) {
+		json->err = ESP_ERR_INVALID_STATE;
+		return;
+	}
+
+	json_key(json, key);
+	json_write(json, &c, 1);
+	json->depth++;
+	json->has_items &= ~(1 << json->depth);
+}
+
+static void json_close(app_json_t *json, char c) {
+	if (!json->depth) {
+		json->err = ESP_ERR_INVALID_STATE;
+		return;
+	}
+
+	json->depth--;
+	json_write(json, &c, 1);
+}
+
+void app_json_object_start(app_json_t *json, const char *key) {
+	json_open(json, key, '{');
+}
+
+void app_json_object_end(app_json_t *json) {
+	json_close(json, '}');
+}
+
+void app_json_array_start(app_json_t *json, const char *key) {
+	json_open(json, key, '[');
+}
+
+void app_json_array_end(app_json_t *json) {
+	json_close(json, ']');
+}
+
+void app_json_string(app_json_t *json, const char *key, const char *val) {
+	json_key(json, key);
+	if (!!val)
+		json_write_escaped(json, val);
+	else
+		json_write(json, "null", 4);
+}
+
+void app_json_int(app_json_t *json, const char *key, int64_t val) {
+	app_json_fixed(json, key, val, 0);
+}
+
+void app_json_fixed(app_json_t *json, const char *key, int64_t val, uint8_t decimals) {
+	char digits[24];
+	char *p = digits + sizeof(digits);
+	uint64_t u = val < 0 ? -(uint64_t)val : (uint64_t)val;
+	int n = 0;
+
+	//the decimals are always written, leading zeros included
+	do {
+		if (n++ == decimals && !!decimals)
+			*--p = '.';
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u || n <= decimals);
+	if (val < 0)
+		*--p = '-';
+
+	json_key(json, key);
+	json_write(json, p, digits + sizeof(digits) - p);
+}
+
+void app_json_bool(app_json_t *json, const char *key, bool val) {
+	json_key(json, key);
+	if (val)
+		json_write(json, "true", 4);
+	else
+		json_write(json, "false", 5);
+}
+
+esp_err_t app_json_end(app_json_t *json) {
+	if (json->err == ESP_OK && json->depth)
+		json->err = ESP_ERR_INVALID_STATE;
+
+	return json->err;
+}
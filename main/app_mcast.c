@@ -0,0 +1,214 @@
+/*
+ * app_mcast.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+
+#include "app_common.h"
+#include "app_encode.h"
+#include "app_frame.h"
+#include "app_mcast.h"
+#include "app_metrics.h"
+
+//datagram with its header, fits a single Ethernet frame
+#define MCAST_DATAGRAM_LEN 1400
+#define MCAST_PAYLOAD_LEN (MCAST_DATAGRAM_LEN - APP_MCAST_HEADER_LEN)
+//a datagram lwIP has no buffer for is retried this many times, a tick apart
+#define MCAST_SEND_RETRIES 5
+#define MCAST_STATS_PERIOD_US (10 * 1000000)
+
+typedef struct {
+	uint32_t frames;
+	uint32_t abandoned;
+	uint32_t datagrams;
+	uint64_t bytes;
+} mcast_stats_t;
+
+static int mcast_fd = -1;
+static struct sockaddr_in group_addr;
+static uint16_t datagram_seq = 0;
+static mcast_stats_t stats;
+
+static TaskHandle_t mcast_task_handle = NULL;
+
+static void mcast_task(void *pvParameters);
+
+static void mcast_frame_ready(void *arg) {
+	xTaskNotifyGive(mcast_task_handle);
+}
+
+/*
+ * Every frame goes out once to the group, however many viewers there
+ * are. Keeps the camera capturing while nobody streams.
+ */
+esp_err_t init_mcast(void) {
+	uint8_t ttl = CONFIG_CAM_MCAST_TTL;
+
+	memset(&group_addr, 0, sizeof(group_addr));
+	group_addr.sin_family = AF_INET;
+	group_addr.sin_port = htons(CONFIG_CAM_MCAST_PORT);
+	APP_ERROR_CHECK_WITH_MSG(inet_aton(CONFIG_CAM_MCAST_GROUP, &group_addr.sin_addr), "Invalid multicast group " CONFIG_CAM_MCAST_GROUP, err_init);
+
+	APP_ERROR_CHECK_WITH_MSG((mcast_fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0, "socket() multicast Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(!setsockopt(mcast_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)), "setsockopt() IP_MULTICAST_TTL Failed", err_init);
+
+	APP_ERROR_CHECK_WITH_MSG(xTaskCreatePinnedToCore(mcast_task, "mcast", configMINIMAL_STACK_SIZE * 4, NULL, 5, &mcast_task_handle, APP_FRAME_CAPTURE_CORE) == pdPASS, "xTaskCreatePinnedToCore() multicast task Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(app_frame_subscribe(mcast_frame_ready, NULL) == ESP_OK, "Multicast frame subscription failed", err_init);
+
+	ESP_LOGI(APP_MCAST_TAG, "Sending frames to %s:%d", CONFIG_CAM_MCAST_GROUP, CONFIG_CAM_MCAST_PORT);
+
+	return ESP_OK;
+err_init:
+	if (mcast_fd >= 0) close(mcast_fd);
+	mcast_fd = -1;
+	return ESP_FAIL;
+}
+
+static uint8_t *put_u16_be(uint8_t *buf, uint16_t val) {
+	*buf++ = val >> 8;
+	*buf++ = val;
+	return buf;
+}
+
+static uint8_t *put_u32_be(uint8_t *buf, uint32_t val) {
+	*buf++ = val >> 24;
+	*buf++ = val >> 16;
+	*buf++ = val >> 8;
+	*buf++ = val;
+	return buf;
+}
+
+/*
+ * Header of every datagram, big endian:
+ *   version u8, header length u8, datagram sequence u16,
+ *   frame sequence u32, frame length u32, fragment offset u32,
+ *   fragment index u16, fragment count u16, capture time in ms u32
+ * followed by the fragment. Receivers drop a frame missing any of them.
+ */
+static bool mcast_send_frame(uint32_t seq, const uint8_t *jpg, size_t len, const struct timeval *timestamp) {
+	uint8_t header[APP_MCAST_HEADER_LEN];
+	struct iovec iov[2];
+	struct msghdr msg;
+	uint16_t count = (len + MCAST_PAYLOAD_LEN - 1) / MCAST_PAYLOAD_LEN;
+	uint32_t timestamp_ms = timestamp->tv_sec * 1000 + timestamp->tv_usec / 1000;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &group_addr;
+	msg.msg_namelen = sizeof(group_addr);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+
+	for (uint16_t index = 0; index < count; index++) {
+		size_t offset = (size_t)index * MCAST_PAYLOAD_LEN;
+		uint8_t *p = header;
+		int retries = 0;
+
+		*p++ = APP_MCAST_VERSION;
+		*p++ = APP_MCAST_HEADER_LEN;
+		p = put_u16_be(p, datagram_seq++);
+		p = put_u32_be(p, seq);
+		p = put_u32_be(p, len);
+		p = put_u32_be(p, offset);
+		p = put_u16_be(p, index);
+		p = put_u16_be(p, count);
+		put_u32_be(p, timestamp_ms);
+
+		//the fragment is sent straight from the frame
+		iov[1].iov_base = (void *)(jpg + offset);
+		iov[1].iov_len = MIN(len - offset, MCAST_PAYLOAD_LEN);
+
+		while (sendmsg(mcast_fd, &msg, 0) < 0) {
+			//without this fragment the rest of the frame is of no use
+			if ((errno != ENOMEM && errno != EAGAIN && errno != EWOULDBLOCK) || ++retries > MCAST_SEND_RETRIES)
+				return false;
+			vTaskDelay(1);
+		}
+
+		stats.datagrams++;
+		stats.bytes += sizeof(header) + iov[1].iov_len;
+		app_metrics_add(APP_METRICS_BYTES_SENT, sizeof(header) + iov[1].iov_len);
+	}
+
+	return true;
+}
+
+static void mcast_log_stats(int64_t elapsed_us) {
+	if (!!stats.frames || !!stats.abandoned)
+		ESP_LOGI(APP_MCAST_TAG, "Multicast: %u frames, %u abandoned, %.1f datagrams/frame, %u KB/s",
+			stats.frames, stats.abandoned, !!stats.frames ? (float)stats.datagrams / stats.frames : 0,
+			(uint32_t)(stats.bytes * 1000000 / elapsed_us / 1024));
+	memset(&stats, 0, sizeof(stats));
+}
+
+static void mcast_task(void *pvParameters) {
+	const app_encoded_t *encoded;
+	app_frame_t *frame;
+	uint32_t last_seq = 0;
+	int64_t now, stats_start = esp_timer_get_time();
+	size_t jpg_len;
+	const uint8_t *jpg;
+
+	for (;;) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		now = esp_timer_get_time();
+		if (now - stats_start >= MCAST_STATS_PERIOD_US) {
+			mcast_log_stats(now - stats_start);
+			stats_start = now;
+		}
+
+		//always the newest frame, the ones published while sending are skipped
+		if (!(frame = app_frame_acquire()))
+			continue;
+		if (frame->seq == last_seq) {
+			app_frame_release(frame);
+			continue;
+		}
+
+		camera_fb_t *fb = frame->fb;
+		encoded = NULL;
+		if (fb->format != PIXFORMAT_JPEG) {
+			//shared with the stream viewers of the same frame
+			if (!(encoded = app_encode_acquire(frame))) {
+				app_frame_release(frame);
+				continue;
+			}
+			jpg = encoded->buf;
+			jpg_len = encoded->len;
+		} else {
+			jpg = fb->buf;
+			jpg_len = fb->len;
+		}
+
+		if (!!last_seq && frame->seq - last_seq > 1)
+			app_metrics_add(APP_METRICS_FRAMES_DROPPED, frame->seq - last_seq - 1);
+		last_seq = frame->seq;
+
+		if (mcast_send_frame(frame->seq, jpg, jpg_len, &fb->timestamp)) {
+			stats.frames++;
+			app_metrics_add(APP_METRICS_MCAST_FRAMES, 1);
+		} else {
+			stats.abandoned++;
+		}
+
+		app_encode_release(encoded);
+		app_frame_release(frame);
+	}
+	vTaskDelete(NULL);
+}
@@ -5,7 +5,10 @@
  *      Author: ceanm
  */
 #include <string.h>
+#include <sys/param.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
 #include "mdns.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -15,8 +18,32 @@
 
 #include "app_common.h"
 #include "app_camera.h"
+#include "app_httpd.h"
+#include "app_json.h"
 #include "app_mdns.h"
 
+#define MDNS_QUERY_INTERVAL_MS 5000
+#define MDNS_QUERY_TIMEOUT_MS 1500
+//a camera missing from three browses in a row is dropped
+#define MDNS_CAM_TTL_US (3LL * (MDNS_QUERY_INTERVAL_MS + MDNS_QUERY_TIMEOUT_MS) * 1000)
+#define MDNS_TXT_MAX 8
+
+typedef struct {
+	char key[16];
+	char value[32];
+} mdns_cam_txt_t;
+
+typedef struct mdns_cam_s {
+	struct mdns_cam_s *next;
+	char instance[64];
+	char host[64];
+	uint16_t port;
+	uint32_t ip;
+	size_t txt_count;
+	mdns_cam_txt_t txt[MDNS_TXT_MAX];
+	int64_t seen_us;
+} mdns_cam_t;
+
 static const char * service_name = "sisbarc-webcam";
 static const char * proto = "TCP";
 
@@ -27,90 +54,179 @@ static char iname[64];
 static char hname[64];
 static char framesize[4];
 static char pixformat[4];
+static char stream_port[6];
+#if CONFIG_CAM_MCAST_ENABLE
+//group:port the frames are sent to
+static char mcast_addr[24];
+#endif
 
-static mdns_result_t * found_cams = NULL;
-
-void app_mdns_query(cJSON* resp_json_data) {
-	cJSON* item = cJSON_CreateObject();
-	cJSON_AddStringToObject(item, "instance", iname);
-	cJSON_AddStringToObject(item, "host", hname);
-	cJSON_AddNumberToObject(item, "port", 80);
-
-	cJSON *txt = cJSON_CreateObject();
-	cJSON_AddStringToObject(txt, "pixformat", pixformat);
-	cJSON_AddStringToObject(txt, "framesize", framesize);
-	cJSON_AddNumberToObject(txt, "stream_port", 81);
-	cJSON_AddStringToObject(txt, "board", CAM_BOARD);
-	cJSON_AddStringToObject(txt, "model", model);
+//keyed by instance name, entries are only allocated when a camera first shows up
+static mdns_cam_t * cams = NULL;
+static uint32_t own_ip = 0;
 
-	cJSON_AddItemToObject(item, "txt", txt);
+//readers only hold this long enough to take a reference, never behind a browse
+static portMUX_TYPE snapshot_mux = portMUX_INITIALIZER_UNLOCKED;
+static app_mdns_snapshot_t * current_snapshot = NULL;
 
-	//add own data first
+static uint32_t mdns_own_ip(void) {
 	tcpip_adapter_ip_info_t ip;
 	if (strlen(CONFIG_APP_WIFI_SSID)) {
 		tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &ip);
 	} else {
 		tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_AP, &ip);
 	}
+	return ip.ip.addr;
+}
 
+static void mdns_render(app_json_t *json, uint32_t own_ip) {
 	char formatted_ip[16];
-	sprintf(formatted_ip, IPSTR, IP2STR(&(ip.ip)));
+	char id[22];
 
-	cJSON_AddStringToObject(item, "ip", formatted_ip);
+	app_json_array_start(json, NULL);
 
-	char id[22];
-	sprintf(id, "%s:%u", formatted_ip, 80);
+	//add own data first
+	app_json_object_start(json, NULL);
+	app_json_string(json, "instance", iname);
+	app_json_string(json, "host", hname);
+	app_json_int(json, "port", app_httpd_port());
+
+	app_json_object_start(json, "txt");
+	app_json_string(json, "pixformat", pixformat);
+	app_json_string(json, "framesize", framesize);
+	app_json_int(json, "stream_port", CONFIG_CAM_STREAM_PORT);
+#if CONFIG_CAM_MCAST_ENABLE
+	app_json_string(json, "mcast", mcast_addr);
+#endif
+	app_json_string(json, "board", CAM_BOARD);
+	app_json_string(json, "model", model);
+	app_json_object_end(json);
+
+	sprintf(formatted_ip, IPSTR, IP2STR((esp_ip4_addr_t *)&own_ip));
+	app_json_string(json, "ip", formatted_ip);
+	sprintf(id, "%s:%u", formatted_ip, app_httpd_port());
+	app_json_string(json, "id", id);
+
+	app_json_string(json, "service", service_name);
+	app_json_string(json, "proto", proto);
+	app_json_object_end(json);
+
+	for (mdns_cam_t *cam = cams; !!cam; cam = cam->next) {
+		app_json_object_start(json, NULL);
+		app_json_string(json, "instance", cam->instance);
+		if (!!cam->host[0]) {
+			app_json_string(json, "host", cam->host);
+			app_json_int(json, "port", cam->port);
+		}
+		if (!!cam->txt_count) {
+			app_json_object_start(json, "txt");
+			for (size_t i = 0; i < cam->txt_count; i++)
+				app_json_string(json, cam->txt[i].key, cam->txt[i].value);
+			app_json_object_end(json);
+		}
+		if (!!cam->ip) {
+			sprintf(formatted_ip, IPSTR, IP2STR((esp_ip4_addr_t *)&cam->ip));
+			app_json_string(json, "ip", formatted_ip);
+			sprintf(id, "%s:%u", formatted_ip, cam->port);
+			app_json_string(json, "id", id);
+		}
+		app_json_string(json, "service", service_name);
+		app_json_string(json, "proto", proto);
+		app_json_object_end(json);
+	}
 
-	cJSON_AddStringToObject(item, "id", id);
+	app_json_array_end(json);
+}
 
-	cJSON_AddStringToObject(item, "service", service_name);
-	cJSON_AddStringToObject(item, "proto", proto);
+static esp_err_t mdns_count(void *arg, const char *data, size_t len) {
+	*(size_t *)arg += len;
+	return ESP_OK;
+}
+
+static void mdns_snapshot_unref(app_mdns_snapshot_t *snapshot) {
+	uint32_t refs;
+
+	portENTER_CRITICAL(&snapshot_mux);
+	refs = --snapshot->refs;
+	portEXIT_CRITICAL(&snapshot_mux);
+
+	if (!refs)
+		free(snapshot);
+}
 
-	cJSON_AddItemToArray(resp_json_data, item);
+/*
+ * Renders the camera list twice, first only to measure it, so the snapshot
+ * is a single exact-size allocation that is never written again.
+ */
+static esp_err_t mdns_publish(void) {
+	app_mdns_snapshot_t *snapshot = NULL, *old;
+	app_json_t json;
+	char scratch[64];
+	size_t len = 0;
 
 	xSemaphoreTake(query_lock, portMAX_DELAY);
-	if (!!found_cams) {
-		mdns_result_t* result = found_cams;
-		mdns_ip_addr_t* addr = NULL;
-		int i;
-		while(!!result) {
-			item = cJSON_CreateObject();
-			if(!!result->instance_name)
-				cJSON_AddStringToObject(item, "instance", result->instance_name);
-			if(!!result->hostname) {
-				cJSON_AddStringToObject(item, "host", result->hostname);
-				cJSON_AddNumberToObject(item, "port", result->port);
-			}
-			if(!!result->txt_count) {
-				txt = cJSON_CreateObject();
-				for(i=0; i < result->txt_count; i++)
-					cJSON_AddStringToObject(txt, result->txt[i].key, result->txt[i].value ? result->txt[i].value : "NULL");
-
-				cJSON_AddItemToObject(item, "txt", txt);
-			}
-			addr = result->addr;
-			while(!!addr) {
-				if(addr->addr.type != IPADDR_TYPE_V6){
-					sprintf(formatted_ip, IPSTR, IP2STR(&(addr->addr.u_addr.ip4)));
-					cJSON_AddStringToObject(item, "ip", formatted_ip);
-					sprintf(id, "%s:%u", formatted_ip, result->port);
-					cJSON_AddStringToObject(item, "id", id);
-					break;
-				}
-				addr = addr->next;
-			}
-			cJSON_AddStringToObject(item, "service", service_name);
-			cJSON_AddStringToObject(item, "proto", proto);
-			cJSON_AddItemToArray(resp_json_data, item);
-			result = result->next;
-		}
-	}
+
+	own_ip = mdns_own_ip();
+
+	app_json_init(&json, scratch, sizeof(scratch), mdns_count, &len);
+	mdns_render(&json, own_ip);
+	APP_ERROR_CHECK_WITH_MSG(app_json_end(&json) == ESP_OK, "Error measuring mDNS snapshot", err_publish);
+	len += json.len;
+
+	APP_ERROR_CHECK_WITH_MSG(!!(snapshot = malloc(sizeof(app_mdns_snapshot_t) + len)), "No memory for mDNS snapshot", err_publish);
+	app_json_init(&json, snapshot->body, len, NULL, NULL);
+	mdns_render(&json, own_ip);
+	APP_ERROR_CHECK_WITH_MSG(app_json_end(&json) == ESP_OK, "Error rendering mDNS snapshot", err_publish);
+
+	snapshot->len = json.len;
+	snapshot->refs = 1;
+
+	portENTER_CRITICAL(&snapshot_mux);
+	old = current_snapshot;
+	snapshot->version = !!old ? old->version + 1 : esp_random();
+	current_snapshot = snapshot;
+	portEXIT_CRITICAL(&snapshot_mux);
+
+	//publishers stay serialized so an older render never replaces a newer one
 	xSemaphoreGive(query_lock);
+
+	if (!!old)
+		mdns_snapshot_unref(old);
+
+	return ESP_OK;
+err_publish:
+	xSemaphoreGive(query_lock);
+	if (!!snapshot) free(snapshot);
+	return ESP_FAIL;
+}
+
+const app_mdns_snapshot_t *app_mdns_snapshot_acquire(void) {
+	app_mdns_snapshot_t *snapshot;
+
+	portENTER_CRITICAL(&snapshot_mux);
+	snapshot = current_snapshot;
+	if (!!snapshot)
+		snapshot->refs++;
+	portEXIT_CRITICAL(&snapshot_mux);
+
+	return snapshot;
+}
+
+void app_mdns_snapshot_release(const app_mdns_snapshot_t *snapshot) {
+	if (!!snapshot)
+		mdns_snapshot_unref((app_mdns_snapshot_t *)snapshot);
 }
 
 esp_err_t app_mdns_update_framesize(const int size) {
+	//not started yet, app_mdns_main() reads the framesize itself
+	if (!query_lock)
+		return ESP_OK;
+
+	xSemaphoreTake(query_lock, portMAX_DELAY);
 	snprintf(framesize, 4, "%d", size);
+	xSemaphoreGive(query_lock);
+
 	APP_ERROR_CHECK_WITH_MSG(!mdns_service_txt_item_set(service_name, proto, "framesize", (char*)framesize), "mdns_service_txt_item_set() framesize Failed", err_mdns_update);
+	APP_ERROR_CHECK(mdns_publish() == ESP_OK, err_mdns_update);
 	return ESP_OK;
 err_mdns_update:
 	return ESP_FAIL;
@@ -122,12 +238,10 @@ static void mdns_task(void *pvParameters);
 esp_err_t app_mdns_main(void) {
 	uint8_t mac[6];
 
-	query_lock = xSemaphoreCreateBinary();
+	query_lock = xSemaphoreCreateMutex();
 
 	APP_ERROR_CHECK_WITH_MSG(query_lock != NULL, "xSemaphoreCreateMutex() Failed", err_app_mdns);
 
-	xSemaphoreGive(query_lock);
-
 	sensor_t * sensor = esp_camera_sensor_get();
 
 	APP_ERROR_CHECK_WITH_MSG(sensor != NULL, "Something wrong", err_app_mdns);
@@ -159,6 +273,10 @@ esp_err_t app_mdns_main(void) {
 
 	snprintf(framesize, 4, "%d", sensor->status.framesize);
 	snprintf(pixformat, 4, "%d", sensor->pixformat);
+	snprintf(stream_port, 6, "%d", CONFIG_CAM_STREAM_PORT);
+#if CONFIG_CAM_MCAST_ENABLE
+	snprintf(mcast_addr, sizeof(mcast_addr), "%s:%d", CONFIG_CAM_MCAST_GROUP, CONFIG_CAM_MCAST_PORT);
+#endif
 
 	char * src = iname, *dst = hname, c;
 	while (*src) {
@@ -173,19 +291,27 @@ esp_err_t app_mdns_main(void) {
 	APP_ERROR_CHECK_WITH_MSG(mdns_init() == ESP_OK, "mdns_init() Failed", err_app_mdns);
 	APP_ERROR_CHECK_WITH_MSG(mdns_hostname_set(hname) == ESP_OK, "mdns_hostname_set(hname) Failed", err_app_mdns);
 	APP_ERROR_CHECK_WITH_MSG(mdns_instance_name_set(iname) == ESP_OK, "mdns_instance_name_set(iname) Failed", err_app_mdns);
-	APP_ERROR_CHECK_WITH_MSG(mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0) == ESP_OK, "mdns_service_add() HTTP Failed", err_app_mdns);
+	APP_ERROR_CHECK_WITH_MSG(mdns_service_add(NULL, "_http", "_tcp", app_httpd_port(), NULL, 0) == ESP_OK, "mdns_service_add() HTTP Failed", err_app_mdns);
+#if CONFIG_CAM_RTSP_ENABLE
+	APP_ERROR_CHECK_WITH_MSG(mdns_service_add(NULL, "_rtsp", "_tcp", CONFIG_CAM_RTSP_PORT, NULL, 0) == ESP_OK, "mdns_service_add() RTSP Failed", err_app_mdns);
+#endif
 
 	mdns_txt_item_t camera_txt_data[] = {
 		{(char*)"board"         ,(char*)CAM_BOARD},
 		{(char*)"model"     	,(char*)model},
-		{(char*)"stream_port"   ,(char*)"81"},
+		{(char*)"stream_port"   ,(char*)stream_port},
 		{(char*)"framesize"   	,(char*)framesize},
-		{(char*)"pixformat"   	,(char*)pixformat}
+		{(char*)"pixformat"   	,(char*)pixformat},
+#if CONFIG_CAM_MCAST_ENABLE
+		{(char*)"mcast"   		,(char*)mcast_addr},
+#endif
 	};
 
-	APP_ERROR_CHECK_WITH_MSG(!mdns_service_add(NULL, service_name, proto, 80, camera_txt_data, 5), "mdns_service_add() ESP-CAM Failed", err_app_mdns);
+	APP_ERROR_CHECK_WITH_MSG(!mdns_service_add(NULL, service_name, proto, app_httpd_port(), camera_txt_data, sizeof(camera_txt_data) / sizeof(camera_txt_data[0])), "mdns_service_add() ESP-CAM Failed", err_app_mdns);
 
-	xTaskCreatePinnedToCore(mdns_task, "mdns-cam", configMINIMAL_STACK_SIZE * 3, NULL, 2, NULL, APP_CPU_NUM);
+	APP_ERROR_CHECK_WITH_MSG(mdns_publish() == ESP_OK, "mdns_publish() Failed", err_app_mdns);
+
+	xTaskCreatePinnedToCore(mdns_task, "mdns-cam", configMINIMAL_STACK_SIZE * 4, NULL, 2, NULL, APP_CPU_NUM);
 
 	ESP_LOGI(APP_MDNS_TAG, "mdns_hostname: %s, mdns_instance_name: %s", hname, iname);
 
@@ -194,18 +320,109 @@ err_app_mdns:
 	return ESP_FAIL;
 }
 
+static bool mdns_cam_set_str(char *dst, const char *src, size_t len) {
+	if (!src || !strncmp(dst, src, len - 1))
+		return false;
+
+	strlcpy(dst, src, len);
+	return true;
+}
+
+/*
+ * A short browse often brings only part of the PTR/SRV/TXT/A answers, the
+ * fields it carries overwrite the entry and the missing ones are kept.
+ */
+static bool mdns_cam_merge(mdns_result_t *result, int64_t now) {
+	mdns_cam_t *cam = cams;
+	bool changed = false;
+
+	if (!result->instance_name)
+		return false;
+
+	while (!!cam && strncmp(cam->instance, result->instance_name, sizeof(cam->instance) - 1))
+		cam = cam->next;
+
+	if (!cam) {
+		APP_ERROR_CHECK_WITH_MSG(!!(cam = calloc(1, sizeof(mdns_cam_t))), "No memory for mDNS camera", err_merge);
+		strlcpy(cam->instance, result->instance_name, sizeof(cam->instance));
+		cam->next = cams;
+		cams = cam;
+		changed = true;
+	}
+	cam->seen_us = now;
+
+	if (!!result->hostname) {
+		changed |= mdns_cam_set_str(cam->host, result->hostname, sizeof(cam->host));
+		changed |= cam->port != result->port;
+		cam->port = result->port;
+	}
+
+	for (mdns_ip_addr_t *addr = result->addr; !!addr; addr = addr->next) {
+		if (addr->addr.type != IPADDR_TYPE_V6) {
+			changed |= cam->ip != addr->addr.u_addr.ip4.addr;
+			cam->ip = addr->addr.u_addr.ip4.addr;
+			break;
+		}
+	}
+
+	if (!!result->txt_count) {
+		size_t count = MIN(result->txt_count, MDNS_TXT_MAX);
+		changed |= cam->txt_count != count;
+		cam->txt_count = count;
+		for (size_t i = 0; i < count; i++) {
+			changed |= mdns_cam_set_str(cam->txt[i].key, result->txt[i].key, sizeof(cam->txt[i].key));
+			changed |= mdns_cam_set_str(cam->txt[i].value, result->txt[i].value ? result->txt[i].value : "NULL", sizeof(cam->txt[i].value));
+		}
+	}
+
+	return changed;
+err_merge:
+	return false;
+}
+
+static bool mdns_cams_expire(int64_t now) {
+	mdns_cam_t **link = &cams;
+	bool changed = false;
+
+	while (!!*link) {
+		mdns_cam_t *cam = *link;
+		if (now - cam->seen_us > MDNS_CAM_TTL_US) {
+			ESP_LOGI(APP_MDNS_TAG, "Camera gone: %s", cam->instance);
+			*link = cam->next;
+			free(cam);
+			changed = true;
+		} else
+			link = &cam->next;
+	}
+
+	return changed;
+}
+
 static esp_err_t mdns_query_for_cams(void) {
-	mdns_result_t * new_cams = NULL;
+	mdns_result_t * results = NULL;
 	esp_err_t resp;
-	APP_ERROR_CHECK((resp = mdns_query_ptr(service_name, proto, 5000, 4,  &new_cams)) == ESP_OK, err_mdns_query);
+	bool changed = false;
 
-	xSemaphoreTake(query_lock, portMAX_DELAY);
-	if (!found_cams)
-		mdns_query_results_free(found_cams);
+	//no result cap, the timeout bounds the browse
+	APP_ERROR_CHECK((resp = mdns_query_ptr(service_name, proto, MDNS_QUERY_TIMEOUT_MS, 0, &results)) == ESP_OK, err_mdns_query);
+
+	int64_t now = esp_timer_get_time();
 
-	found_cams = new_cams;
+	xSemaphoreTake(query_lock, portMAX_DELAY);
+	for (mdns_result_t *result = results; !!result; result = result->next)
+		changed |= mdns_cam_merge(result, now);
+	changed |= mdns_cams_expire(now);
 	xSemaphoreGive(query_lock);
 
+	if (!!results)
+		mdns_query_results_free(results);
+
+	//the own entry carries the station IP, which changes on reconnect
+	if (changed || own_ip != mdns_own_ip()) {
+		ESP_LOGI(APP_MDNS_TAG, "Camera list changed");
+		APP_ERROR_CHECK((resp = mdns_publish()) == ESP_OK, err_mdns_query);
+	}
+
 	return ESP_OK;
 err_mdns_query:
 	return resp;
@@ -216,8 +433,7 @@ static void mdns_task(void *pvParameters) {
 	for (;;) {
 		if((resp = mdns_query_for_cams()) != ESP_OK)
 			ESP_LOGE(APP_MDNS_TAG, "MDNS Query Failed: %s", esp_err_to_name(resp));
-		//delay 55 seconds
-		vTaskDelay((55 * 1000) / portTICK_PERIOD_MS);
+		vTaskDelay(MDNS_QUERY_INTERVAL_MS / portTICK_PERIOD_MS);
 	}
 	vTaskDelete(NULL);
 }
@@ -0,0 +1,185 @@
+/*
+ * app_metrics.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "app_common.h"
+#include "app_metrics.h"
+
+//upper bounds in microseconds, the implicit last bucket is +Inf
+static const uint32_t bucket_bounds[] = {
+	1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000
+};
+
+#define BUCKETS (sizeof(bucket_bounds) / sizeof(bucket_bounds[0]) + 1)
+#define METRICS_LINE_LEN 160
+
+/*
+ * 64 bit total made of two 32 bit atomics, the ESP32 has no 64 bit
+ * ones. hi counts the 2^31 steps lo went through, so its lowest bit
+ * has to match the top bit of lo: when it does not, the writer that
+ * crossed the step has not bumped hi yet and the reader does it.
+ */
+typedef struct {
+	uint32_t lo;
+	uint32_t hi;
+} metrics_u64_t;
+
+typedef struct {
+	const char *name;
+	const char *help;
+	uint32_t buckets[BUCKETS];
+	//a wait observed back to back would wrap 32 bits in about an hour
+	metrics_u64_t sum_us;
+} metrics_histogram_t;
+
+typedef struct {
+	const char *name;
+	const char *help;
+	metrics_u64_t val;
+} metrics_counter_t;
+
+typedef struct {
+	const char *name;
+	const char *help;
+	int32_t val;
+} metrics_gauge_t;
+
+/*
+ * Writers only use atomic increments, the hot path never takes
+ * a lock. A scrape may see a histogram sum one observation ahead of
+ * its buckets, which Prometheus tolerates.
+ */
+static metrics_histogram_t histograms[APP_METRICS_HISTOGRAMS] = {
+	[APP_METRICS_CAPTURE_WAIT] = { .name = "cam_capture_wait_seconds", .help = "Time blocked in esp_camera_fb_get()" },
+	[APP_METRICS_JPEG_ENCODE] = { .name = "cam_jpeg_encode_seconds", .help = "Time converting a raw frame to JPEG" },
+	[APP_METRICS_FRAME_SEND] = { .name = "cam_frame_send_seconds", .help = "Time from queueing a frame to a stream client until it is fully written" },
+	[APP_METRICS_CONTROL_APPLY] = { .name = "cam_control_apply_seconds", .help = "Time parsing and applying one sensor control request" },
+	[APP_METRICS_FRAME_PROCESS] = { .name = "cam_frame_process_seconds", .help = "Time a frame spends in the process stage before it is published" },
+	[APP_METRICS_MOTION_ANALYSE] = { .name = "cam_motion_analyse_seconds", .help = "Time sampling one frame and comparing it against the motion background" },
+};
+
+static metrics_counter_t counters[APP_METRICS_COUNTERS] = {
+	[APP_METRICS_FRAMES_SERVED] = { .name = "cam_frames_served_total", .help = "Frames fully sent to clients" },
+	[APP_METRICS_FRAMES_DROPPED] = { .name = "cam_frames_dropped_total", .help = "Frames skipped by stream clients that fell behind" },
+	[APP_METRICS_BYTES_SENT] = { .name = "cam_bytes_sent_total", .help = "Image bytes written to clients" },
+	[APP_METRICS_SENSOR_WRITES] = { .name = "cam_sensor_writes_total", .help = "Sensor setters called by control requests" },
+	[APP_METRICS_FRAMES_CAPTURED] = { .name = "cam_frames_captured_total", .help = "Frames taken from the driver by the capture stage" },
+	[APP_METRICS_FRAMES_PROCESSED] = { .name = "cam_frames_processed_total", .help = "Frames passed through the process stage" },
+	[APP_METRICS_MOTION_EVENTS] = { .name = "cam_motion_events_total", .help = "Motion start and end events recorded" },
+	[APP_METRICS_FRAMES_SUPPRESSED] = { .name = "cam_frames_suppressed_total", .help = "Frames of a static scene not sent to static mode stream clients" },
+	[APP_METRICS_BYTES_SAVED] = { .name = "cam_bytes_saved_total", .help = "JPEG bytes not sent because the scene was static" },
+	[APP_METRICS_MCAST_FRAMES] = { .name = "cam_mcast_frames_total", .help = "Frames fully sent to the multicast group" },
+};
+
+static metrics_gauge_t gauges[APP_METRICS_GAUGES] = {
+	[APP_METRICS_STREAM_CLIENTS] = { .name = "cam_stream_clients", .help = "Active stream clients" },
+	[APP_METRICS_FB_IN_USE] = { .name = "cam_fb_in_use", .help = "Camera frame buffers held by the frame hub and its readers" },
+	[APP_METRICS_MOTION_SCORE] = { .name = "cam_motion_score", .help = "Percentage of motion grid blocks changed in the last analysed frame" },
+	[APP_METRICS_RTSP_SESSIONS] = { .name = "cam_rtsp_sessions", .help = "RTSP sessions playing" },
+};
+
+//steps are far below 2^31, so one add crosses at most one step of lo
+static void u64_add(metrics_u64_t *c, uint32_t val) {
+	uint32_t old = __atomic_fetch_add(&c->lo, val, __ATOMIC_RELEASE);
+	if ((old ^ (old + val)) >> 31)
+		__atomic_fetch_add(&c->hi, 1, __ATOMIC_RELEASE);
+}
+
+static uint64_t u64_load(metrics_u64_t *c) {
+	uint32_t hi = __atomic_load_n(&c->hi, __ATOMIC_ACQUIRE);
+	uint32_t lo = __atomic_load_n(&c->lo, __ATOMIC_ACQUIRE);
+
+	if ((hi & 1) != lo >> 31)
+		hi++;
+
+	return ((uint64_t)hi << 31) | (lo & 0x7fffffff);
+}
+
+void app_metrics_observe(app_metrics_histogram_t histogram, uint32_t us) {
+	metrics_histogram_t *h = &histograms[histogram];
+	size_t i = 0;
+
+	while (i < BUCKETS - 1 && us > bucket_bounds[i])
+		i++;
+
+	__atomic_fetch_add(&h->buckets[i], 1, __ATOMIC_RELAXED);
+	u64_add(&h->sum_us, us);
+}
+
+void app_metrics_add(app_metrics_counter_t counter, uint32_t val) {
+	u64_add(&counters[counter].val, val);
+}
+
+void app_metrics_set(app_metrics_gauge_t gauge, int32_t val) {
+	__atomic_store_n(&gauges[gauge].val, val, __ATOMIC_RELAXED);
+}
+
+static esp_err_t render_header(app_metrics_writer_t writer, void *arg, char *line, const char *name, const char *help, const char *type) {
+	int len = snprintf(line, METRICS_LINE_LEN, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	return writer(arg, line, MIN(len, METRICS_LINE_LEN - 1));
+}
+
+static esp_err_t render_histogram(app_metrics_writer_t writer, void *arg, char *line, metrics_histogram_t *h) {
+	uint32_t cumulative = 0;
+	int len;
+
+	APP_ERROR_CHECK(render_header(writer, arg, line, h->name, h->help, "histogram") == ESP_OK, err_render);
+
+	for (size_t i = 0; i < BUCKETS; i++) {
+		cumulative += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+		if (i < BUCKETS - 1)
+			len = snprintf(line, METRICS_LINE_LEN, "%s_bucket{le=\"%u.%06u\"} %u\n", h->name, bucket_bounds[i] / 1000000, bucket_bounds[i] % 1000000, cumulative);
+		else
+			len = snprintf(line, METRICS_LINE_LEN, "%s_bucket{le=\"+Inf\"} %u\n", h->name, cumulative);
+		APP_ERROR_CHECK(writer(arg, line, len) == ESP_OK, err_render);
+	}
+
+	uint64_t sum_us = u64_load(&h->sum_us);
+	len = snprintf(line, METRICS_LINE_LEN, "%s_sum %u.%06u\n%s_count %u\n", h->name, (uint32_t)(sum_us / 1000000), (uint32_t)(sum_us % 1000000), h->name, cumulative);
+	APP_ERROR_CHECK(writer(arg, line, len) == ESP_OK, err_render);
+
+	return ESP_OK;
+err_render:
+	return ESP_FAIL;
+}
+
+static esp_err_t render_value(app_metrics_writer_t writer, void *arg, char *line, const char *name, const char *help, const char *type, long long val) {
+	APP_ERROR_CHECK(render_header(writer, arg, line, name, help, type) == ESP_OK, err_render);
+
+	int len = snprintf(line, METRICS_LINE_LEN, "%s %lld\n", name, val);
+	APP_ERROR_CHECK(writer(arg, line, len) == ESP_OK, err_render);
+
+	return ESP_OK;
+err_render:
+	return ESP_FAIL;
+}
+
+esp_err_t app_metrics_render(app_metrics_writer_t writer, void *arg) {
+	char line[METRICS_LINE_LEN];
+
+	for (int i = 0; i < APP_METRICS_HISTOGRAMS; i++)
+		APP_ERROR_CHECK(render_histogram(writer, arg, line, &histograms[i]) == ESP_OK, err_render);
+
+	for (int i = 0; i < APP_METRICS_COUNTERS; i++)
+		APP_ERROR_CHECK(render_value(writer, arg, line, counters[i].name, counters[i].help, "counter", u64_load(&counters[i].val)) == ESP_OK, err_render);
+
+	for (int i = 0; i < APP_METRICS_GAUGES; i++)
+		APP_ERROR_CHECK(render_value(writer, arg, line, gauges[i].name, gauges[i].help, "gauge", __atomic_load_n(&gauges[i].val, __ATOMIC_RELAXED)) == ESP_OK, err_render);
+
+	APP_ERROR_CHECK(render_value(writer, arg, line, "cam_heap_free_bytes", "Free 8-bit capable heap", "gauge", heap_caps_get_free_size(MALLOC_CAP_8BIT)) == ESP_OK, err_render);
+	APP_ERROR_CHECK(render_value(writer, arg, line, "cam_heap_largest_free_block_bytes", "Largest free 8-bit capable heap block", "gauge", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)) == ESP_OK, err_render);
+
+	return ESP_OK;
+err_render:
+	return ESP_FAIL;
+}
@@ -0,0 +1,498 @@
+/*
+ * app_motion.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_camera.h"
+#include "esp_jpg_decode.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "app_common.h"
+#include "app_encode.h"
+#include "app_frame.h"
+#include "app_metrics.h"
+#include "app_motion.h"
+
+#define MOTION_BLOCKS (APP_MOTION_GRID_W * APP_MOTION_GRID_H)
+//raw frames are sampled on the grid a 1/8 scaled JPEG decode would give
+#define MOTION_SAMPLE_STEP 8
+//nearly every block changing at once is exposure or lighting, not motion
+#define MOTION_GLOBAL_CHANGE_PERCENT 80
+//background adaption as a power of two, changed blocks follow slowly so a moving object is not absorbed
+#define MOTION_LEARN_SHIFT 3
+#define MOTION_LEARN_CHANGED_SHIFT 6
+#define MOTION_STATS_PERIOD_US (10 * 1000000)
+
+#if CONFIG_CAM_MOTION_ENABLE
+#define MOTION_ENABLED_AT_BOOT true
+#else
+#define MOTION_ENABLED_AT_BOOT false
+#endif
+
+typedef struct {
+	uint32_t sums[MOTION_BLOCKS];
+	uint16_t counts[MOTION_BLOCKS];
+	uint16_t width;
+	uint16_t height;
+} motion_grid_t;
+
+typedef struct {
+	app_motion_cb_t cb;
+	void *arg;
+} motion_listener_t;
+
+static portMUX_TYPE motion_mux = portMUX_INITIALIZER_UNLOCKED;
+static app_motion_config_t motion_config = {
+	.enabled = MOTION_ENABLED_AT_BOOT,
+	.threshold = CONFIG_CAM_MOTION_THRESHOLD,
+	.trigger = CONFIG_CAM_MOTION_TRIGGER,
+	.hold_ms = CONFIG_CAM_MOTION_HOLD_MS
+};
+static app_motion_status_t motion_status;
+static app_motion_event_t events[APP_MOTION_EVENTS];
+static uint32_t last_event_id = 0;
+static motion_listener_t listeners[APP_MOTION_MAX_LISTENERS];
+static int listeners_count = 0;
+//users of the grid status while motion detection is off
+static int analyse_holds = 0;
+
+//owned by the motion task
+static motion_grid_t grid;
+static int32_t background[MOTION_BLOCKS]; //luma in 8.8 fixed point
+static bool background_valid = false;
+static bool in_event = false;
+static int64_t last_motion_us = 0;
+static app_motion_event_t event_summary;
+
+static TaskHandle_t motion_task_handle = NULL;
+
+static void motion_task(void *pvParameters);
+
+static void motion_frame_ready(void *arg) {
+	xTaskNotifyGive(motion_task_handle);
+}
+
+esp_err_t init_motion(void) {
+	memset(&motion_status, 0, sizeof(motion_status));
+	memset(events, 0, sizeof(events));
+	memset(listeners, 0, sizeof(listeners));
+
+	//a lower priority than the process task, publishing a frame never waits for its analysis
+	APP_ERROR_CHECK_WITH_MSG(xTaskCreatePinnedToCore(motion_task, "motion", configMINIMAL_STACK_SIZE * 4, NULL, 4, &motion_task_handle, APP_FRAME_PROCESS_CORE) == pdPASS, "xTaskCreatePinnedToCore() motion task Failed", err_init);
+
+	if (motion_config.enabled)
+		APP_ERROR_CHECK(app_frame_subscribe(motion_frame_ready, NULL) == ESP_OK, err_init);
+
+	return ESP_OK;
+err_init:
+	return ESP_FAIL;
+}
+
+void app_motion_get_config(app_motion_config_t *config) {
+	portENTER_CRITICAL(&motion_mux);
+	*config = motion_config;
+	portEXIT_CRITICAL(&motion_mux);
+}
+
+esp_err_t app_motion_set_config(const app_motion_config_t *config) {
+	bool was_enabled;
+	int holds;
+
+	if (!config->threshold || !config->trigger || config->trigger > 100)
+		return ESP_ERR_INVALID_ARG;
+
+	portENTER_CRITICAL(&motion_mux);
+	was_enabled = motion_config.enabled;
+	holds = analyse_holds;
+	motion_config = *config;
+	portEXIT_CRITICAL(&motion_mux);
+
+	//analysis keeps the camera capturing, so it only listens while enabled or held
+	if (config->enabled && !was_enabled && !holds && app_frame_subscribe(motion_frame_ready, NULL) != ESP_OK) {
+		portENTER_CRITICAL(&motion_mux);
+		motion_config.enabled = false;
+		portEXIT_CRITICAL(&motion_mux);
+		return ESP_FAIL;
+	}
+
+	if (!config->enabled && was_enabled) {
+		if (!holds)
+			app_frame_unsubscribe(motion_frame_ready, NULL);
+		//lets the task close a running event
+		xTaskNotifyGive(motion_task_handle);
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t app_motion_hold(void) {
+	bool listening;
+
+	portENTER_CRITICAL(&motion_mux);
+	listening = motion_config.enabled || !!analyse_holds;
+	analyse_holds++;
+	portEXIT_CRITICAL(&motion_mux);
+
+	if (!listening && app_frame_subscribe(motion_frame_ready, NULL) != ESP_OK) {
+		portENTER_CRITICAL(&motion_mux);
+		analyse_holds--;
+		portEXIT_CRITICAL(&motion_mux);
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
+void app_motion_release(void) {
+	bool listening;
+
+	portENTER_CRITICAL(&motion_mux);
+	analyse_holds--;
+	listening = motion_config.enabled || !!analyse_holds;
+	portEXIT_CRITICAL(&motion_mux);
+
+	if (!listening)
+		app_frame_unsubscribe(motion_frame_ready, NULL);
+}
+
+void app_motion_get_status(app_motion_status_t *status) {
+	portENTER_CRITICAL(&motion_mux);
+	*status = motion_status;
+	portEXIT_CRITICAL(&motion_mux);
+}
+
+int app_motion_get_events(uint32_t since_id, app_motion_event_t *out, int max) {
+	int count = 0;
+
+	portENTER_CRITICAL(&motion_mux);
+	uint32_t first = last_event_id > APP_MOTION_EVENTS ? last_event_id - APP_MOTION_EVENTS + 1 : 1;
+	if (since_id >= first)
+		first = since_id + 1;
+	for (uint32_t id = first; id <= last_event_id && count < max; id++)
+		out[count++] = events[id % APP_MOTION_EVENTS];
+	portEXIT_CRITICAL(&motion_mux);
+
+	return count;
+}
+
+uint32_t app_motion_last_event_id(void) {
+	uint32_t id;
+
+	portENTER_CRITICAL(&motion_mux);
+	id = last_event_id;
+	portEXIT_CRITICAL(&motion_mux);
+
+	return id;
+}
+
+esp_err_t app_motion_subscribe(app_motion_cb_t cb, void *arg) {
+	bool added = false;
+
+	portENTER_CRITICAL(&motion_mux);
+	if (listeners_count < APP_MOTION_MAX_LISTENERS) {
+		listeners[listeners_count].cb = cb;
+		listeners[listeners_count].arg = arg;
+		listeners_count++;
+		added = true;
+	}
+	portEXIT_CRITICAL(&motion_mux);
+
+	APP_ERROR_CHECK_WITH_MSG(added, "Too many motion listeners", err_subscribe);
+
+	return ESP_OK;
+err_subscribe:
+	return ESP_FAIL;
+}
+
+void app_motion_unsubscribe(app_motion_cb_t cb, void *arg) {
+	portENTER_CRITICAL(&motion_mux);
+	for (int i = 0; i < listeners_count; i++) {
+		if (listeners[i].cb == cb && listeners[i].arg == arg) {
+			listeners[i] = listeners[--listeners_count];
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&motion_mux);
+}
+
+void app_motion_event_json(app_json_t *json, const char *key, const app_motion_event_t *event) {
+	app_json_object_start(json, key);
+	app_json_int(json, "id", event->id);
+	app_json_string(json, "type", event->type == APP_MOTION_START ? "start" : "end");
+	app_json_int(json, "seq", event->seq);
+	app_json_int(json, "uptime_ms", event->uptime_ms);
+	app_json_int(json, "score", event->score);
+	app_json_array_start(json, "box");
+	app_json_int(json, NULL, event->box.x0);
+	app_json_int(json, NULL, event->box.y0);
+	app_json_int(json, NULL, event->box.x1);
+	app_json_int(json, NULL, event->box.y1);
+	app_json_array_end(json);
+	app_json_object_end(json);
+}
+
+static void grid_reset(uint16_t width, uint16_t height) {
+	memset(grid.sums, 0, sizeof(grid.sums));
+	memset(grid.counts, 0, sizeof(grid.counts));
+	grid.width = width;
+	grid.height = height;
+}
+
+static inline void grid_add(uint16_t x, uint16_t y, uint8_t luma) {
+	int block = (y * APP_MOTION_GRID_H / grid.height) * APP_MOTION_GRID_W + x * APP_MOTION_GRID_W / grid.width;
+
+	grid.sums[block] += luma;
+	grid.counts[block]++;
+}
+
+static size_t motion_jpg_read(void *arg, size_t index, uint8_t *buf, size_t len) {
+	camera_fb_t *fb = (camera_fb_t *)arg;
+
+	if (index + len > fb->len)
+		len = fb->len - index;
+	if (!!buf)
+		memcpy(buf, fb->buf + index, len);
+
+	return len;
+}
+
+static bool motion_jpg_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+	if (!data) {
+		//start of the decode reports the scaled output size
+		if (!x && !y)
+			grid_reset(w, h);
+		return true;
+	}
+
+	for (uint16_t iy = 0; iy < h; iy++) {
+		for (uint16_t ix = 0; ix < w; ix++, data += 3)
+			grid_add(x + ix, y + iy, (77 * data[0] + 150 * data[1] + 29 * data[2]) >> 8);
+	}
+
+	return true;
+}
+
+/*
+ * Fills the grid with the mean luma of every block. A JPEG is decoded
+ * at 1/8 scale, which only needs the DC coefficient of each 8x8 block.
+ */
+static esp_err_t motion_sample(camera_fb_t *fb) {
+	const uint8_t *buf = fb->buf;
+
+	switch (fb->format) {
+	case PIXFORMAT_JPEG:
+		return app_encode_decode(fb->len, JPG_SCALE_8X, motion_jpg_read, motion_jpg_write, fb);
+	case PIXFORMAT_GRAYSCALE:
+	case PIXFORMAT_YUV422:
+	case PIXFORMAT_RGB565:
+		break;
+	default:
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+
+	grid_reset(fb->width, fb->height);
+	for (uint16_t y = 0; y < fb->height; y += MOTION_SAMPLE_STEP) {
+		for (uint16_t x = 0; x < fb->width; x += MOTION_SAMPLE_STEP) {
+			size_t i = y * fb->width + x;
+			uint8_t luma;
+
+			if (fb->format == PIXFORMAT_GRAYSCALE) {
+				luma = buf[i];
+			} else if (fb->format == PIXFORMAT_YUV422) {
+				//YUYV, every even byte is a Y sample
+				luma = buf[i * 2];
+			} else {
+				uint16_t px = (buf[i * 2] << 8) | buf[i * 2 + 1];
+				luma = (77 * ((px >> 8) & 0xf8) + 150 * ((px >> 3) & 0xfc) + 29 * ((px << 3) & 0xf8)) >> 8;
+			}
+			grid_add(x, y, luma);
+		}
+	}
+
+	return ESP_OK;
+}
+
+static void box_add(app_motion_box_t *box, const app_motion_box_t *other) {
+	box->x0 = MIN(box->x0, other->x0);
+	box->y0 = MIN(box->y0, other->y0);
+	box->x1 = MAX(box->x1, other->x1);
+	box->y1 = MAX(box->y1, other->y1);
+}
+
+static void motion_record(app_motion_event_t *event) {
+	motion_listener_t current[APP_MOTION_MAX_LISTENERS];
+	int count;
+
+	portENTER_CRITICAL(&motion_mux);
+	event->id = ++last_event_id;
+	events[event->id % APP_MOTION_EVENTS] = *event;
+	count = listeners_count;
+	memcpy(current, listeners, sizeof(current));
+	portEXIT_CRITICAL(&motion_mux);
+
+	ESP_LOGI(APP_MOTION_TAG, "Motion %s, frame %u, score %u%%, blocks %u,%u-%u,%u", event->type == APP_MOTION_START ? "start" : "end",
+			event->seq, event->score, event->box.x0, event->box.y0, event->box.x1, event->box.y1);
+	app_metrics_add(APP_METRICS_MOTION_EVENTS, 1);
+
+	for (int i = 0; i < count; i++)
+		current[i].cb(current[i].arg);
+}
+
+static void motion_end_event(uint32_t seq) {
+	event_summary.type = APP_MOTION_END;
+	event_summary.seq = seq;
+	event_summary.uptime_ms = esp_timer_get_time() / 1000;
+	motion_record(&event_summary);
+	in_event = false;
+}
+
+/*
+ * Compares the grid against the background, block by block, and turns
+ * the fraction of changed blocks into events. An event starts on the
+ * first frame at or above the trigger and ends once no frame reached
+ * it for hold_ms.
+ */
+static void motion_analyse(const app_motion_config_t *config, uint32_t seq) {
+	app_motion_status_t status = { 0 };
+	app_motion_box_t box = { APP_MOTION_GRID_W, APP_MOTION_GRID_H, 0, 0 };
+	bool changed[MOTION_BLOCKS];
+	int64_t now = esp_timer_get_time();
+
+	for (int i = 0; i < MOTION_BLOCKS; i++) {
+		int32_t luma = !!grid.counts[i] ? (int32_t)(grid.sums[i] / grid.counts[i]) : background[i] >> 8;
+
+		changed[i] = background_valid && abs(luma - (background[i] >> 8)) > config->threshold;
+		if (changed[i]) {
+			uint8_t x = i % APP_MOTION_GRID_W, y = i / APP_MOTION_GRID_W;
+			status.rows[y] |= 1U << x;
+			status.changed++;
+			box.x0 = MIN(box.x0, x);
+			box.y0 = MIN(box.y0, y);
+			box.x1 = MAX(box.x1, x);
+			box.y1 = MAX(box.y1, y);
+		}
+
+		if (!background_valid)
+			background[i] = luma << 8;
+		else
+			background[i] += ((luma << 8) - background[i]) >> (changed[i] ? MOTION_LEARN_CHANGED_SHIFT : MOTION_LEARN_SHIFT);
+	}
+	background_valid = true;
+
+	status.score = status.changed * 100 / MOTION_BLOCKS;
+	if (status.score >= MOTION_GLOBAL_CHANGE_PERCENT) {
+		ESP_LOGD(APP_MOTION_TAG, "Global change of %u%%, background reset", status.score);
+		background_valid = false;
+		status.score = status.changed = 0;
+		memset(status.rows, 0, sizeof(status.rows));
+	}
+
+	if (!config->enabled) {
+		//only held for the grid status, no events
+		if (in_event)
+			motion_end_event(seq);
+	} else if (status.score >= config->trigger) {
+		last_motion_us = now;
+		if (!in_event) {
+			memset(&event_summary, 0, sizeof(event_summary));
+			event_summary.type = APP_MOTION_START;
+			event_summary.seq = seq;
+			event_summary.uptime_ms = now / 1000;
+			event_summary.score = status.score;
+			event_summary.box = box;
+			motion_record(&event_summary);
+			in_event = true;
+		} else {
+			event_summary.score = MAX(event_summary.score, status.score);
+			box_add(&event_summary.box, &box);
+		}
+	} else if (in_event && now - last_motion_us >= (int64_t)config->hold_ms * 1000) {
+		motion_end_event(seq);
+	}
+
+	status.active = in_event;
+	status.box = !!status.changed ? box : (app_motion_box_t){ 0 };
+
+	portENTER_CRITICAL(&motion_mux);
+	status.frames = motion_status.frames + 1;
+	status.skipped = motion_status.skipped;
+	status.analyse_us = motion_status.analyse_us;
+	status.seq = seq;
+	status.uptime_ms = now / 1000;
+	motion_status = status;
+	portEXIT_CRITICAL(&motion_mux);
+
+	app_metrics_set(APP_METRICS_MOTION_SCORE, status.score);
+}
+
+static void motion_task(void *pvParameters) {
+	app_motion_config_t config;
+	app_frame_t *frame;
+	uint32_t last_seq = 0;
+	uint32_t frames = 0, last_frames = 0;
+	int64_t stats_start = esp_timer_get_time();
+
+	for (;;) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		portENTER_CRITICAL(&motion_mux);
+		config = motion_config;
+		int holds = analyse_holds;
+		portEXIT_CRITICAL(&motion_mux);
+		if (!config.enabled && !holds) {
+			if (in_event)
+				motion_end_event(last_seq);
+			background_valid = false;
+			continue;
+		}
+
+		//always the newest frame, the ones published during an analysis are skipped
+		if (!(frame = app_frame_acquire()))
+			continue;
+		if (frame->seq == last_seq) {
+			app_frame_release(frame);
+			continue;
+		}
+
+		int64_t start = esp_timer_get_time();
+		esp_err_t err = motion_sample(frame->fb);
+		uint32_t seq = frame->seq;
+		app_frame_release(frame);
+
+		if (err != ESP_OK) {
+			ESP_LOGW(APP_MOTION_TAG, "Frame %u could not be sampled", seq);
+			last_seq = seq;
+			continue;
+		}
+
+		motion_analyse(&config, seq);
+		int64_t end = esp_timer_get_time();
+
+		portENTER_CRITICAL(&motion_mux);
+		if (!!last_seq && seq - last_seq > 1)
+			motion_status.skipped += seq - last_seq - 1;
+		motion_status.analyse_us = end - start;
+		portEXIT_CRITICAL(&motion_mux);
+
+		app_metrics_observe(APP_METRICS_MOTION_ANALYSE, end - start);
+		last_seq = seq;
+		frames++;
+
+		if (end - stats_start >= MOTION_STATS_PERIOD_US) {
+			ESP_LOGI(APP_MOTION_TAG, "Motion: %u frames analysed, %uus last, score %u%%", frames - last_frames, (uint32_t)(end - start), motion_status.score);
+			last_frames = frames;
+			stats_start = end;
+		}
+	}
+	vTaskDelete(NULL);
+}
@@ -0,0 +1,1168 @@
+/*
+ * app_rtsp.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_camera.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+
+#include "app_common.h"
+#include "app_encode.h"
+#include "app_frame.h"
+#include "app_metrics.h"
+#include "app_rtsp.h"
+#include "app_stream.h"
+
+#define RTSP_TRACK "track0"
+static const char *_RTSP_BUSY = "RTSP/1.0 503 Service Unavailable\r\n\r\n";
+static const char *_RTSP_PUBLIC = "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n";
+//one JPEG video track, its URL is the content base followed by RTSP_TRACK
+static const char *_RTSP_SDP = "v=0\r\n"
+	"o=- %u 1 IN IP4 %s\r\n"
+	"s=sisbarc-webcam\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"t=0 0\r\n"
+	"a=control:*\r\n"
+	"m=video 0 RTP/AVP 26\r\n"
+	"a=control:" RTSP_TRACK "\r\n";
+
+#define RTSP_URI "/cam/stream"
+#define RTSP_REQ_BUF_LEN 512
+#define RTSP_RESP_BUF_LEN 768
+#define RTSP_URL_LEN 128
+//a session not heard from, by request or receiver report, is closed after this long
+#define RTSP_TIMEOUT_S 60
+#define RTSP_STATS_PERIOD_US (10 * 1000000)
+#define RTSP_SR_PERIOD_US (5 * 1000000)
+//a frame the hub already replaced is copied out of the driver buffer after this long
+#define RTSP_SPILL_AFTER_US (100 * 1000)
+//a datagram the network interface had no room for is retried this soon
+#define RTSP_RETRY_US (5 * 1000)
+
+//RTP packet without the interleaved prefix, fits a single Ethernet frame
+#define RTP_PACKET_LEN 1400
+#define RTP_HEADER_LEN 12
+#define RTP_PT_JPEG 26
+#define RTP_CLOCK_HZ 90000
+#define RTP_INTERLEAVED_LEN 4
+#define RTP_JPEG_HEADER_LEN 8
+#define RTP_RESTART_HEADER_LEN 4
+#define RTP_QUANT_HEADER_LEN 4
+//luma and chroma tables, 8 bit precision
+#define RTP_QTABLES_LEN 128
+#define RTCP_PT_SR 200
+#define RTCP_SR_LEN 28
+//seconds from the NTP epoch, 1900, to the Unix one
+#define NTP_UNIX_OFFSET 2208988800UL
+
+typedef enum {
+	SESSION_FREE = 0,
+	SESSION_INIT,
+	SESSION_READY,
+	SESSION_PLAYING,
+	SESSION_CLOSING
+} session_state_t;
+
+/* What RFC 2435 carries of a baseline JPEG, the scan goes out as is. */
+typedef struct {
+	const uint8_t *scan;
+	size_t scan_len;
+	uint8_t type;
+	uint8_t width; //in 8 pixel blocks
+	uint8_t height;
+	uint16_t restart_interval;
+	uint8_t qtables[RTP_QTABLES_LEN];
+} rtp_jpeg_t;
+
+typedef struct {
+	int fd;
+	session_state_t state;
+	struct sockaddr_in addr;
+	int64_t connected_us;
+	int64_t active_us;
+	size_t req_len;
+	size_t skip; //request body or interleaved packet from the client, discarded
+	char req_buf[RTSP_REQ_BUF_LEN];
+	size_t resp_len;
+	size_t resp_sent;
+	char resp_buf[RTSP_RESP_BUF_LEN];
+	//transport set up by SETUP
+	uint32_t id;
+	bool interleaved;
+	uint8_t rtp_channel;
+	uint8_t rtcp_channel;
+	struct sockaddr_in rtp_addr;
+	struct sockaddr_in rtcp_addr;
+	uint32_t ssrc;
+	uint16_t rtp_seq;
+	uint32_t ts_offset;
+	//frame being packetized
+	app_frame_t *frame;
+	const app_encoded_t *encoded; //shared JPEG of a raw frame
+	uint8_t *scan_buf; //spilled scan owned by the session
+	rtp_jpeg_t jpeg;
+	size_t offset;
+	uint32_t timestamp;
+	uint32_t last_seq;
+	bool warned; //about a frame RTP/JPEG can not carry
+	int64_t frame_published_us;
+	int64_t frame_queued_us;
+	//packet being sent, headers behind room for the interleaved prefix
+	uint8_t header[RTP_INTERLEAVED_LEN + RTP_HEADER_LEN + RTP_JPEG_HEADER_LEN + RTP_RESTART_HEADER_LEN + RTP_QUANT_HEADER_LEN + RTP_QTABLES_LEN];
+	struct iovec iov[2];
+	int iov_count;
+	int iov_index;
+	bool packet_rtcp;
+	size_t packet_len;
+	//sender report figures
+	int64_t last_sr_us;
+	uint32_t packets_sent;
+	uint32_t octets_sent;
+	//per session figures, read by app_rtsp_get_clients()
+	int64_t last_done_us;
+	uint32_t avg_interval_us;
+	uint32_t avg_latency_us;
+	uint32_t frames_sent;
+	uint32_t frames_dropped;
+	uint32_t frames_spilled;
+	uint64_t bytes_sent;
+} rtsp_session_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t packets;
+	uint64_t bytes;
+} rtsp_stats_t;
+
+static portMUX_TYPE rtsp_mux = portMUX_INITIALIZER_UNLOCKED;
+static rtsp_session_t sessions[CONFIG_CAM_RTSP_MAX_CLIENTS];
+static int playing_count = 0;
+static rtsp_stats_t stats;
+
+static int listen_fd = -1;
+static int rtp_fd = -1;
+static int rtcp_fd = -1;
+//the capture task wakes the server up with a loopback datagram to the RTP port
+static int notify_fd = -1;
+static struct sockaddr_in wake_addr;
+
+static void rtsp_task(void *pvParameters);
+
+static int set_non_blocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int udp_bind(uint16_t port) {
+	struct sockaddr_in addr;
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || set_non_blocking(fd)) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+esp_err_t init_rtsp_server(uint16_t port) {
+	struct sockaddr_in addr;
+	int enable = 1;
+
+	memset(sessions, 0, sizeof(sessions));
+	for (int i = 0; i < CONFIG_CAM_RTSP_MAX_CLIENTS; i++)
+		sessions[i].fd = -1;
+
+	APP_ERROR_CHECK_WITH_MSG((rtp_fd = udp_bind(CONFIG_CAM_RTSP_RTP_PORT)) >= 0, "RTP socket Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG((rtcp_fd = udp_bind(CONFIG_CAM_RTSP_RTP_PORT + 1)) >= 0, "RTCP socket Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG((notify_fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0, "socket() notify Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(!set_non_blocking(notify_fd), "fcntl() notify Failed", err_init);
+
+	memset(&wake_addr, 0, sizeof(wake_addr));
+	wake_addr.sin_family = AF_INET;
+	wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	wake_addr.sin_port = htons(CONFIG_CAM_RTSP_RTP_PORT);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	APP_ERROR_CHECK_WITH_MSG((listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) >= 0, "socket() listen Failed", err_init);
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	APP_ERROR_CHECK_WITH_MSG(!bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)), "bind() listen Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(!listen(listen_fd, CONFIG_CAM_RTSP_MAX_CLIENTS), "listen() Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(!set_non_blocking(listen_fd), "fcntl() listen Failed", err_init);
+
+	APP_ERROR_CHECK_WITH_MSG(xTaskCreatePinnedToCore(rtsp_task, "rtsp-server", 4096, NULL, 5, NULL, APP_FRAME_CAPTURE_CORE) == pdPASS, "xTaskCreatePinnedToCore() RTSP server Failed", err_init);
+
+	ESP_LOGI(APP_RTSP_TAG, "RTSP server listening on port %d, RTP from port %d", port, CONFIG_CAM_RTSP_RTP_PORT);
+
+	return ESP_OK;
+err_init:
+	if (listen_fd >= 0) close(listen_fd);
+	if (rtp_fd >= 0) close(rtp_fd);
+	if (rtcp_fd >= 0) close(rtcp_fd);
+	if (notify_fd >= 0) close(notify_fd);
+	listen_fd = rtp_fd = rtcp_fd = notify_fd = -1;
+	return ESP_FAIL;
+}
+
+static void rtsp_frame_ready(void *arg) {
+	const uint8_t wake = 0;
+	sendto(notify_fd, &wake, sizeof(wake), MSG_DONTWAIT, (struct sockaddr *)&wake_addr, sizeof(wake_addr));
+}
+
+static uint16_t get_u16_be(const uint8_t *buf) {
+	return (buf[0] << 8) | buf[1];
+}
+
+static uint8_t *put_u16_be(uint8_t *buf, uint16_t val) {
+	*buf++ = val >> 8;
+	*buf++ = val;
+	return buf;
+}
+
+static uint8_t *put_u32_be(uint8_t *buf, uint32_t val) {
+	*buf++ = val >> 24;
+	*buf++ = val >> 16;
+	*buf++ = val >> 8;
+	*buf++ = val;
+	return buf;
+}
+
+/*
+ * Walks the marker segments up to the scan. Only what RFC 2435 can
+ * describe is accepted: baseline, 8 bit tables, luma on table 0 and
+ * chroma on table 1, YUV 4:2:2 (type 0) or 4:2:0 (type 1). The
+ * receiver rebuilds the standard Huffman tables on its own.
+ */
+static bool rtp_jpeg_parse(const uint8_t *jpg, size_t len, rtp_jpeg_t *jpeg) {
+	uint8_t tables = 0;
+	bool frame = false;
+	size_t pos = 2;
+
+	if (len < 4 || jpg[0] != 0xff || jpg[1] != 0xd8)
+		return false;
+
+	jpeg->restart_interval = 0;
+
+	while (pos + 4 <= len) {
+		if (jpg[pos] != 0xff)
+			return false;
+
+		uint8_t marker = jpg[pos + 1];
+		if (marker == 0xff) {
+			pos++;
+			continue;
+		}
+
+		const uint8_t *seg = jpg + pos + 4;
+		size_t seg_len = get_u16_be(jpg + pos + 2);
+		if (seg_len < 2 || pos + 2 + seg_len > len)
+			return false;
+		seg_len -= 2;
+
+		switch (marker) {
+		case 0xdb: //DQT, one or more tables
+			for (size_t i = 0; i + 65 <= seg_len; i += 65) {
+				uint8_t id = seg[i] & 0x0f;
+				if ((seg[i] >> 4) || id > 1)
+					return false;
+				memcpy(jpeg->qtables + id * 64, seg + i + 1, 64);
+				tables |= 1 << id;
+			}
+			break;
+		case 0xc0: //SOF0
+			if (seg_len < 15 || seg[5] != 3 || seg[8] || seg[10] != 0x11 || seg[11] != 1 || seg[13] != 0x11 || seg[14] != 1)
+				return false;
+			if (seg[7] == 0x21)
+				jpeg->type = 0;
+			else if (seg[7] == 0x22)
+				jpeg->type = 1;
+			else
+				return false;
+
+			uint16_t height = get_u16_be(seg + 1), width = get_u16_be(seg + 3);
+			if (!width || !height || width > 2040 || height > 2040)
+				return false;
+			jpeg->width = (width + 7) / 8;
+			jpeg->height = (height + 7) / 8;
+			frame = true;
+			break;
+		case 0xc1: case 0xc2: case 0xc3: case 0xc5: case 0xc6: case 0xc7:
+		case 0xc9: case 0xca: case 0xcb: case 0xcd: case 0xce: case 0xcf:
+			return false;
+		case 0xdd: //DRI
+			if (seg_len < 2)
+				return false;
+			jpeg->restart_interval = get_u16_be(seg);
+			break;
+		case 0xda: //SOS, the scan follows its header
+			if (!frame || tables != 0x03)
+				return false;
+
+			jpeg->scan = seg + seg_len;
+			jpeg->scan_len = len - (jpeg->scan - jpg);
+			//the receiver appends its own EOI, the driver may pad after it
+			for (size_t end = jpeg->scan_len; end >= 2 && jpeg->scan_len - end < 32; end--) {
+				if (jpeg->scan[end - 2] == 0xff && jpeg->scan[end - 1] == 0xd9) {
+					jpeg->scan_len = end - 2;
+					break;
+				}
+			}
+			if (!!jpeg->restart_interval)
+				jpeg->type += 64;
+
+			return jpeg->scan_len > 0;
+		default:
+			break;
+		}
+
+		pos += 4 + seg_len;
+	}
+
+	return false;
+}
+
+/* Same clock as fb->timestamp, from an offset picked per session. */
+static uint32_t rtp_timestamp(const rtsp_session_t *session, int64_t us) {
+	return session->ts_offset + (uint32_t)(us * RTP_CLOCK_HZ / 1000000);
+}
+
+static void session_frame_done(rtsp_session_t *session) {
+	if (!!session->scan_buf) {
+		free(session->scan_buf);
+		session->scan_buf = NULL;
+	}
+	app_encode_release(session->encoded);
+	session->encoded = NULL;
+	app_frame_release(session->frame);
+	session->frame = NULL;
+	session->jpeg.scan = NULL;
+	session->offset = 0;
+}
+
+static bool session_has_pending(rtsp_session_t *session) {
+	return session->iov_index < session->iov_count;
+}
+
+static uint32_t session_pending_bytes(rtsp_session_t *session) {
+	uint32_t len = session->resp_len - session->resp_sent;
+
+	for (int i = session->iov_index; i < session->iov_count; i++)
+		len += session->iov[i].iov_len;
+
+	return len;
+}
+
+static bool session_play(rtsp_session_t *session, bool play) {
+	if ((session->state == SESSION_PLAYING) == play)
+		return true;
+
+	if (play && !playing_count++ && app_frame_subscribe(rtsp_frame_ready, NULL) != ESP_OK) {
+		playing_count--;
+		return false;
+	}
+	if (!play && !--playing_count)
+		app_frame_unsubscribe(rtsp_frame_ready, NULL);
+	app_metrics_set(APP_METRICS_RTSP_SESSIONS, playing_count);
+
+	portENTER_CRITICAL(&rtsp_mux);
+	session->state = play ? SESSION_PLAYING : SESSION_READY;
+	portEXIT_CRITICAL(&rtsp_mux);
+
+	return true;
+}
+
+static void session_close(rtsp_session_t *session) {
+	session_play(session, false);
+	session_frame_done(session);
+	close(session->fd);
+
+	portENTER_CRITICAL(&rtsp_mux);
+	session->fd = -1;
+	session->state = SESSION_FREE;
+	session->req_len = session->skip = 0;
+	session->resp_len = session->resp_sent = 0;
+	session->iov_count = session->iov_index = 0;
+	portEXIT_CRITICAL(&rtsp_mux);
+}
+
+static void session_accept(void) {
+	int fd, enable = 1;
+	rtsp_session_t *session = NULL;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	while ((fd = accept(listen_fd, (struct sockaddr *)&addr, &addr_len)) >= 0) {
+		addr_len = sizeof(addr);
+
+		for (int i = 0; i < CONFIG_CAM_RTSP_MAX_CLIENTS; i++) {
+			if (sessions[i].state == SESSION_FREE) {
+				session = &sessions[i];
+				break;
+			}
+		}
+
+		if (!session) {
+			ESP_LOGW(APP_RTSP_TAG, "No free RTSP session, rejecting client");
+			send(fd, _RTSP_BUSY, strlen(_RTSP_BUSY), MSG_DONTWAIT);
+			close(fd);
+			continue;
+		}
+
+		set_non_blocking(fd);
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+		portENTER_CRITICAL(&rtsp_mux);
+		session->fd = fd;
+		session->state = SESSION_INIT;
+		session->addr = addr;
+		session->connected_us = session->active_us = session->last_done_us = esp_timer_get_time();
+		session->req_len = session->skip = 0;
+		session->resp_len = session->resp_sent = 0;
+		session->iov_count = session->iov_index = 0;
+		session->last_seq = 0;
+		session->warned = false;
+		session->last_sr_us = 0;
+		session->packets_sent = session->octets_sent = 0;
+		session->avg_interval_us = session->avg_latency_us = 0;
+		session->frames_sent = session->frames_dropped = session->frames_spilled = 0;
+		session->bytes_sent = 0;
+		portEXIT_CRITICAL(&rtsp_mux);
+		session = NULL;
+	}
+}
+
+/* Copies the value of a request header, names are case insensitive. Empty when missing or too long. */
+static void rtsp_header(const char *req, const char *name, char *val, size_t size) {
+	const char *p = req;
+	size_t len = strlen(name);
+
+	*val = '\0';
+	while (!!(p = strstr(p + 1, "\r\n")) && strncasecmp(p + 2, name, len));
+	if (!p || p[2 + len] != ':')
+		return;
+
+	for (p += 3 + len; *p == ' '; p++);
+	for (len = 0; p[len] && p[len] != '\r'; len++);
+	if (len >= size)
+		return;
+
+	memcpy(val, p, len);
+	val[len] = '\0';
+}
+
+static void session_respond(rtsp_session_t *session, const char *status, const char *cseq, const char *headers, const char *body) {
+	size_t size = RTSP_RESP_BUF_LEN;
+	int len = snprintf(session->resp_buf, size, "RTSP/1.0 %s\r\nCSeq: %s\r\n%s", status, cseq, headers);
+
+	if (!!body)
+		len += snprintf(session->resp_buf + len, size - len, "Content-Type: application/sdp\r\nContent-Length: %u\r\n\r\n%s", (unsigned)strlen(body), body);
+	else
+		len += snprintf(session->resp_buf + len, size - len, "\r\n");
+
+	session->resp_len = MIN(len, RTSP_RESP_BUF_LEN - 1);
+	session->resp_sent = 0;
+}
+
+/* Path of an absolute or relative request URL. */
+static const char *rtsp_path(const char *url) {
+	if (strncmp(url, "rtsp://", 7))
+		return url;
+
+	url = strchr(url + 7, '/');
+	return !!url ? url : "/";
+}
+
+static bool rtsp_path_valid(const char *url) {
+	const char *path = rtsp_path(url);
+	size_t len = strlen(RTSP_URI);
+
+	return !strncmp(path, RTSP_URI, len) && (path[len] == '\0' || path[len] == '/');
+}
+
+static void session_describe(rtsp_session_t *session, const char *url, const char *cseq) {
+	char headers[RTSP_URL_LEN + 32], sdp[256], ip[16];
+	struct sockaddr_in local;
+	socklen_t local_len = sizeof(local);
+
+	//the address the client reached the camera on
+	getsockname(session->fd, (struct sockaddr *)&local, &local_len);
+	uint8_t *addr = (uint8_t *)&local.sin_addr.s_addr;
+	sprintf(ip, "%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
+
+	snprintf(sdp, sizeof(sdp), _RTSP_SDP, (uint32_t)(session->connected_us / 1000000), ip);
+	snprintf(headers, sizeof(headers), "Content-Base: %s%s\r\n", url, url[strlen(url) - 1] == '/' ? "" : "/");
+	session_respond(session, "200 OK", cseq, headers, sdp);
+}
+
+static void session_setup(rtsp_session_t *session, const char *cseq, const char *transport) {
+	char headers[160];
+	const char *p;
+	int rtp_port, rtcp_port;
+
+	if (session->state == SESSION_PLAYING) {
+		session_respond(session, "455 Method Not Valid in This State", cseq, "", NULL);
+		return;
+	}
+
+	if (!!strstr(transport, "multicast")) {
+		session_respond(session, "461 Unsupported Transport", cseq, "", NULL);
+		return;
+	}
+
+	if (!!strstr(transport, "RTP/AVP/TCP")) {
+		session->interleaved = true;
+		session->rtp_channel = 0;
+		if (!!(p = strstr(transport, "interleaved=")))
+			session->rtp_channel = atoi(p + 12);
+		session->rtcp_channel = session->rtp_channel + 1;
+	} else if (!!(p = strstr(transport, "client_port="))) {
+		int count = sscanf(p + 12, "%d-%d", &rtp_port, &rtcp_port);
+		if (count < 1 || rtp_port <= 0 || rtp_port > 65535) {
+			session_respond(session, "461 Unsupported Transport", cseq, "", NULL);
+			return;
+		}
+		if (count < 2)
+			rtcp_port = rtp_port + 1;
+
+		session->interleaved = false;
+		session->rtp_addr = session->rtcp_addr = session->addr;
+		session->rtp_addr.sin_port = htons(rtp_port);
+		session->rtcp_addr.sin_port = htons(rtcp_port);
+	} else {
+		session_respond(session, "461 Unsupported Transport", cseq, "", NULL);
+		return;
+	}
+
+	if (session->state == SESSION_INIT) {
+		session->id = esp_random();
+		session->ssrc = esp_random();
+		session->rtp_seq = esp_random();
+		session->ts_offset = esp_random();
+	}
+
+	if (session->interleaved)
+		snprintf(headers, sizeof(headers), "Transport: RTP/AVP/TCP;unicast;interleaved=%u-%u;ssrc=%08X\r\nSession: %08X;timeout=%d\r\n",
+			session->rtp_channel, session->rtcp_channel, session->ssrc, session->id, RTSP_TIMEOUT_S);
+	else
+		snprintf(headers, sizeof(headers), "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d;ssrc=%08X\r\nSession: %08X;timeout=%d\r\n",
+			ntohs(session->rtp_addr.sin_port), ntohs(session->rtcp_addr.sin_port), CONFIG_CAM_RTSP_RTP_PORT, CONFIG_CAM_RTSP_RTP_PORT + 1, session->ssrc, session->id, RTSP_TIMEOUT_S);
+
+	portENTER_CRITICAL(&rtsp_mux);
+	session->state = SESSION_READY;
+	portEXIT_CRITICAL(&rtsp_mux);
+
+	session_respond(session, "200 OK", cseq, headers, NULL);
+}
+
+static void session_handle(rtsp_session_t *session, char *req) {
+	char method[16], url[RTSP_URL_LEN], cseq[12], id[32], transport[128], headers[RTSP_URL_LEN + 64];
+
+	rtsp_header(req, "CSeq", cseq, sizeof(cseq));
+	rtsp_header(req, "Session", id, sizeof(id));
+	rtsp_header(req, "Transport", transport, sizeof(transport));
+
+	if (sscanf(req, "%15s %127s", method, url) != 2) {
+		session_respond(session, "400 Bad Request", cseq, "", NULL);
+		return;
+	}
+
+	if (!strcmp(method, "OPTIONS")) {
+		session_respond(session, "200 OK", cseq, _RTSP_PUBLIC, NULL);
+		return;
+	}
+
+	if (strcmp(method, "DESCRIBE") && strcmp(method, "SETUP") && strcmp(method, "PLAY") && strcmp(method, "PAUSE")
+			&& strcmp(method, "TEARDOWN") && strcmp(method, "GET_PARAMETER") && strcmp(method, "SET_PARAMETER")) {
+		session_respond(session, "501 Not Implemented", cseq, "", NULL);
+		return;
+	}
+
+	if (!rtsp_path_valid(url)) {
+		session_respond(session, "404 Not Found", cseq, "", NULL);
+		return;
+	}
+
+	if (!strcmp(method, "DESCRIBE")) {
+		session_describe(session, url, cseq);
+		return;
+	}
+
+	if (!strcmp(method, "SETUP")) {
+		session_setup(session, cseq, transport);
+		return;
+	}
+
+	//every other method acts on the session SETUP created
+	if (session->state < SESSION_READY || strtoul(id, NULL, 16) != session->id) {
+		session_respond(session, "454 Session Not Found", cseq, "", NULL);
+		return;
+	}
+
+	snprintf(headers, sizeof(headers), "Session: %08X\r\n", session->id);
+
+	if (!strcmp(method, "PLAY")) {
+		if (session->state != SESSION_PLAYING)
+			session->last_seq = 0;
+		if (!session_play(session, true)) {
+			session_respond(session, "503 Service Unavailable", cseq, "", NULL);
+			return;
+		}
+		snprintf(headers, sizeof(headers), "Session: %08X\r\nRange: npt=0.000-\r\nRTP-Info: url=%s;seq=%u\r\n", session->id, url, session->rtp_seq);
+	} else if (!strcmp(method, "PAUSE")) {
+		session_play(session, false);
+	} else if (!strcmp(method, "TEARDOWN")) {
+		session_play(session, false);
+		portENTER_CRITICAL(&rtsp_mux);
+		session->state = SESSION_CLOSING;
+		portEXIT_CRITICAL(&rtsp_mux);
+	}
+
+	session_respond(session, "200 OK", cseq, headers, NULL);
+}
+
+static void session_consume(rtsp_session_t *session, size_t len) {
+	memmove(session->req_buf, session->req_buf + len, session->req_len - len);
+	session->req_len -= len;
+}
+
+/*
+ * Requests are answered one at a time. Receiver reports interleaved
+ * in the connection and request bodies are skipped.
+ */
+static bool session_parse(rtsp_session_t *session) {
+	char *end, length[12];
+
+	while (!session->resp_len) {
+		if (!!session->skip) {
+			size_t len = MIN(session->skip, session->req_len);
+			session_consume(session, len);
+			session->skip -= len;
+			if (!!session->skip)
+				return true;
+		}
+
+		if (!session->req_len)
+			return true;
+
+		if (session->req_buf[0] == '$') {
+			if (session->req_len < RTP_INTERLEAVED_LEN)
+				return true;
+			session->skip = RTP_INTERLEAVED_LEN + get_u16_be((uint8_t *)session->req_buf + 2);
+			continue;
+		}
+
+		session->req_buf[session->req_len] = '\0';
+		if (!(end = strstr(session->req_buf, "\r\n\r\n")))
+			return session->req_len < RTSP_REQ_BUF_LEN - 1;
+
+		rtsp_header(session->req_buf, "Content-Length", length, sizeof(length));
+		session_handle(session, session->req_buf);
+		session_consume(session, end + 4 - session->req_buf);
+		session->skip = strtoul(length, NULL, 10);
+	}
+
+	return true;
+}
+
+static bool session_read(rtsp_session_t *session, int64_t now) {
+	int len = recv(session->fd, session->req_buf + session->req_len, RTSP_REQ_BUF_LEN - 1 - session->req_len, 0);
+	if (len < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	if (!len)
+		return false;
+
+	session->req_len += len;
+	session->active_us = now;
+
+	return session_parse(session);
+}
+
+static void session_queue(rtsp_session_t *session, bool rtcp, size_t header_len, const uint8_t *payload, size_t payload_len) {
+	uint8_t *header = session->header;
+
+	if (session->interleaved) {
+		header[0] = '$';
+		header[1] = rtcp ? session->rtcp_channel : session->rtp_channel;
+		put_u16_be(header + 2, header_len + payload_len);
+	} else {
+		header += RTP_INTERLEAVED_LEN;
+	}
+
+	session->iov[0].iov_base = header;
+	session->iov[0].iov_len = session->header + RTP_INTERLEAVED_LEN + header_len - header;
+	session->iov_count = 1;
+	session->iov_index = 0;
+	if (!!payload_len) {
+		session->iov[1].iov_base = (void *)payload;
+		session->iov[1].iov_len = payload_len;
+		session->iov_count++;
+	}
+
+	session->packet_rtcp = rtcp;
+	session->packet_len = header_len + payload_len;
+}
+
+static void session_queue_sr(rtsp_session_t *session, int64_t now) {
+	uint8_t *p = session->header + RTP_INTERLEAVED_LEN;
+	struct timeval tv;
+
+	//RTP time runs on the monotonic clock frames are stamped with, map now onto the wall clock
+	gettimeofday(&tv, NULL);
+	int64_t wall_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec - esp_timer_get_time() + now;
+
+	*p++ = 0x80;
+	*p++ = RTCP_PT_SR;
+	p = put_u16_be(p, RTCP_SR_LEN / 4 - 1);
+	p = put_u32_be(p, session->ssrc);
+	//wall clock and the RTP time of the same instant, receivers line up their streams with it
+	p = put_u32_be(p, wall_us / 1000000 + NTP_UNIX_OFFSET);
+	p = put_u32_be(p, ((uint64_t)(wall_us % 1000000) << 32) / 1000000);
+	p = put_u32_be(p, rtp_timestamp(session, now));
+	p = put_u32_be(p, session->packets_sent);
+	p = put_u32_be(p, session->octets_sent);
+
+	session_queue(session, true, RTCP_SR_LEN, NULL, 0);
+	session->last_sr_us = now;
+}
+
+static bool session_next_frame(rtsp_session_t *session) {
+	size_t jpg_len;
+	const uint8_t *jpg;
+
+	app_frame_t *frame = app_frame_acquire();
+	if (!frame)
+		return false;
+
+	if (frame->seq == session->last_seq) {
+		app_frame_release(frame);
+		return false;
+	}
+
+	camera_fb_t *fb = frame->fb;
+	if (fb->format != PIXFORMAT_JPEG) {
+		//every viewer of a raw frame shares one encode
+		if (!(session->encoded = app_encode_acquire(frame))) {
+			app_frame_release(frame);
+			return false;
+		}
+		jpg = session->encoded->buf;
+		jpg_len = session->encoded->len;
+	} else {
+		jpg = fb->buf;
+		jpg_len = fb->len;
+	}
+
+	if (!rtp_jpeg_parse(jpg, jpg_len, &session->jpeg)) {
+		if (!session->warned)
+			ESP_LOGW(APP_RTSP_TAG, "Frame %u can not be sent as RTP/JPEG, skipping such frames", frame->seq);
+		session->warned = true;
+		session->last_seq = frame->seq;
+		app_encode_release(session->encoded);
+		session->encoded = NULL;
+		app_frame_release(frame);
+		return false;
+	}
+
+	//frames published while the previous one was being sent are skipped
+	if (!!session->last_seq && frame->seq - session->last_seq > 1) {
+		portENTER_CRITICAL(&rtsp_mux);
+		session->frames_dropped += frame->seq - session->last_seq - 1;
+		portEXIT_CRITICAL(&rtsp_mux);
+		app_metrics_add(APP_METRICS_FRAMES_DROPPED, frame->seq - session->last_seq - 1);
+	}
+
+	session->last_seq = frame->seq;
+	session->offset = 0;
+	session->timestamp = rtp_timestamp(session, (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec);
+	session->frame_published_us = frame->published_us;
+	session->frame_queued_us = esp_timer_get_time();
+
+	//an encoded frame no longer needs the driver buffer
+	if (!!session->encoded)
+		app_frame_release(frame);
+	else
+		session->frame = frame;
+
+	return true;
+}
+
+/* Next fragment of the frame, RFC 2435 headers followed by a slice of the scan. */
+static void session_queue_fragment(rtsp_session_t *session) {
+	rtp_jpeg_t *jpeg = &session->jpeg;
+	uint8_t *rtp = session->header + RTP_INTERLEAVED_LEN;
+	uint8_t *p = rtp + RTP_HEADER_LEN;
+
+	*p++ = 0;
+	*p++ = session->offset >> 16;
+	p = put_u16_be(p, session->offset);
+	*p++ = jpeg->type;
+	*p++ = 255; //tables in band, in the first fragment
+	*p++ = jpeg->width;
+	*p++ = jpeg->height;
+
+	if (jpeg->type >= 64) {
+		p = put_u16_be(p, jpeg->restart_interval);
+		//first and last bits set with the count at its maximum, fragments need not follow restart intervals
+		p = put_u16_be(p, 0xffff);
+	}
+
+	if (!session->offset) {
+		*p++ = 0;
+		*p++ = 0; //8 bit precision
+		p = put_u16_be(p, RTP_QTABLES_LEN);
+		memcpy(p, jpeg->qtables, RTP_QTABLES_LEN);
+		p += RTP_QTABLES_LEN;
+	}
+
+	size_t len = MIN(jpeg->scan_len - session->offset, RTP_PACKET_LEN - (size_t)(p - rtp));
+	bool last = session->offset + len == jpeg->scan_len;
+
+	rtp[0] = 0x80;
+	rtp[1] = (last ? 0x80 : 0) | RTP_PT_JPEG;
+	put_u16_be(rtp + 2, session->rtp_seq++);
+	put_u32_be(rtp + 4, session->timestamp);
+	put_u32_be(rtp + 8, session->ssrc);
+
+	session_queue(session, false, p - rtp, jpeg->scan + session->offset, len);
+	session->offset += len;
+}
+
+static void session_frame_sent(rtsp_session_t *session) {
+	int64_t now = esp_timer_get_time();
+	uint32_t interval = now - session->last_done_us;
+	uint32_t latency = now - session->frame_published_us;
+
+	portENTER_CRITICAL(&rtsp_mux);
+	//exponential moving averages, 1/8 weight for the newest sample
+	session->avg_interval_us = !session->frames_sent ? interval : session->avg_interval_us - session->avg_interval_us / 8 + interval / 8;
+	session->avg_latency_us = !session->frames_sent ? latency : session->avg_latency_us - session->avg_latency_us / 8 + latency / 8;
+	session->last_done_us = now;
+	session->frames_sent++;
+	portEXIT_CRITICAL(&rtsp_mux);
+
+	stats.frames++;
+
+	app_metrics_observe(APP_METRICS_FRAME_SEND, now - session->frame_queued_us);
+	app_metrics_add(APP_METRICS_FRAMES_SERVED, 1);
+
+	session_frame_done(session);
+}
+
+/* len is 0 for a datagram that was lost. */
+static void session_packet_sent(rtsp_session_t *session, size_t len) {
+	portENTER_CRITICAL(&rtsp_mux);
+	session->bytes_sent += len;
+	portEXIT_CRITICAL(&rtsp_mux);
+
+	stats.bytes += len;
+	app_metrics_add(APP_METRICS_BYTES_SENT, len);
+
+	if (session->packet_rtcp)
+		return;
+
+	if (!!len) {
+		stats.packets++;
+		session->packets_sent++;
+		session->octets_sent += session->packet_len - RTP_HEADER_LEN;
+	}
+
+	if (!!session->jpeg.scan && session->offset == session->jpeg.scan_len)
+		session_frame_sent(session);
+}
+
+/*
+ * Returns 1 once the packet is out, 0 when the socket has no room yet
+ * and -1 when the session is gone. A datagram the client does not take
+ * is simply lost, as on the network.
+ */
+static int session_flush_packet(rtsp_session_t *session) {
+	int len;
+
+	if (!session->interleaved) {
+		struct msghdr msg;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = session->packet_rtcp ? &session->rtcp_addr : &session->rtp_addr;
+		msg.msg_namelen = sizeof(struct sockaddr_in);
+		msg.msg_iov = session->iov;
+		msg.msg_iovlen = session->iov_count;
+
+		len = sendmsg(session->packet_rtcp ? rtcp_fd : rtp_fd, &msg, 0);
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOMEM))
+			return 0;
+
+		session->iov_index = session->iov_count;
+		session_packet_sent(session, len < 0 ? 0 : session->packet_len);
+		return 1;
+	}
+
+	while (session_has_pending(session)) {
+		len = writev(session->fd, &session->iov[session->iov_index], session->iov_count - session->iov_index);
+		if (len < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+		while (len > 0) {
+			struct iovec *iov = &session->iov[session->iov_index];
+			if ((size_t)len >= iov->iov_len) {
+				len -= iov->iov_len;
+				session->iov_index++;
+			} else {
+				iov->iov_base = (uint8_t *)iov->iov_base + len;
+				iov->iov_len -= len;
+				len = 0;
+			}
+		}
+	}
+
+	session_packet_sent(session, RTP_INTERLEAVED_LEN + session->packet_len);
+	return 1;
+}
+
+static int session_flush_response(rtsp_session_t *session) {
+	while (session->resp_sent < session->resp_len) {
+		int len = send(session->fd, session->resp_buf + session->resp_sent, session->resp_len - session->resp_sent, 0);
+		if (len < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		session->resp_sent += len;
+	}
+
+	session->resp_len = session->resp_sent = 0;
+	return 1;
+}
+
+/*
+ * Responses share the connection with interleaved packets and go out
+ * between two of them. Packets are queued one at a time until a socket
+ * has no room left.
+ */
+static bool session_pump(rtsp_session_t *session, int64_t now) {
+	int res;
+
+	for (;;) {
+		if (!!session->resp_len && (!session->interleaved || !session_has_pending(session))) {
+			if ((res = session_flush_response(session)) <= 0)
+				return !res;
+			if (session->state == SESSION_CLOSING)
+				return false;
+			//requests that arrived meanwhile
+			if (!session_parse(session))
+				return false;
+			continue;
+		}
+
+		if (session_has_pending(session)) {
+			if ((res = session_flush_packet(session)) <= 0)
+				return !res;
+			continue;
+		}
+
+		if (session->state != SESSION_PLAYING) {
+			session_frame_done(session);
+			return true;
+		}
+
+		if (!!session->packets_sent && now - session->last_sr_us >= RTSP_SR_PERIOD_US)
+			session_queue_sr(session, now);
+		else if (!!session->jpeg.scan || session_next_frame(session))
+			session_queue_fragment(session);
+		else
+			return true;
+	}
+}
+
+/*
+ * A slow interleaved client must not keep a driver buffer the capture
+ * task needs. Once the hub has published a newer frame, the scan is
+ * copied to the heap and the frame is released.
+ */
+static void session_spill(rtsp_session_t *session, int64_t now) {
+	uint8_t *copy;
+
+	if (!session->frame || now - session->frame_published_us < RTSP_SPILL_AFTER_US)
+		return;
+
+	if (app_frame_latest_seq() == session->frame->seq)
+		return;
+
+	if (!(copy = malloc(session->jpeg.scan_len)))
+		return;
+
+	memcpy(copy, session->jpeg.scan, session->jpeg.scan_len);
+	//the packet being written may point into the scan as well
+	if (session->iov_count == 2 && session->iov_index < 2)
+		session->iov[1].iov_base = copy + ((const uint8_t *)session->iov[1].iov_base - session->jpeg.scan);
+	session->jpeg.scan = session->scan_buf = copy;
+
+	app_frame_release(session->frame);
+	session->frame = NULL;
+
+	portENTER_CRITICAL(&rtsp_mux);
+	session->frames_spilled++;
+	portEXIT_CRITICAL(&rtsp_mux);
+}
+
+/* Receiver reports only keep their session alive. */
+static void rtsp_read_reports(int64_t now) {
+	uint8_t buf[64];
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	while (recvfrom(rtcp_fd, buf, sizeof(buf), 0, (struct sockaddr *)&addr, &addr_len) >= 0) {
+		addr_len = sizeof(addr);
+
+		for (int i = 0; i < CONFIG_CAM_RTSP_MAX_CLIENTS; i++) {
+			rtsp_session_t *session = &sessions[i];
+			if (session->state >= SESSION_READY && !session->interleaved
+					&& session->rtcp_addr.sin_addr.s_addr == addr.sin_addr.s_addr && session->rtcp_addr.sin_port == addr.sin_port)
+				session->active_us = now;
+		}
+	}
+}
+
+static void rtsp_log_stats(int64_t elapsed_us) {
+	if (!!stats.frames)
+		ESP_LOGI(APP_RTSP_TAG, "RTSP: %u frames, %.1f packets/frame, %u KB/s",
+			stats.frames, (float)stats.packets / stats.frames, (uint32_t)(stats.bytes * 1000000 / elapsed_us / 1024));
+	memset(&stats, 0, sizeof(stats));
+}
+
+static void rtsp_task(void *pvParameters) {
+	fd_set rfds, wfds;
+	struct timeval tv;
+	uint8_t wake[8];
+	int maxfd;
+	bool retry;
+	int64_t now, stats_start = esp_timer_get_time();
+
+	for (;;) {
+		now = esp_timer_get_time();
+		if (now - stats_start >= RTSP_STATS_PERIOD_US) {
+			rtsp_log_stats(now - stats_start);
+			stats_start = now;
+		}
+
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_SET(listen_fd, &rfds);
+		FD_SET(rtp_fd, &rfds);
+		FD_SET(rtcp_fd, &rfds);
+		maxfd = MAX(listen_fd, MAX(rtp_fd, rtcp_fd));
+		retry = false;
+
+		for (int i = 0; i < CONFIG_CAM_RTSP_MAX_CLIENTS; i++) {
+			rtsp_session_t *session = &sessions[i];
+			if (session->state == SESSION_FREE)
+				continue;
+			FD_SET(session->fd, &rfds);
+			if (!!session->resp_len || (session->interleaved && session_has_pending(session)))
+				FD_SET(session->fd, &wfds);
+			else if (session_has_pending(session))
+				retry = true;
+			maxfd = MAX(maxfd, session->fd);
+		}
+
+		tv.tv_sec = retry ? 0 : 1;
+		tv.tv_usec = retry ? RTSP_RETRY_US : 0;
+		if (select(maxfd + 1, &rfds, &wfds, NULL, &tv) < 0) {
+			ESP_LOGE(APP_RTSP_TAG, "select() Failed: %d", errno);
+			vTaskDelay(100 / portTICK_PERIOD_MS);
+			continue;
+		}
+
+		now = esp_timer_get_time();
+
+		//wake ups and anything a client sends to the RTP port
+		if (FD_ISSET(rtp_fd, &rfds))
+			while (recv(rtp_fd, wake, sizeof(wake), 0) >= 0);
+
+		if (FD_ISSET(rtcp_fd, &rfds))
+			rtsp_read_reports(now);
+
+		if (FD_ISSET(listen_fd, &rfds))
+			session_accept();
+
+		for (int i = 0; i < CONFIG_CAM_RTSP_MAX_CLIENTS; i++) {
+			rtsp_session_t *session = &sessions[i];
+			if (session->state == SESSION_FREE)
+				continue;
+
+			if (now - session->active_us > (int64_t)RTSP_TIMEOUT_S * 1000000) {
+				ESP_LOGW(APP_RTSP_TAG, "RTSP session %08X timed out", session->id);
+				session_close(session);
+				continue;
+			}
+
+			if (FD_ISSET(session->fd, &rfds) && !session_read(session, now)) {
+				session_close(session);
+				continue;
+			}
+
+			if (!session_pump(session, now)) {
+				session_close(session);
+				continue;
+			}
+
+			if (session_has_pending(session))
+				session_spill(session, esp_timer_get_time());
+		}
+	}
+	vTaskDelete(NULL);
+}
+
+int app_rtsp_get_clients(app_stream_client_info_t *infos, int max) {
+	int count = 0;
+	int64_t now = esp_timer_get_time();
+
+	portENTER_CRITICAL(&rtsp_mux);
+	for (int i = 0; i < CONFIG_CAM_RTSP_MAX_CLIENTS && count < max; i++) {
+		rtsp_session_t *session = &sessions[i];
+		if (session->state != SESSION_READY && session->state != SESSION_PLAYING)
+			continue;
+
+		app_stream_client_info_t *info = &infos[count++];
+		memset(info, 0, sizeof(*info));
+		info->ip = session->addr.sin_addr.s_addr;
+		info->port = ntohs(session->addr.sin_port);
+		info->uptime_ms = (now - session->connected_us) / 1000;
+		info->frames_sent = session->frames_sent;
+		info->frames_dropped = session->frames_dropped;
+		info->frames_spilled = session->frames_spilled;
+		info->bytes_sent = session->bytes_sent;
+		info->transport = session->interleaved ? APP_STREAM_RTSP_TCP : APP_STREAM_RTSP_UDP;
+		info->queue_bytes = session_pending_bytes(session);
+		info->latency_ms = session->avg_latency_us / 1000;
+		info->fps = !!session->avg_interval_us ? 1000000.0f / session->avg_interval_us : 0;
+	}
+	portEXIT_CRITICAL(&rtsp_mux);
+
+	return count;
+}
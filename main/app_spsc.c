@@ -0,0 +1,57 @@
+/*
+ * app_spsc.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stddef.h>
+
+#include "app_spsc.h"
+
+/*
+ * head and tail run over twice the size so a full queue can be told
+ * from an empty one without giving up a slot.
+ */
+static uint32_t spsc_count(uint32_t head, uint32_t tail, uint32_t size) {
+	return (head + 2 * size - tail) % (2 * size);
+}
+
+void app_spsc_init(app_spsc_t *queue, void **slots, uint32_t size) {
+	queue->slots = slots;
+	queue->size = size;
+	queue->head = 0;
+	queue->tail = 0;
+}
+
+bool app_spsc_push(app_spsc_t *queue, void *item) {
+	uint32_t head = queue->head;
+	uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+	if (spsc_count(head, tail, queue->size) == queue->size)
+		return false;
+
+	queue->slots[head % queue->size] = item;
+	//the slot is written before the consumer can see the new head
+	__atomic_store_n(&queue->head, (head + 1) % (2 * queue->size), __ATOMIC_RELEASE);
+
+	return true;
+}
+
+void *app_spsc_pop(app_spsc_t *queue) {
+	uint32_t tail = queue->tail;
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return NULL;
+
+	void *item = queue->slots[tail % queue->size];
+	//the slot is read before the producer can reuse it
+	__atomic_store_n(&queue->tail, (tail + 1) % (2 * queue->size), __ATOMIC_RELEASE);
+
+	return item;
+}
+
+uint32_t app_spsc_count(const app_spsc_t *queue) {
+	return spsc_count(__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE), __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE), queue->size);
+}
@@ -0,0 +1,1011 @@
+/*
+ * app_stream.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/base64.h"
+#include "sdkconfig.h"
+
+#include "app_common.h"
+#include "app_encode.h"
+#include "app_frame.h"
+#include "app_json.h"
+#include "app_metrics.h"
+#include "app_motion.h"
+#include "app_stream.h"
+
+#define PART_BOUNDARY "123456789000000000000987654321"
+static const char *_STREAM_HEADERS = "HTTP/1.1 200 OK\r\n"
+	"Content-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY "\r\n"
+	"Access-Control-Allow-Origin: *\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Connection: close\r\n"
+	"\r\n";
+static const char *_EVENTS_HEADERS = "HTTP/1.1 200 OK\r\n"
+	"Content-Type: text/event-stream\r\n"
+	"Access-Control-Allow-Origin: *\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Connection: close\r\n"
+	"\r\n";
+static const char *_WS_HEADERS = "HTTP/1.1 101 Switching Protocols\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Accept: %s\r\n"
+	"\r\n";
+static const char *_STREAM_BAD_REQUEST = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char *_STREAM_NOT_FOUND = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char *_STREAM_BUSY = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+//boundary and part header of every frame, completed by stream_format_part()
+static const char _STREAM_PART_LENGTH[] = "\r\n--" PART_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: ";
+static const char _STREAM_PART_TIMESTAMP[] = "\r\nX-Timestamp: ";
+static const char _STREAM_PART_END[] = "\r\n\r\n";
+
+#define STREAM_URI "/cam/stream"
+#define MOTION_EVENTS_URI "/motion/events"
+#define WS_URI "/cam/ws"
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_KEY_LEN 24
+#define WS_OP_TEXT 0x1
+#define WS_OP_BINARY 0x2
+#define WS_OP_CLOSE 0x8
+//sequence, capture time in seconds and microseconds, JPEG length, all big endian
+#define WS_META_LEN 16
+#define STREAM_REQ_BUF_LEN 512
+//part header of a frame or a whole server-sent event
+#define STREAM_PART_BUF_LEN 256
+#define STREAM_SEGMENTS 2
+#define STREAM_STATS_PERIOD_US (10 * 1000000)
+//a frame the hub already replaced is copied out of the driver buffer after this long
+#define STREAM_SPILL_AFTER_US (100 * 1000)
+//bytes of entropy coded data hashed per frame to spot a repeated scene
+#define STREAM_HASH_SAMPLES 64
+//motion analysis this many frames behind still vouches for a static scene
+#define STREAM_MOTION_MAX_LAG 2
+
+typedef enum {
+	CLIENT_FREE = 0,
+	CLIENT_REQUEST,
+	CLIENT_STREAMING,
+	CLIENT_CLOSING
+} client_state_t;
+
+typedef enum {
+	CLIENT_MJPEG = 0,
+	CLIENT_EVENTS,
+	CLIENT_WS
+} client_kind_t;
+
+typedef struct {
+	uint32_t seq;
+	int64_t queued_us;
+} ws_pending_t;
+
+typedef struct {
+	int fd;
+	client_state_t state;
+	client_kind_t kind;
+	size_t req_len;
+	char req_buf[STREAM_REQ_BUF_LEN]; //request, then received WebSocket frames
+	app_frame_t *frame;
+	uint32_t last_seq; //last event id for an event client
+	const app_encoded_t *encoded; //shared JPEG of a raw frame
+	uint8_t *jpg_buf; //spilled frame owned by the client
+	bool in_frame;
+	int64_t frame_published_us;
+	int64_t frame_queued_us;
+	struct iovec iov[STREAM_SEGMENTS];
+	int iov_count;
+	int iov_index;
+	char part_buf[STREAM_PART_BUF_LEN];
+	//per client backpressure figures, read by app_stream_get_clients()
+	struct sockaddr_in addr;
+	int64_t connected_us;
+	int64_t last_done_us;
+	uint32_t avg_interval_us;
+	uint32_t avg_latency_us;
+	uint32_t queue_bytes;
+	uint32_t frames_sent;
+	uint32_t frames_dropped;
+	uint32_t frames_spilled;
+	uint64_t bytes_sent;
+	//static mode, the reference is the last frame sent because the scene changed
+	bool static_mode;
+	size_t ref_len;
+	uint32_t ref_hash;
+	uint32_t frames_suppressed;
+	uint64_t bytes_saved;
+	//WebSocket frames sent but not acknowledged, a full window holds back the next frame
+	ws_pending_t ws_pending[CONFIG_CAM_STREAM_WS_WINDOW];
+	int ws_pending_count;
+	uint32_t avg_ack_us;
+	uint32_t acks;
+} stream_client_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t send_calls;
+	uint64_t bytes;
+	uint64_t bytes_saved;
+} stream_stats_t;
+
+static portMUX_TYPE stream_mux = portMUX_INITIALIZER_UNLOCKED;
+static stream_client_t clients[CONFIG_CAM_STREAM_MAX_CLIENTS];
+static int streaming_count = 0;
+static int events_count = 0;
+static stream_stats_t stats;
+
+static int listen_fd = -1;
+//the capture task wakes the engine up through a loopback datagram
+static int wake_fd = -1;
+static int notify_fd = -1;
+static struct sockaddr_in wake_addr;
+
+static void stream_task(void *pvParameters);
+
+static int set_non_blocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static esp_err_t create_wake_sockets(void) {
+	socklen_t addr_len = sizeof(wake_addr);
+
+	memset(&wake_addr, 0, sizeof(wake_addr));
+	wake_addr.sin_family = AF_INET;
+	wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	wake_addr.sin_port = 0;
+
+	APP_ERROR_CHECK_WITH_MSG((wake_fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0, "socket() wake Failed", err_wake);
+	APP_ERROR_CHECK_WITH_MSG(!bind(wake_fd, (struct sockaddr *)&wake_addr, sizeof(wake_addr)), "bind() wake Failed", err_wake);
+	APP_ERROR_CHECK_WITH_MSG(!getsockname(wake_fd, (struct sockaddr *)&wake_addr, &addr_len), "getsockname() wake Failed", err_wake);
+	APP_ERROR_CHECK_WITH_MSG(!set_non_blocking(wake_fd), "fcntl() wake Failed", err_wake);
+	APP_ERROR_CHECK_WITH_MSG((notify_fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0, "socket() notify Failed", err_wake);
+	APP_ERROR_CHECK_WITH_MSG(!set_non_blocking(notify_fd), "fcntl() notify Failed", err_wake);
+
+	return ESP_OK;
+err_wake:
+	return ESP_FAIL;
+}
+
+esp_err_t init_stream_server(uint16_t port) {
+	struct sockaddr_in addr;
+	int enable = 1;
+
+	memset(clients, 0, sizeof(clients));
+	for (int i = 0; i < CONFIG_CAM_STREAM_MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+
+	APP_ERROR_CHECK_WITH_MSG(create_wake_sockets() == ESP_OK, "Stream wake sockets failed", err_init);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	APP_ERROR_CHECK_WITH_MSG((listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) >= 0, "socket() listen Failed", err_init);
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	APP_ERROR_CHECK_WITH_MSG(!bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)), "bind() listen Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(!listen(listen_fd, CONFIG_CAM_STREAM_MAX_CLIENTS), "listen() Failed", err_init);
+	APP_ERROR_CHECK_WITH_MSG(!set_non_blocking(listen_fd), "fcntl() listen Failed", err_init);
+
+	APP_ERROR_CHECK_WITH_MSG(xTaskCreatePinnedToCore(stream_task, "stream-engine", 4096, NULL, 5, NULL, APP_FRAME_CAPTURE_CORE) == pdPASS, "xTaskCreatePinnedToCore() stream engine Failed", err_init);
+
+	ESP_LOGI(APP_STREAM_TAG, "Stream server listening on port %d", port);
+
+	return ESP_OK;
+err_init:
+	if (listen_fd >= 0) close(listen_fd);
+	if (wake_fd >= 0) close(wake_fd);
+	if (notify_fd >= 0) close(notify_fd);
+	listen_fd = wake_fd = notify_fd = -1;
+	return ESP_FAIL;
+}
+
+static void stream_frame_ready(void *arg) {
+	const uint8_t wake = 0;
+	sendto(notify_fd, &wake, sizeof(wake), MSG_DONTWAIT, (struct sockaddr *)&wake_addr, sizeof(wake_addr));
+}
+
+static void client_queue(stream_client_t *client, const void *buf, size_t len) {
+	client->iov[client->iov_count].iov_base = (void *)buf;
+	client->iov[client->iov_count].iov_len = len;
+	client->iov_count++;
+}
+
+static bool client_has_pending(stream_client_t *client) {
+	return client->iov_index < client->iov_count;
+}
+
+static void client_frame_done(stream_client_t *client) {
+	if (!!client->jpg_buf) {
+		free(client->jpg_buf);
+		client->jpg_buf = NULL;
+	}
+	app_encode_release(client->encoded);
+	client->encoded = NULL;
+	app_frame_release(client->frame);
+	client->frame = NULL;
+	client->in_frame = false;
+	client->iov_count = client->iov_index = 0;
+}
+
+static void client_close(stream_client_t *client) {
+	client_frame_done(client);
+	close(client->fd);
+
+	if (client->state == CLIENT_STREAMING && client->kind == CLIENT_EVENTS) {
+		if (!--events_count)
+			app_motion_unsubscribe(stream_frame_ready, NULL);
+	} else if (client->state == CLIENT_STREAMING) {
+		if (!--streaming_count)
+			app_frame_unsubscribe(stream_frame_ready, NULL);
+		app_metrics_set(APP_METRICS_STREAM_CLIENTS, streaming_count);
+		if (client->static_mode)
+			app_motion_release();
+	}
+
+	portENTER_CRITICAL(&stream_mux);
+	client->fd = -1;
+	client->state = CLIENT_FREE;
+	client->req_len = 0;
+	client->last_seq = 0;
+	portEXIT_CRITICAL(&stream_mux);
+}
+
+static void client_accept(void) {
+	int fd, enable = 1;
+	stream_client_t *client = NULL;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	while ((fd = accept(listen_fd, (struct sockaddr *)&addr, &addr_len)) >= 0) {
+		addr_len = sizeof(addr);
+
+		for (int i = 0; i < CONFIG_CAM_STREAM_MAX_CLIENTS; i++) {
+			if (clients[i].state == CLIENT_FREE) {
+				client = &clients[i];
+				break;
+			}
+		}
+
+		if (!client) {
+			ESP_LOGW(APP_STREAM_TAG, "No free stream slot, rejecting client");
+			send(fd, _STREAM_BUSY, strlen(_STREAM_BUSY), MSG_DONTWAIT);
+			close(fd);
+			continue;
+		}
+
+		set_non_blocking(fd);
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+		portENTER_CRITICAL(&stream_mux);
+		client->fd = fd;
+		client->state = CLIENT_REQUEST;
+		client->kind = CLIENT_MJPEG;
+		client->req_len = 0;
+		client->addr = addr;
+		client->connected_us = client->last_done_us = esp_timer_get_time();
+		client->avg_interval_us = client->avg_latency_us = 0;
+		client->queue_bytes = 0;
+		client->frames_sent = client->frames_dropped = client->frames_spilled = 0;
+		client->bytes_sent = 0;
+		client->static_mode = false;
+		client->ref_len = client->ref_hash = 0;
+		client->frames_suppressed = 0;
+		client->bytes_saved = 0;
+		client->ws_pending_count = 0;
+		client->avg_ack_us = client->acks = 0;
+		portEXIT_CRITICAL(&stream_mux);
+		client = NULL;
+	}
+}
+
+/*
+ * Motion events as server-sent events. A reconnecting browser sends the
+ * id of the last event it saw and gets the ones it missed, as far as
+ * the motion engine still keeps them.
+ */
+static void client_start_events(stream_client_t *client, const char *last_event_id) {
+	client_queue(client, _EVENTS_HEADERS, strlen(_EVENTS_HEADERS));
+	client->state = CLIENT_STREAMING;
+	client->kind = CLIENT_EVENTS;
+	client->last_seq = !!*last_event_id ? strtoul(last_event_id, NULL, 10) : app_motion_last_event_id();
+
+	//the engine is woken up the same way as for a new frame
+	if (!events_count++ && app_motion_subscribe(stream_frame_ready, NULL) != ESP_OK) {
+		events_count--;
+		client->kind = CLIENT_MJPEG;
+		client->state = CLIENT_CLOSING;
+	}
+}
+
+/* True when the query string holds param as one of its key=value pairs. */
+static bool query_has(const char *query, const char *param) {
+	size_t len = strlen(param);
+
+	while (!!query) {
+		if (!strncmp(query, param, len) && (query[len] == '&' || query[len] == '\0'))
+			return true;
+		if (!!(query = strchr(query, '&')))
+			query++;
+	}
+
+	return false;
+}
+
+/* Copies the value of a request header, empty when it is missing or too long. */
+static void request_header(const char *req, const char *name, char *val, size_t size) {
+	const char *p = req;
+	size_t len = strlen(name);
+
+	*val = '\0';
+	while (!!(p = strstr(p + 1, "\r\n")) && strncmp(p + 2, name, len));
+	if (!p || p[2 + len] != ':')
+		return;
+
+	for (p += 3 + len; *p == ' '; p++);
+	for (len = 0; p[len] && p[len] != '\r'; len++);
+	if (len >= size)
+		return;
+
+	memcpy(val, p, len);
+	val[len] = '\0';
+}
+
+static void client_watch_frames(stream_client_t *client) {
+	client->state = CLIENT_STREAMING;
+
+	if (!streaming_count++ && app_frame_subscribe(stream_frame_ready, NULL) != ESP_OK) {
+		streaming_count--;
+		client->state = CLIENT_CLOSING;
+	}
+	app_metrics_set(APP_METRICS_STREAM_CLIENTS, streaming_count);
+
+	//static mode tells a still scene by the motion grid, analysed even with motion detection off
+	if (client->state == CLIENT_STREAMING && client->static_mode && app_motion_hold() != ESP_OK) {
+		ESP_LOGW(APP_STREAM_TAG, "No motion analysis, static mode off for this client");
+		client->static_mode = false;
+	}
+}
+
+/*
+ * Every JPEG goes out as one binary message behind a WS_META_LEN header.
+ * The browser acknowledges each frame it has decoded with a message
+ * holding its sequence, a 4 byte big endian binary or decimal text.
+ */
+static void client_start_ws(stream_client_t *client, const char *key) {
+	char input[WS_KEY_LEN + sizeof(WS_GUID)];
+	unsigned char sha[20];
+	char accept[32];
+	size_t accept_len;
+
+	if (strlen(key) != WS_KEY_LEN) {
+		client_queue(client, _STREAM_BAD_REQUEST, strlen(_STREAM_BAD_REQUEST));
+		client->state = CLIENT_CLOSING;
+		return;
+	}
+
+	memcpy(input, key, WS_KEY_LEN);
+	memcpy(input + WS_KEY_LEN, WS_GUID, sizeof(WS_GUID));
+	mbedtls_sha1_ret((const unsigned char *)input, strlen(input), sha);
+	mbedtls_base64_encode((unsigned char *)accept, sizeof(accept), &accept_len, sha, sizeof(sha));
+	accept[accept_len] = '\0';
+
+	client_queue(client, client->part_buf, snprintf(client->part_buf, STREAM_PART_BUF_LEN, _WS_HEADERS, accept));
+	client->kind = CLIENT_WS;
+	client->req_len = 0;
+	client_watch_frames(client);
+}
+
+static void client_start_stream(stream_client_t *client) {
+	char *uri = NULL, *query = NULL, *end;
+	char last_event_id[12], ws_key[WS_KEY_LEN + 1];
+
+	client->req_buf[client->req_len] = '\0';
+
+	//looked up before the request line is cut at the end of the path
+	request_header(client->req_buf, "Last-Event-ID", last_event_id, sizeof(last_event_id));
+	request_header(client->req_buf, "Sec-WebSocket-Key", ws_key, sizeof(ws_key));
+
+	if (!strncmp(client->req_buf, "GET ", 4)) {
+		uri = client->req_buf + 4;
+		if (!!(end = strchr(uri, ' ')))
+			*end = '\0';
+		if (!!(query = strchr(uri, '?')))
+			*query++ = '\0';
+	}
+
+	if (!!uri && !strcmp(uri, MOTION_EVENTS_URI)) {
+		client_start_events(client, last_event_id);
+		return;
+	}
+
+	if (!uri || (strcmp(uri, STREAM_URI) && strcmp(uri, WS_URI))) {
+		client_queue(client, _STREAM_NOT_FOUND, strlen(_STREAM_NOT_FOUND));
+		client->state = CLIENT_CLOSING;
+		return;
+	}
+
+	client->static_mode = query_has(query, "mode=static");
+
+	if (!strcmp(uri, WS_URI)) {
+		client_start_ws(client, ws_key);
+		return;
+	}
+
+	client_queue(client, _STREAM_HEADERS, strlen(_STREAM_HEADERS));
+	client_watch_frames(client);
+}
+
+static uint32_t get_u32_be(const uint8_t *buf) {
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static uint8_t *put_u32_be(uint8_t *buf, uint32_t val) {
+	*buf++ = val >> 24;
+	*buf++ = val >> 16;
+	*buf++ = val >> 8;
+	*buf++ = val;
+	return buf;
+}
+
+/* Frees the window up to the acknowledged frame, and times the round trip of that frame. */
+static void client_ws_ack(stream_client_t *client, uint32_t seq) {
+	int64_t now = esp_timer_get_time();
+	int kept = 0;
+
+	for (int i = 0; i < client->ws_pending_count; i++) {
+		ws_pending_t *pending = &client->ws_pending[i];
+		if (pending->seq > seq) {
+			client->ws_pending[kept++] = *pending;
+			continue;
+		}
+		if (pending->seq != seq)
+			continue;
+
+		uint32_t ack_us = now - pending->queued_us;
+		portENTER_CRITICAL(&stream_mux);
+		client->avg_ack_us = !client->acks ? ack_us : client->avg_ack_us - client->avg_ack_us / 8 + ack_us / 8;
+		client->acks++;
+		portEXIT_CRITICAL(&stream_mux);
+	}
+	client->ws_pending_count = kept;
+}
+
+/*
+ * Client frames are masked and, as only acknowledgements are expected,
+ * short. Anything longer than a single length byte closes the client.
+ */
+static bool client_read_ws(stream_client_t *client) {
+	uint8_t *buf = (uint8_t *)client->req_buf;
+	size_t pos = 0;
+
+	int len = recv(client->fd, buf + client->req_len, STREAM_REQ_BUF_LEN - client->req_len, 0);
+	if (len < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	if (!len)
+		return false;
+
+	client->req_len += len;
+
+	while (client->req_len - pos >= 2) {
+		uint8_t opcode = buf[pos] & 0x0f;
+		size_t payload_len = buf[pos + 1] & 0x7f;
+
+		if (!(buf[pos + 1] & 0x80) || payload_len > 125)
+			return false;
+		if (client->req_len - pos < 6 + payload_len)
+			break;
+
+		uint8_t *mask = buf + pos + 2, *payload = buf + pos + 6;
+		for (size_t i = 0; i < payload_len; i++)
+			payload[i] ^= mask[i % 4];
+
+		if (opcode == WS_OP_CLOSE)
+			return false;
+		if (opcode == WS_OP_BINARY && payload_len == 4)
+			client_ws_ack(client, get_u32_be(payload));
+		else if (opcode == WS_OP_TEXT && payload_len > 0 && payload_len < 11) {
+			char text[11];
+			memcpy(text, payload, payload_len);
+			text[payload_len] = '\0';
+			client_ws_ack(client, strtoul(text, NULL, 10));
+		}
+
+		pos += 6 + payload_len;
+	}
+
+	memmove(buf, buf + pos, client->req_len - pos);
+	client->req_len -= pos;
+
+	return true;
+}
+
+static bool client_read(stream_client_t *client) {
+	char discard[64];
+	int len;
+
+	if (client->kind == CLIENT_WS && client->state == CLIENT_STREAMING)
+		return client_read_ws(client);
+
+	if (client->state != CLIENT_REQUEST) {
+		//nothing is expected from a viewer, only the end of the connection
+		len = recv(client->fd, discard, sizeof(discard), 0);
+		return len > 0 || (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+	}
+
+	len = recv(client->fd, client->req_buf + client->req_len, STREAM_REQ_BUF_LEN - 1 - client->req_len, 0);
+	if (len < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	if (!len)
+		return false;
+
+	client->req_len += len;
+	client->req_buf[client->req_len] = '\0';
+
+	if (!!strstr(client->req_buf, "\r\n\r\n") || client->req_len == STREAM_REQ_BUF_LEN - 1)
+		client_start_stream(client);
+
+	return true;
+}
+
+static char *format_uint(char *dst, uint32_t val, int min_digits) {
+	char digits[10];
+	int len = 0;
+
+	do {
+		digits[len++] = '0' + val % 10;
+		val /= 10;
+	} while (val || len < min_digits);
+
+	while (len)
+		*dst++ = digits[--len];
+
+	return dst;
+}
+
+static size_t stream_format_part(char *buf, size_t jpg_len, const struct timeval *timestamp) {
+	char *p = buf;
+
+	memcpy(p, _STREAM_PART_LENGTH, sizeof(_STREAM_PART_LENGTH) - 1);
+	p = format_uint(p + sizeof(_STREAM_PART_LENGTH) - 1, jpg_len, 1);
+	memcpy(p, _STREAM_PART_TIMESTAMP, sizeof(_STREAM_PART_TIMESTAMP) - 1);
+	p = format_uint(p + sizeof(_STREAM_PART_TIMESTAMP) - 1, timestamp->tv_sec, 1);
+	*p++ = '.';
+	p = format_uint(p, timestamp->tv_usec, 6);
+	memcpy(p, _STREAM_PART_END, sizeof(_STREAM_PART_END) - 1);
+
+	return p + sizeof(_STREAM_PART_END) - 1 - buf;
+}
+
+/*
+ * FNV-1a over bytes sampled evenly from the entropy coded data, after
+ * the SOS header. Cheap enough to run on every frame of every viewer.
+ */
+static uint32_t stream_sample_hash(const uint8_t *jpg, size_t len) {
+	uint32_t hash = 2166136261U;
+	size_t start = 0;
+
+	for (size_t i = 2; i + 3 < len; i++) {
+		if (jpg[i] == 0xff && jpg[i + 1] == 0xda) {
+			start = i + 2 + ((jpg[i + 2] << 8) | jpg[i + 3]);
+			break;
+		}
+	}
+
+	//no entropy coded data found, only the size is compared
+	if (!start || start >= len)
+		return 0;
+
+	size_t step = MAX(1, (len - start) / STREAM_HASH_SAMPLES);
+	for (size_t i = start; i < len; i += step) {
+		hash ^= jpg[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/*
+ * No change in the blocks of the motion grid for this frame or one just
+ * before it. Sensor noise keeps the JPEG bytes of a real scene from ever
+ * repeating, this is what tells a static one apart then. Static mode
+ * clients hold the analysis, so the grid is kept up to date for them.
+ */
+static bool stream_motion_still(uint32_t seq) {
+	app_motion_status_t status;
+
+	app_motion_get_status(&status);
+	return !!status.frames && !status.changed && seq - status.seq <= STREAM_MOTION_MAX_LAG;
+}
+
+/*
+ * A frame of the same scene is within the size tolerance of the
+ * reference and has the very same sampled bytes, or the motion grid saw
+ * nothing change. The size alone never makes a frame static. One frame
+ * still goes out every keep-alive interval and, like the first one that
+ * differs, goes out immediately and becomes the new reference.
+ */
+static bool client_frame_static(stream_client_t *client, uint32_t seq, const uint8_t *jpg, size_t len, int64_t now) {
+	uint32_t hash = stream_sample_hash(jpg, len);
+	size_t delta = len > client->ref_len ? len - client->ref_len : client->ref_len - len;
+
+	bool same = !!client->ref_len && delta * 1000 <= client->ref_len * CONFIG_CAM_STREAM_STATIC_TOLERANCE
+			&& ((!!hash && hash == client->ref_hash) || stream_motion_still(seq));
+	if (same && now - client->last_done_us < (int64_t)CONFIG_CAM_STREAM_KEEPALIVE_MS * 1000)
+		return true;
+
+	client->ref_len = len;
+	client->ref_hash = hash;
+	return false;
+}
+
+static size_t ws_format_header(uint8_t *buf, uint32_t seq, size_t jpg_len, const struct timeval *timestamp) {
+	size_t len = WS_META_LEN + jpg_len;
+	uint8_t *p = buf;
+
+	*p++ = 0x80 | WS_OP_BINARY;
+	if (len < 126) {
+		*p++ = len;
+	} else if (len <= 0xffff) {
+		*p++ = 126;
+		*p++ = len >> 8;
+		*p++ = len;
+	} else {
+		*p++ = 127;
+		p = put_u32_be(p, 0);
+		p = put_u32_be(p, len);
+	}
+
+	p = put_u32_be(p, seq);
+	p = put_u32_be(p, timestamp->tv_sec);
+	p = put_u32_be(p, timestamp->tv_usec);
+	p = put_u32_be(p, jpg_len);
+
+	return p - buf;
+}
+
+static void client_next_frame(stream_client_t *client) {
+	size_t jpg_len;
+	const uint8_t *jpg;
+
+	//the browser has not caught up, it gets the newest frame once it acknowledges one
+	if (client->kind == CLIENT_WS && client->ws_pending_count == CONFIG_CAM_STREAM_WS_WINDOW)
+		return;
+
+	app_frame_t *frame = app_frame_acquire();
+	if (!frame)
+		return;
+
+	if (frame->seq == client->last_seq) {
+		app_frame_release(frame);
+		return;
+	}
+
+	camera_fb_t *fb = frame->fb;
+	if (fb->format != PIXFORMAT_JPEG) {
+		//every viewer of a raw frame shares one encode
+		if (!(client->encoded = app_encode_acquire(frame))) {
+			app_frame_release(frame);
+			return;
+		}
+		jpg = client->encoded->buf;
+		jpg_len = client->encoded->len;
+	} else {
+		jpg = fb->buf;
+		jpg_len = fb->len;
+	}
+
+	if (client->static_mode && client_frame_static(client, frame->seq, jpg, jpg_len, esp_timer_get_time())) {
+		client->last_seq = frame->seq;
+
+		portENTER_CRITICAL(&stream_mux);
+		client->frames_suppressed++;
+		client->bytes_saved += jpg_len;
+		portEXIT_CRITICAL(&stream_mux);
+
+		stats.bytes_saved += jpg_len;
+		app_metrics_add(APP_METRICS_FRAMES_SUPPRESSED, 1);
+		app_metrics_add(APP_METRICS_BYTES_SAVED, jpg_len);
+
+		app_encode_release(client->encoded);
+		client->encoded = NULL;
+		app_frame_release(frame);
+		return;
+	}
+
+	//frames published while the previous one was being sent are skipped
+	if (!!client->last_seq && frame->seq - client->last_seq > 1) {
+		portENTER_CRITICAL(&stream_mux);
+		client->frames_dropped += frame->seq - client->last_seq - 1;
+		portEXIT_CRITICAL(&stream_mux);
+		app_metrics_add(APP_METRICS_FRAMES_DROPPED, frame->seq - client->last_seq - 1);
+	}
+
+	client->last_seq = frame->seq;
+	client->frame_published_us = frame->published_us;
+	client->frame_queued_us = esp_timer_get_time();
+	client->in_frame = true;
+
+	//boundary, part header and payload leave in a single gather write
+	if (client->kind == CLIENT_WS) {
+		client->ws_pending[client->ws_pending_count].seq = frame->seq;
+		client->ws_pending[client->ws_pending_count].queued_us = client->frame_queued_us;
+		client->ws_pending_count++;
+		client_queue(client, client->part_buf, ws_format_header((uint8_t *)client->part_buf, frame->seq, jpg_len, &fb->timestamp));
+	} else {
+		client_queue(client, client->part_buf, stream_format_part(client->part_buf, jpg_len, &fb->timestamp));
+	}
+	client_queue(client, jpg, jpg_len);
+
+	//an encoded frame no longer needs the driver buffer
+	if (!!client->encoded)
+		app_frame_release(frame);
+	else
+		client->frame = frame;
+}
+
+static void client_next_event(stream_client_t *client) {
+	app_motion_event_t event;
+	app_json_t json;
+	char *p = client->part_buf;
+	size_t size = STREAM_PART_BUF_LEN;
+
+	if (!app_motion_get_events(client->last_seq, &event, 1))
+		return;
+
+	client->last_seq = event.id;
+
+	int len = snprintf(p, size, "id: %u\nevent: motion\ndata: ", event.id);
+	app_json_init(&json, p + len, size - len - 2, NULL, NULL);
+	app_motion_event_json(&json, NULL, &event);
+	if (app_json_end(&json) != ESP_OK) {
+		ESP_LOGW(APP_STREAM_TAG, "Motion event %u does not fit the event buffer", event.id);
+		return;
+	}
+	len += json.len;
+	p[len++] = '\n';
+	p[len++] = '\n';
+
+	client_queue(client, p, len);
+}
+
+static uint32_t client_pending_bytes(stream_client_t *client) {
+	uint32_t len = 0;
+
+	for (int i = client->iov_index; i < client->iov_count; i++)
+		len += client->iov[i].iov_len;
+
+	return len;
+}
+
+/*
+ * A slow viewer must not keep a driver buffer the capture task needs.
+ * Once the hub has published a newer frame, the unsent rest of the
+ * payload is copied to the heap and the frame is released.
+ */
+static void client_spill(stream_client_t *client, int64_t now) {
+	struct iovec *payload;
+	uint8_t *copy;
+
+	if (!client->frame || now - client->frame_published_us < STREAM_SPILL_AFTER_US)
+		return;
+
+	if (app_frame_latest_seq() == client->frame->seq)
+		return;
+
+	payload = &client->iov[client->iov_count - 1];
+	if (!(copy = malloc(payload->iov_len)))
+		return;
+
+	memcpy(copy, payload->iov_base, payload->iov_len);
+	payload->iov_base = copy;
+	client->jpg_buf = copy;
+
+	app_frame_release(client->frame);
+	client->frame = NULL;
+
+	portENTER_CRITICAL(&stream_mux);
+	client->frames_spilled++;
+	portEXIT_CRITICAL(&stream_mux);
+}
+
+static void client_frame_sent(stream_client_t *client) {
+	int64_t now = esp_timer_get_time();
+	uint32_t interval = now - client->last_done_us;
+	uint32_t latency = now - client->frame_published_us;
+
+	portENTER_CRITICAL(&stream_mux);
+	//exponential moving averages, 1/8 weight for the newest sample
+	client->avg_interval_us = !client->frames_sent ? interval : client->avg_interval_us - client->avg_interval_us / 8 + interval / 8;
+	client->avg_latency_us = !client->frames_sent ? latency : client->avg_latency_us - client->avg_latency_us / 8 + latency / 8;
+	client->last_done_us = now;
+	client->frames_sent++;
+	portEXIT_CRITICAL(&stream_mux);
+
+	stats.frames++;
+
+	app_metrics_observe(APP_METRICS_FRAME_SEND, now - client->frame_queued_us);
+	app_metrics_add(APP_METRICS_FRAMES_SERVED, 1);
+}
+
+static bool client_flush(stream_client_t *client) {
+	int len;
+
+	while (client_has_pending(client)) {
+		len = writev(client->fd, &client->iov[client->iov_index], client->iov_count - client->iov_index);
+		if (len < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+
+		stats.send_calls++;
+		stats.bytes += len;
+		app_metrics_add(APP_METRICS_BYTES_SENT, len);
+
+		portENTER_CRITICAL(&stream_mux);
+		client->bytes_sent += len;
+		portEXIT_CRITICAL(&stream_mux);
+
+		while (len > 0) {
+			struct iovec *iov = &client->iov[client->iov_index];
+			if ((size_t)len >= iov->iov_len) {
+				len -= iov->iov_len;
+				client->iov_index++;
+			} else {
+				iov->iov_base = (uint8_t *)iov->iov_base + len;
+				iov->iov_len -= len;
+				len = 0;
+			}
+		}
+
+		client->queue_bytes = client_pending_bytes(client);
+	}
+
+	if (client->in_frame)
+		client_frame_sent(client);
+
+	client_frame_done(client);
+
+	return client->state != CLIENT_CLOSING;
+}
+
+static bool client_pump(stream_client_t *client) {
+	do {
+		if (client->state == CLIENT_STREAMING && !client_has_pending(client)) {
+			if (client->kind == CLIENT_EVENTS)
+				client_next_event(client);
+			else
+				client_next_frame(client);
+		}
+		if (!client_has_pending(client))
+			return true;
+		if (!client_flush(client))
+			return false;
+	} while (!client_has_pending(client));
+
+	return true;
+}
+
+static void stream_log_stats(int64_t elapsed_us) {
+	if (!!stats.frames)
+		ESP_LOGI(APP_STREAM_TAG, "Stream: %u frames, %.2f send calls/frame, %u KB/s, %u KB/s saved",
+			stats.frames, (float)stats.send_calls / stats.frames, (uint32_t)(stats.bytes * 1000000 / elapsed_us / 1024),
+			(uint32_t)(stats.bytes_saved * 1000000 / elapsed_us / 1024));
+	memset(&stats, 0, sizeof(stats));
+}
+
+static void stream_task(void *pvParameters) {
+	fd_set rfds, wfds;
+	struct timeval tv;
+	uint8_t wake[8];
+	int maxfd;
+	int64_t now, stats_start = esp_timer_get_time();
+
+	for (;;) {
+		now = esp_timer_get_time();
+		if (now - stats_start >= STREAM_STATS_PERIOD_US) {
+			stream_log_stats(now - stats_start);
+			stats_start = now;
+		}
+
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_SET(listen_fd, &rfds);
+		FD_SET(wake_fd, &rfds);
+		maxfd = MAX(listen_fd, wake_fd);
+
+		for (int i = 0; i < CONFIG_CAM_STREAM_MAX_CLIENTS; i++) {
+			stream_client_t *client = &clients[i];
+			if (client->state == CLIENT_FREE)
+				continue;
+			FD_SET(client->fd, &rfds);
+			if (client_has_pending(client))
+				FD_SET(client->fd, &wfds);
+			maxfd = MAX(maxfd, client->fd);
+		}
+
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+		if (select(maxfd + 1, &rfds, &wfds, NULL, &tv) < 0) {
+			ESP_LOGE(APP_STREAM_TAG, "select() Failed: %d", errno);
+			vTaskDelay(100 / portTICK_PERIOD_MS);
+			continue;
+		}
+
+		if (FD_ISSET(wake_fd, &rfds))
+			while (recv(wake_fd, wake, sizeof(wake), 0) > 0);
+
+		if (FD_ISSET(listen_fd, &rfds))
+			client_accept();
+
+		for (int i = 0; i < CONFIG_CAM_STREAM_MAX_CLIENTS; i++) {
+			stream_client_t *client = &clients[i];
+			if (client->state == CLIENT_FREE)
+				continue;
+
+			if (FD_ISSET(client->fd, &rfds) && !client_read(client)) {
+				client_close(client);
+				continue;
+			}
+
+			if (!client_pump(client)) {
+				client_close(client);
+				continue;
+			}
+
+			if (client_has_pending(client)) {
+				client->queue_bytes = client_pending_bytes(client);
+				client_spill(client, esp_timer_get_time());
+			}
+		}
+	}
+	vTaskDelete(NULL);
+}
+
+int app_stream_get_clients(app_stream_client_info_t *infos, int max) {
+	int count = 0;
+	int64_t now = esp_timer_get_time();
+
+	portENTER_CRITICAL(&stream_mux);
+	for (int i = 0; i < CONFIG_CAM_STREAM_MAX_CLIENTS && count < max; i++) {
+		stream_client_t *client = &clients[i];
+		if (client->state != CLIENT_STREAMING || client->kind == CLIENT_EVENTS)
+			continue;
+
+		app_stream_client_info_t *info = &infos[count++];
+		info->ip = client->addr.sin_addr.s_addr;
+		info->port = ntohs(client->addr.sin_port);
+		info->uptime_ms = (now - client->connected_us) / 1000;
+		info->frames_sent = client->frames_sent;
+		info->frames_dropped = client->frames_dropped;
+		info->frames_spilled = client->frames_spilled;
+		info->bytes_sent = client->bytes_sent;
+		info->static_mode = client->static_mode;
+		info->frames_suppressed = client->frames_suppressed;
+		info->bytes_saved = client->bytes_saved;
+		info->transport = client->kind == CLIENT_WS ? APP_STREAM_WS : APP_STREAM_MJPEG;
+		info->ws_pending = client->ws_pending_count;
+		info->ack_ms = client->avg_ack_us / 1000;
+		info->queue_bytes = client->queue_bytes;
+		info->latency_ms = client->avg_latency_us / 1000;
+		info->fps = !!client->avg_interval_us ? 1000000.0f / client->avg_interval_us : 0;
+	}
+	portEXIT_CRITICAL(&stream_mux);
+
+	return count;
+}
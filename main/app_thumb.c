@@ -0,0 +1,151 @@
+/*
+ * app_thumb.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_camera.h"
+#include "esp_jpg_decode.h"
+#include "img_converters.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "app_common.h"
+#include "app_encode.h"
+#include "app_metrics.h"
+#include "app_thumb.h"
+
+#define THUMB_QUALITY 70
+
+typedef struct {
+	const uint8_t *src;
+	size_t src_len;
+	uint8_t *rgb;
+	uint16_t width;
+	uint16_t height;
+} thumb_decoder_t;
+
+static SemaphoreHandle_t thumb_lock = NULL;
+//one entry per reduced scale, JPG_SCALE_NONE is served by the capture endpoint
+static app_thumb_t thumbs[JPG_SCALE_MAX + 1];
+
+esp_err_t init_thumb_cache(void) {
+	memset(thumbs, 0, sizeof(thumbs));
+
+	APP_ERROR_CHECK_WITH_MSG(!!(thumb_lock = xSemaphoreCreateMutex()), "xSemaphoreCreateMutex() Failed", err_init);
+
+	return ESP_OK;
+err_init:
+	return ESP_FAIL;
+}
+
+static size_t thumb_read(void *arg, size_t index, uint8_t *buf, size_t len) {
+	thumb_decoder_t *d = (thumb_decoder_t *)arg;
+
+	if (index + len > d->src_len)
+		len = d->src_len - index;
+	if (!!buf)
+		memcpy(buf, d->src + index, len);
+
+	return len;
+}
+
+static bool thumb_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+	thumb_decoder_t *d = (thumb_decoder_t *)arg;
+
+	if (!data) {
+		//start of the decode reports the scaled output size
+		if (!x && !y) {
+			d->width = w;
+			d->height = h;
+			d->rgb = heap_caps_malloc(w * h * 3, MALLOC_CAP_SPIRAM);
+			if (!d->rgb)
+				d->rgb = heap_caps_malloc(w * h * 3, MALLOC_CAP_8BIT);
+			return !!d->rgb;
+		}
+		return true;
+	}
+
+	//esp_jpg_decode() goes on decoding whatever the start call returned
+	if (!d->rgb)
+		return false;
+
+	//the decoder emits RGB, fmt2jpg() expects RGB888 frames in BGR order
+	size_t stride = d->width * 3;
+	uint8_t *row = d->rgb + y * stride + x * 3;
+	for (uint16_t iy = 0; iy < h; iy++, row += stride) {
+		for (uint16_t ix = 0; ix < w * 3; ix += 3, data += 3) {
+			row[ix] = data[2];
+			row[ix + 1] = data[1];
+			row[ix + 2] = data[0];
+		}
+	}
+
+	return true;
+}
+
+static esp_err_t thumb_encode(app_frame_t *frame, jpg_scale_t scale, app_thumb_t *thumb) {
+	const app_encoded_t *encoded = NULL;
+	thumb_decoder_t d = {
+		.src = frame->fb->buf,
+		.src_len = frame->fb->len,
+		.rgb = NULL
+	};
+	int64_t encode_start = esp_timer_get_time();
+
+	//a raw frame is scaled from the JPEG its stream viewers share
+	if (frame->fb->format != PIXFORMAT_JPEG) {
+		APP_ERROR_CHECK_WITH_MSG(!!(encoded = app_encode_acquire(frame)), "No JPEG of the raw frame", err_encode);
+		d.src = encoded->buf;
+		d.src_len = encoded->len;
+	}
+
+	esp_err_t err = app_encode_decode(d.src_len, scale, thumb_read, thumb_write, &d);
+	app_encode_release(encoded);
+	APP_ERROR_CHECK_WITH_MSG(err == ESP_OK, "Scaled JPEG decode failed", err_encode);
+
+	if (!!thumb->buf) {
+		free(thumb->buf);
+		thumb->buf = NULL;
+		thumb->len = 0;
+	}
+
+	APP_ERROR_CHECK_WITH_MSG(fmt2jpg(d.rgb, d.width * d.height * 3, d.width, d.height, PIXFORMAT_RGB888, THUMB_QUALITY, &thumb->buf, &thumb->len), "Thumbnail JPEG encode failed", err_encode);
+
+	free(d.rgb);
+	thumb->width = d.width;
+	thumb->height = d.height;
+	thumb->seq = frame->seq;
+
+	app_metrics_observe(APP_METRICS_JPEG_ENCODE, esp_timer_get_time() - encode_start);
+
+	return ESP_OK;
+err_encode:
+	if (!!d.rgb) free(d.rgb);
+	thumb->seq = 0;
+	return ESP_FAIL;
+}
+
+const app_thumb_t *app_thumb_acquire(app_frame_t *frame, jpg_scale_t scale) {
+	app_thumb_t *thumb = &thumbs[scale];
+
+	xSemaphoreTake(thumb_lock, portMAX_DELAY);
+
+	if ((thumb->seq != frame->seq || !thumb->buf) && thumb_encode(frame, scale, thumb) != ESP_OK) {
+		xSemaphoreGive(thumb_lock);
+		return NULL;
+	}
+
+	return thumb;
+}
+
+void app_thumb_release(const app_thumb_t *thumb) {
+	if (!!thumb)
+		xSemaphoreGive(thumb_lock);
+}
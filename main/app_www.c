@@ -0,0 +1,208 @@
+/*
+ * app_www.c
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "esp_http_server.h"
+
+#include "app_common.h"
+#include "app_www.h"
+
+#define WWW_PACK_MAGIC 0x31575757 //"WWW1"
+#define WWW_PACK_FLAG_IMMUTABLE 0x0001
+
+#define WWW_INDEX "/index.html"
+#define WWW_PATH_MAX 128
+#define WWW_ETAG_LEN 16
+
+#define CACHE_CONTROL_IMMUTABLE "public, max-age=31536000, immutable"
+#define CACHE_CONTROL_REVALIDATE "no-cache"
+
+/* Layout written by tools/www_pack.py, offsets are relative to the image. */
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+	uint32_t image_len;
+	uint32_t reserved;
+} www_pack_header_t;
+
+typedef struct {
+	uint32_t path_off;
+	uint16_t path_len;
+	uint16_t flags;
+	uint32_t data_off;
+	uint32_t data_len;
+	uint32_t gz_off;
+	uint32_t gz_len;
+	uint32_t etag;
+} www_pack_entry_t;
+
+typedef struct {
+	const char *ext;
+	const char *type;
+} www_type_t;
+
+static const www_type_t types[] = {
+	{ ".html", "text/html" },
+	{ ".js", "application/javascript" },
+	{ ".css", "text/css" },
+	{ ".json", "application/json" },
+	{ ".svg", "image/svg+xml" },
+	{ ".png", "image/png" },
+	{ ".jpg", "image/jpeg" },
+	{ ".ico", "image/x-icon" },
+	{ ".woff2", "font/woff2" },
+	{ ".txt", "text/plain" },
+};
+
+//the whole image stays mapped, responses are sent straight from flash
+static const uint8_t *pack = NULL;
+static const www_pack_header_t *header = NULL;
+static const www_pack_entry_t *entries = NULL;
+
+static const www_pack_entry_t *www_lookup(const char *path, size_t len) {
+	int lo = 0, hi = (int)header->count - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		const www_pack_entry_t *entry = &entries[mid];
+		int cmp = memcmp(path, pack + entry->path_off, MIN(len, entry->path_len));
+
+		if (!cmp)
+			cmp = (int)len - (int)entry->path_len;
+		if (!cmp)
+			return entry;
+		if (cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+static void www_benchmark(void) {
+	char path[WWW_PATH_MAX];
+	int found = 0;
+
+	int64_t start = esp_timer_get_time();
+	for (uint32_t i = 0; i < header->count; i++) {
+		size_t len = MIN(entries[i].path_len, sizeof(path));
+		memcpy(path, pack + entries[i].path_off, len);
+		found += !!www_lookup(path, len);
+	}
+	int64_t elapsed = esp_timer_get_time() - start;
+
+	ESP_LOGI(APP_WWW_TAG, "%d/%u assets, %u bytes, lookup %uns avg", found, header->count, header->image_len,
+			header->count ? (uint32_t)(elapsed * 1000 / header->count) : 0);
+}
+
+esp_err_t init_www(void) {
+	const esp_partition_t *partition;
+	spi_flash_mmap_handle_t handle;
+	www_pack_header_t head;
+	const void *ptr;
+
+	APP_ERROR_CHECK_WITH_MSG(!!(partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, APP_WWW_PARTITION_SUBTYPE, APP_WWW_PARTITION_LABEL)), "Failed to find www partition", err_init);
+
+	//read the header first so only the pages the image uses get mapped
+	APP_ERROR_CHECK_WITH_MSG(esp_partition_read(partition, 0, &head, sizeof(head)) == ESP_OK, "Failed to read www header", err_init);
+	APP_ERROR_CHECK_WITH_MSG(head.magic == WWW_PACK_MAGIC, "www partition holds no asset pack", err_init);
+	APP_ERROR_CHECK_WITH_MSG(head.image_len <= partition->size && sizeof(head) + head.count * sizeof(www_pack_entry_t) <= head.image_len, "Corrupted asset pack", err_init);
+
+	APP_ERROR_CHECK_WITH_MSG(esp_partition_mmap(partition, 0, head.image_len, SPI_FLASH_MMAP_DATA, &ptr, &handle) == ESP_OK, "Failed to map www partition", err_init);
+
+	pack = (const uint8_t *)ptr;
+	header = (const www_pack_header_t *)pack;
+	entries = (const www_pack_entry_t *)(pack + sizeof(www_pack_header_t));
+
+	www_benchmark();
+
+	return ESP_OK;
+err_init:
+	return ESP_FAIL;
+}
+
+static const char *www_type(const char *path) {
+	const char *ext = strrchr(path, '.');
+
+	if (!!ext)
+		for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+			if (!strcasecmp(ext, types[i].ext))
+				return types[i].type;
+
+	return "application/octet-stream";
+}
+
+static bool www_accepts_gzip(httpd_req_t *req) {
+	char accept[64];
+
+	if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept)) != ESP_OK)
+		return false;
+
+	return !!strstr(accept, "gzip");
+}
+
+esp_err_t app_www_handler(httpd_req_t *req) {
+	char path[WWW_PATH_MAX];
+	char etag[WWW_ETAG_LEN];
+	const www_pack_entry_t *entry;
+
+	size_t len = strcspn(req->uri, "?#");
+	APP_ERROR_CHECK(!!pack, err_not_found);
+	APP_ERROR_CHECK(len > 0 && len + sizeof(WWW_INDEX) <= sizeof(path), err_not_found);
+
+	memcpy(path, req->uri, len);
+	path[len] = '\0';
+	if (path[len - 1] == '/') {
+		strcpy(path + len - 1, WWW_INDEX);
+		len = strlen(path);
+	}
+
+	//history mode routes like /monitor are rendered by index.html
+	if (!(entry = www_lookup(path, len))) {
+		APP_ERROR_CHECK(!strchr(strrchr(path, '/'), '.'), err_not_found);
+		strcpy(path, WWW_INDEX);
+		APP_ERROR_CHECK(!!(entry = www_lookup(path, strlen(path))), err_not_found);
+	}
+
+	httpd_resp_set_type(req, www_type(path));
+	httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+	bool gzip = !!entry->gz_len && www_accepts_gzip(req);
+	if (gzip)
+		httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+
+	if (entry->flags & WWW_PACK_FLAG_IMMUTABLE) {
+		httpd_resp_set_hdr(req, "Cache-Control", CACHE_CONTROL_IMMUTABLE);
+	} else {
+		char if_none_match[WWW_ETAG_LEN];
+
+		snprintf(etag, sizeof(etag), "\"%08x%s\"", entry->etag, gzip ? "-gz" : "");
+		httpd_resp_set_hdr(req, "Cache-Control", CACHE_CONTROL_REVALIDATE);
+		httpd_resp_set_hdr(req, "ETag", etag);
+
+		if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK && !strcmp(if_none_match, etag)) {
+			httpd_resp_set_status(req, "304 Not Modified");
+			return httpd_resp_send(req, NULL, 0);
+		}
+	}
+
+	if (gzip)
+		return httpd_resp_send(req, (const char *)pack + entry->gz_off, entry->gz_len);
+
+	return httpd_resp_send(req, (const char *)pack + entry->data_off, entry->data_len);
+err_not_found:
+	return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
+}
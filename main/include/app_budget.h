@@ -0,0 +1,58 @@
+/*
+ * app_budget.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sensor.h"
+
+#define APP_BUDGET_TAG "app_budget"
+
+/* Memory the frame buffers may use, read once per plan. */
+typedef struct {
+	size_t heap_free;
+	size_t heap_largest;
+	//bytes the current buffers give back when the pool is resized
+	size_t pool_len;
+	uint8_t fb_count;
+	bool psram;
+} app_budget_t;
+
+/*
+ * What one framesize costs from a given quality on: quality is that one
+ * or the first higher value whose JPEG estimate fits a buffer, and the
+ * lengths are the ones the driver allocates at it.
+ */
+typedef struct {
+	framesize_t framesize;
+	int quality;
+	size_t buffer_len;
+	size_t jpeg_len;
+	bool fits;
+} app_budget_entry_t;
+
+void app_budget_snapshot(app_budget_t *budget);
+
+void app_budget_entry(const app_budget_t *budget, framesize_t framesize, int quality, app_budget_entry_t *entry);
+
+/*
+ * Lowers framesize until its buffers fit and raises quality until the
+ * estimated JPEG fits one buffer. ESP_ERR_NO_MEM when not even the
+ * smallest framesize fits.
+ */
+esp_err_t app_budget_plan(framesize_t *framesize, int *quality);
+
+#ifdef __cplusplus
+}
+#endif
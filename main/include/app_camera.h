@@ -11,6 +11,8 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
 #include "sensor.h"
 
@@ -66,8 +68,47 @@ extern "C" {
 
 #define APP_CAMERA_TAG "app_camera"
 
+/*
+ * Describes one sensor control accepted by /api/v1/cam/control. The setter
+ * and the status field are stored as offsets into sensor_t and
+ * camera_status_t so the whole table is built at compile time.
+ */
+typedef struct {
+    const char *name;
+    int min;
+    int max;
+    bool jpeg_only;
+    size_t setter;
+    size_t status;
+    uint8_t status_size;
+} app_camera_control_t;
+
 esp_err_t init_camera(void);
 
+/* Changes whenever a sensor setting is written, survives no reboot. */
+uint32_t app_camera_settings_version(void);
+
+void app_camera_settings_changed(void);
+
+/* Controls in apply order, the ones others depend on come first. */
+const app_camera_control_t *app_camera_controls(size_t *count);
+
+/* Index of the control in app_camera_controls(), -1 when unknown. */
+int app_camera_control_find(const char *name);
+
+bool app_camera_control_valid(const sensor_t *sensor, const app_camera_control_t *control, int val);
+
+int app_camera_control_get(const sensor_t *sensor, const app_camera_control_t *control);
+
+/*
+ * Changing framesize may restart the driver through app_fb_pool_resize(),
+ * fetch the sensor again with esp_camera_sensor_get() afterwards.
+ */
+int app_camera_control_set(sensor_t *sensor, const app_camera_control_t *control, int val);
+
+/* Writes back every control in status that differs from the sensor. */
+void app_camera_restore(sensor_t *sensor, const camera_status_t *status);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,54 @@
+/*
+ * app_encode.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_jpg_decode.h"
+
+#include "app_frame.h"
+
+#define APP_ENCODE_TAG "app_encode"
+
+/*
+ * JPEG of a raw frame, kept in a buffer that is reused for later frames
+ * once every reader has released it.
+ */
+typedef struct {
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+	uint32_t seq;
+	uint32_t refs;
+} app_encoded_t;
+
+esp_err_t init_encode_pool(void);
+
+/*
+ * Returns the JPEG of a RGB565, YUV422 or grayscale frame. The frame is
+ * encoded by the first caller, later callers for the same sequence share
+ * the result. NULL when every buffer is still being read.
+ */
+const app_encoded_t *app_encode_acquire(app_frame_t *frame);
+
+void app_encode_release(const app_encoded_t *encoded);
+
+/*
+ * esp_jpg_decode() works in a static buffer, every decoder in the
+ * firmware goes through here so only one runs at a time.
+ */
+esp_err_t app_encode_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
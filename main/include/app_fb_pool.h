@@ -0,0 +1,76 @@
+/*
+ * app_fb_pool.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "sdkconfig.h"
+
+#define APP_FB_POOL_TAG "app_fb_pool"
+
+#if CONFIG_CAM_FB_MAX_FRAMESIZE_QVGA
+#define APP_FB_POOL_MAX_FRAMESIZE FRAMESIZE_QVGA
+#elif CONFIG_CAM_FB_MAX_FRAMESIZE_VGA
+#define APP_FB_POOL_MAX_FRAMESIZE FRAMESIZE_VGA
+#elif CONFIG_CAM_FB_MAX_FRAMESIZE_SVGA
+#define APP_FB_POOL_MAX_FRAMESIZE FRAMESIZE_SVGA
+#elif CONFIG_CAM_FB_MAX_FRAMESIZE_XGA
+#define APP_FB_POOL_MAX_FRAMESIZE FRAMESIZE_XGA
+#elif CONFIG_CAM_FB_MAX_FRAMESIZE_SXGA
+#define APP_FB_POOL_MAX_FRAMESIZE FRAMESIZE_SXGA
+#else
+#define APP_FB_POOL_MAX_FRAMESIZE FRAMESIZE_UXGA
+#endif
+
+typedef struct {
+	uint8_t count;
+	uint8_t in_use;
+	framesize_t framesize;
+	framesize_t max_framesize;
+	size_t buffer_len;
+	bool psram;
+	bool latest_only;
+	uint32_t resizes;
+} app_fb_pool_stats_t;
+
+/*
+ * Starts the camera driver with the pins and clock in config and the
+ * buffer count, placement and grab policy from Kconfig. The buffers are
+ * sized for config->frame_size, capped at APP_FB_POOL_MAX_FRAMESIZE,
+ * and config->jpeg_quality.
+ */
+esp_err_t init_fb_pool(const camera_config_t *config);
+
+/*
+ * Restarts the driver with buffers sized for framesize, keeping the
+ * sensor controls. Register, PLL and window settings are lost. When the
+ * new buffers do not fit the old ones are allocated again.
+ */
+esp_err_t app_fb_pool_resize(framesize_t framesize);
+
+/*
+ * Sets the JPEG quality, restarting the driver like app_fb_pool_resize()
+ * when the quality crosses one of the steps the buffers are sized by.
+ */
+esp_err_t app_fb_pool_set_quality(int quality);
+
+/* Bytes the driver allocates for one buffer at framesize and quality. */
+size_t app_fb_pool_buffer_len(framesize_t framesize, int quality);
+
+void app_fb_pool_stats(app_fb_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+/*
+ * app_frame.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "sdkconfig.h"
+
+#define APP_FRAME_TAG "app_frame"
+
+#define APP_FRAME_MAX_LISTENERS 8
+
+//capture and its senders share a core, conversion and analysis get the other one
+#if CONFIG_CAMERA_CORE1
+#define APP_FRAME_CAPTURE_CORE APP_CPU_NUM
+#define APP_FRAME_PROCESS_CORE PRO_CPU_NUM
+#else
+#define APP_FRAME_CAPTURE_CORE PRO_CPU_NUM
+#define APP_FRAME_PROCESS_CORE APP_CPU_NUM
+#endif
+#define APP_FRAME_ETAG_LEN 24
+
+/*
+ * A captured frame shared by every reader. The driver buffer goes back
+ * to the camera when the last reference is released.
+ */
+typedef struct {
+	camera_fb_t *fb;
+	uint32_t seq;
+	uint32_t refs;
+	int64_t published_us;
+} app_frame_t;
+
+/* Called from the capture task every time a new frame is published. */
+typedef void (*app_frame_cb_t)(void *arg);
+
+esp_err_t init_frame_hub(void);
+
+esp_err_t app_frame_subscribe(app_frame_cb_t cb, void *arg);
+
+void app_frame_unsubscribe(app_frame_cb_t cb, void *arg);
+
+app_frame_t *app_frame_acquire(void);
+
+void app_frame_release(app_frame_t *frame);
+
+uint32_t app_frame_latest_seq(void);
+
+app_frame_t *app_frame_get(uint32_t max_age_ms, uint32_t timeout_ms);
+
+uint32_t app_frame_age_ms(const app_frame_t *frame);
+
+size_t app_frame_etag(const app_frame_t *frame, const char *suffix, char *etag, size_t len);
+
+/* Driver frame buffers currently held by the hub and its readers. */
+int app_frame_held(void);
+
+/*
+ * Stops capturing and waits until every driver buffer is back with the
+ * camera, so the driver can be restarted. Resumes on its own when the
+ * buffers are not returned in time.
+ */
+esp_err_t app_frame_pause(uint32_t timeout_ms);
+
+void app_frame_resume(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -11,12 +11,16 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include "esp_err.h"
 
 #define APP_HTTPD_TAG "app_httpd"
 
 esp_err_t init_server(const char *base_path);
 
+/* Port the API server listens on, 0 before init_server(). */
+uint16_t app_httpd_port(void);
+
 #ifdef __cplusplus
 }
 #endif
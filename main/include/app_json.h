@@ -0,0 +1,69 @@
+/*
+ * app_json.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define APP_JSON_TAG "app_json"
+
+#define APP_JSON_MAX_DEPTH 8
+
+/* Receives the serialized JSON whenever the buffer fills up. */
+typedef esp_err_t (*app_json_flush_t)(void *arg, const char *data, size_t len);
+
+/*
+ * Serializes JSON straight into a caller owned buffer, nothing is
+ * allocated. Errors are sticky: after the first failure every call is a
+ * no-op and app_json_end() reports it.
+ */
+typedef struct {
+	char *buf;
+	size_t size;
+	size_t len;
+	app_json_flush_t flush;
+	void *arg;
+	bool flushed;
+	uint8_t depth;
+	uint8_t has_items;
+	esp_err_t err;
+} app_json_t;
+
+/* flush may be NULL, then the document has to fit in buf. */
+void app_json_init(app_json_t *json, char *buf, size_t size, app_json_flush_t flush, void *arg);
+
+/* key is NULL at the root and inside arrays. */
+void app_json_object_start(app_json_t *json, const char *key);
+
+void app_json_object_end(app_json_t *json);
+
+void app_json_array_start(app_json_t *json, const char *key);
+
+void app_json_array_end(app_json_t *json);
+
+void app_json_string(app_json_t *json, const char *key, const char *val);
+
+void app_json_int(app_json_t *json, const char *key, int64_t val);
+
+/* val in units of 10^-decimals, written as a decimal fraction. */
+void app_json_fixed(app_json_t *json, const char *key, int64_t val, uint8_t decimals);
+
+void app_json_bool(app_json_t *json, const char *key, bool val);
+
+/* The unflushed tail stays in buf, json->len bytes long. */
+esp_err_t app_json_end(app_json_t *json);
+
+#ifdef __cplusplus
+}
+#endif
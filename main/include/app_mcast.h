@@ -0,0 +1,26 @@
+/*
+ * app_mcast.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_err.h"
+
+#define APP_MCAST_TAG "app_mcast"
+
+#define APP_MCAST_VERSION 1
+//see app_mcast.c and tools/mcast_receiver.py for the layout
+#define APP_MCAST_HEADER_LEN 24
+
+esp_err_t init_mcast(void);
+
+#ifdef __cplusplus
+}
+#endif
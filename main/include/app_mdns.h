@@ -12,12 +12,26 @@ extern "C" {
 #endif
 
 #include <string.h>
+#include <stdint.h>
 #include "esp_err.h"
-#include "cJSON.h"
 
 #define APP_MDNS_TAG "app_mdns"
 
-void app_mdns_query(cJSON* resp_json_data);
+/*
+ * Serialized JSON array with this camera and the ones found on the
+ * network. Published snapshots are never modified, a new one replaces
+ * them whenever the list changes.
+ */
+typedef struct {
+	uint32_t refs;
+	uint32_t version;
+	size_t len;
+	char body[];
+} app_mdns_snapshot_t;
+
+const app_mdns_snapshot_t *app_mdns_snapshot_acquire(void);
+
+void app_mdns_snapshot_release(const app_mdns_snapshot_t *snapshot);
 
 esp_err_t app_mdns_update_framesize(const int size);
 
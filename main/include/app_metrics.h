@@ -0,0 +1,65 @@
+/*
+ * app_metrics.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define APP_METRICS_TAG "app_metrics"
+
+typedef enum {
+	APP_METRICS_CAPTURE_WAIT = 0,
+	APP_METRICS_JPEG_ENCODE,
+	APP_METRICS_FRAME_SEND,
+	APP_METRICS_CONTROL_APPLY,
+	APP_METRICS_FRAME_PROCESS,
+	APP_METRICS_MOTION_ANALYSE,
+	APP_METRICS_HISTOGRAMS
+} app_metrics_histogram_t;
+
+typedef enum {
+	APP_METRICS_FRAMES_SERVED = 0,
+	APP_METRICS_FRAMES_DROPPED,
+	APP_METRICS_BYTES_SENT,
+	APP_METRICS_SENSOR_WRITES,
+	APP_METRICS_FRAMES_CAPTURED,
+	APP_METRICS_FRAMES_PROCESSED,
+	APP_METRICS_MOTION_EVENTS,
+	APP_METRICS_FRAMES_SUPPRESSED,
+	APP_METRICS_BYTES_SAVED,
+	APP_METRICS_MCAST_FRAMES,
+	APP_METRICS_COUNTERS
+} app_metrics_counter_t;
+
+typedef enum {
+	APP_METRICS_STREAM_CLIENTS = 0,
+	APP_METRICS_FB_IN_USE,
+	APP_METRICS_MOTION_SCORE,
+	APP_METRICS_RTSP_SESSIONS,
+	APP_METRICS_GAUGES
+} app_metrics_gauge_t;
+
+/* Receives the rendered Prometheus text, one piece at a time. */
+typedef esp_err_t (*app_metrics_writer_t)(void *arg, const char *data, size_t len);
+
+void app_metrics_observe(app_metrics_histogram_t histogram, uint32_t us);
+
+void app_metrics_add(app_metrics_counter_t counter, uint32_t val);
+
+void app_metrics_set(app_metrics_gauge_t gauge, int32_t val);
+
+esp_err_t app_metrics_render(app_metrics_writer_t writer, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,103 @@
+/*
+ * app_motion.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "app_json.h"
+
+#define APP_MOTION_TAG "app_motion"
+
+#define APP_MOTION_GRID_W 16
+#define APP_MOTION_GRID_H 12
+#define APP_MOTION_EVENTS 16
+#define APP_MOTION_MAX_LISTENERS 4
+
+typedef enum {
+	APP_MOTION_START = 0,
+	APP_MOTION_END
+} app_motion_event_type_t;
+
+/* Blocks of the grid, inclusive on both ends. */
+typedef struct {
+	uint8_t x0;
+	uint8_t y0;
+	uint8_t x1;
+	uint8_t y1;
+} app_motion_box_t;
+
+typedef struct {
+	uint32_t seq;
+	uint32_t uptime_ms;
+	uint8_t score;
+	bool active;
+	uint16_t changed;
+	app_motion_box_t box;
+	uint16_t rows[APP_MOTION_GRID_H]; //one bit per changed block, bit 0 is the leftmost
+	uint32_t frames;
+	uint32_t skipped;
+	uint32_t analyse_us;
+} app_motion_status_t;
+
+/* An END event carries the peak score and the box covering the whole event. */
+typedef struct {
+	uint32_t id;
+	app_motion_event_type_t type;
+	uint32_t seq;
+	uint32_t uptime_ms;
+	uint8_t score;
+	app_motion_box_t box;
+} app_motion_event_t;
+
+typedef struct {
+	bool enabled;
+	uint8_t threshold;
+	uint8_t trigger;
+	uint32_t hold_ms;
+} app_motion_config_t;
+
+/* Called from the motion task every time an event is recorded. */
+typedef void (*app_motion_cb_t)(void *arg);
+
+esp_err_t init_motion(void);
+
+void app_motion_get_config(app_motion_config_t *config);
+
+esp_err_t app_motion_set_config(const app_motion_config_t *config);
+
+void app_motion_get_status(app_motion_status_t *status);
+
+/*
+ * Keeps the frames analysed while motion detection is disabled, so the
+ * status still reports changed grid blocks. No events are recorded for
+ * such frames. Every hold takes one app_motion_release().
+ */
+esp_err_t app_motion_hold(void);
+
+void app_motion_release(void);
+
+/* Copies up to max events newer than since_id, oldest first. */
+int app_motion_get_events(uint32_t since_id, app_motion_event_t *events, int max);
+
+uint32_t app_motion_last_event_id(void);
+
+esp_err_t app_motion_subscribe(app_motion_cb_t cb, void *arg);
+
+void app_motion_unsubscribe(app_motion_cb_t cb, void *arg);
+
+void app_motion_event_json(app_json_t *json, const char *key, const app_motion_event_t *event);
+
+#ifdef __cplusplus
+}
+#endif
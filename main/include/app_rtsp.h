@@ -0,0 +1,28 @@
+/*
+ * app_rtsp.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "app_stream.h"
+
+#define APP_RTSP_TAG "app_rtsp"
+
+esp_err_t init_rtsp_server(uint16_t port);
+
+/* Sessions with a transport set up, listed the same way as the stream clients. */
+int app_rtsp_get_clients(app_stream_client_info_t *infos, int max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,41 @@
+/*
+ * app_spsc.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Bounded queue between exactly one producer task and one consumer task,
+ * possibly on different cores. Neither side takes a lock, head is only
+ * written by the producer and tail only by the consumer.
+ */
+typedef struct {
+	void **slots;
+	uint32_t size;
+	uint32_t head;
+	uint32_t tail;
+} app_spsc_t;
+
+void app_spsc_init(app_spsc_t *queue, void **slots, uint32_t size);
+
+/* Producer side, false when the queue is full. */
+bool app_spsc_push(app_spsc_t *queue, void *item);
+
+/* Consumer side, NULL when the queue is empty. */
+void *app_spsc_pop(app_spsc_t *queue);
+
+uint32_t app_spsc_count(const app_spsc_t *queue);
+
+#ifdef __cplusplus
+}
+#endif
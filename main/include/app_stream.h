@@ -0,0 +1,52 @@
+/*
+ * app_stream.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define APP_STREAM_TAG "app_stream"
+
+typedef enum {
+	APP_STREAM_MJPEG = 0,
+	APP_STREAM_WS,
+	APP_STREAM_RTSP_UDP,
+	APP_STREAM_RTSP_TCP
+} app_stream_transport_t;
+
+typedef struct {
+	uint32_t ip;
+	uint16_t port;
+	uint32_t uptime_ms;
+	uint32_t frames_sent;
+	uint32_t frames_dropped;
+	uint32_t frames_spilled;
+	uint32_t frames_suppressed;
+	uint64_t bytes_sent;
+	uint64_t bytes_saved;
+	bool static_mode;
+	app_stream_transport_t transport;
+	uint8_t ws_pending;
+	uint32_t ack_ms;
+	uint32_t queue_bytes;
+	uint32_t latency_ms;
+	float fps;
+} app_stream_client_info_t;
+
+esp_err_t init_stream_server(uint16_t port);
+
+int app_stream_get_clients(app_stream_client_info_t *infos, int max);
+
+#ifdef __cplusplus
+}
+#endif
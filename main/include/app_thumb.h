@@ -0,0 +1,45 @@
+/*
+ * app_thumb.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_jpg_decode.h"
+
+#include "app_frame.h"
+
+#define APP_THUMB_TAG "app_thumb"
+
+typedef struct {
+	uint8_t *buf;
+	size_t len;
+	uint16_t width;
+	uint16_t height;
+	uint32_t seq;
+} app_thumb_t;
+
+esp_err_t init_thumb_cache(void);
+
+/*
+ * Returns the thumbnail of the frame at the given scale, encoding it only
+ * when the cache holds an older sequence. Raw frames are scaled from
+ * their pooled JPEG, see app_encode_acquire(). The cache stays locked
+ * until app_thumb_release().
+ */
+const app_thumb_t *app_thumb_acquire(app_frame_t *frame, jpg_scale_t scale);
+
+void app_thumb_release(const app_thumb_t *thumb);
+
+#ifdef __cplusplus
+}
+#endif
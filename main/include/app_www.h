@@ -0,0 +1,33 @@
+/*
+ * app_www.h
+ *
+ *  Created on: 17 de out de 2026
+ *      Author: ceanm
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define APP_WWW_TAG "app_www"
+
+#define APP_WWW_PARTITION_LABEL "www"
+#define APP_WWW_PARTITION_SUBTYPE 0x40
+
+/* Maps the asset pack written by tools/www_pack.py into the data address space. */
+esp_err_t init_www(void);
+
+/*
+ * Serves the front-end out of the mapped asset pack. Prefers the
+ * build-time gzip copy of an asset when the client accepts it.
+ */
+esp_err_t app_www_handler(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,390 @@
+#!/usr/bin/env python
+#
+# Load generator for the camera HTTP API. Replays a workload profile
+# against a camera, or the host build in host/, and reports per endpoint
+# latency percentiles and error rates, and the fps every stream client got.
+#
+# usage: cam_bench.py <host[:port]> [--profile <name or file.json>]
+#                     [--duration <s>] [--streams <n>] [--stream-port <port>]
+#                     [--json <file or ->] [--max-error-rate <ratio>]
+#
+# A profile is a list of workloads, each run by its own threads:
+#   {"kind": "stream", "clients": 2, "query": "mode=static"}
+#       readers of /cam/stream on the stream port, every part is counted
+#   {"kind": "poll", "name": "capture", "method": "GET",
+#    "path": "/api/v1/cam/capture?max_age_ms=1000",
+#    "clients": 1, "interval": 1.0, "burst": 1, "bodies": [{...}, ...]}
+#       requests on a keep-alive connection, burst of them back to back
+#       every interval seconds, the POST bodies taken in turn
+# --profile takes one of PROFILES or a JSON file holding such a list.
+#
+# --json writes the results for tracking regressions between builds; the
+# exit status is 1 when an endpoint fails more than --max-error-rate.
+
+import argparse
+import http.client
+import json
+import socket
+import sys
+import threading
+import time
+
+DEFAULT_PORT = 80
+DEFAULT_STREAM_PORT = 81
+STREAM_PATH = '/cam/stream'
+# a request or a stream read waiting longer than this is an error
+TIMEOUT = 10.0
+
+PROFILES = {
+    # what one open Monitor page does: the selected camera streaming,
+    # the thumbnails, status and mdns timers
+    'ui': [
+        {'kind': 'stream', 'clients': 1},
+        {'kind': 'poll', 'name': 'capture', 'path': '/api/v1/cam/capture?max_age_ms=1000', 'interval': 1.0},
+        {'kind': 'poll', 'name': 'thumbnail', 'path': '/api/v1/cam/thumbnail?scale=1/4&max_age_ms=1000', 'interval': 1.0},
+        {'kind': 'poll', 'name': 'status', 'path': '/api/v1/cam/status', 'interval': 2.0},
+        {'kind': 'poll', 'name': 'mdns', 'path': '/api/v1/mdns', 'interval': 10.0},
+    ],
+    'viewers': [
+        {'kind': 'stream', 'clients': 4},
+    ],
+    'thumbnails': [
+        {'kind': 'poll', 'name': 'capture', 'path': '/api/v1/cam/capture?max_age_ms=200', 'clients': 4, 'interval': 0.2},
+        {'kind': 'poll', 'name': 'thumbnail', 'path': '/api/v1/cam/thumbnail?scale=1/4&max_age_ms=200', 'clients': 2, 'interval': 0.2},
+    ],
+    'control': [
+        {'kind': 'stream', 'clients': 1},
+        {'kind': 'poll', 'name': 'control', 'method': 'POST', 'path': '/api/v1/cam/control', 'interval': 1.0, 'burst': 10,
+         'bodies': [{'quality': 10}, {'quality': 12}, {'brightness': 1}, {'brightness': 0}]},
+    ],
+    'mdns': [
+        {'kind': 'poll', 'name': 'mdns', 'path': '/api/v1/mdns', 'clients': 4, 'interval': 0.1},
+    ],
+    'mixed': [
+        {'kind': 'stream', 'clients': 4},
+        {'kind': 'poll', 'name': 'capture', 'path': '/api/v1/cam/capture?max_age_ms=1000', 'clients': 2, 'interval': 0.5},
+        {'kind': 'poll', 'name': 'thumbnail', 'path': '/api/v1/cam/thumbnail?scale=1/4&max_age_ms=1000', 'clients': 2, 'interval': 0.5},
+        {'kind': 'poll', 'name': 'status', 'path': '/api/v1/cam/status', 'interval': 1.0},
+        {'kind': 'poll', 'name': 'control', 'method': 'POST', 'path': '/api/v1/cam/control', 'interval': 2.0, 'burst': 5,
+         'bodies': [{'quality': 10}, {'quality': 12}]},
+        {'kind': 'poll', 'name': 'mdns', 'path': '/api/v1/mdns', 'interval': 2.0},
+    ],
+}
+
+
+def percentile(values, p):
+    """Nearest rank percentile of sorted values, None when there are none."""
+    if not values:
+        return None
+    rank = max(int(round(p / 100.0 * len(values) + 0.5)) - 1, 0)
+    return values[min(rank, len(values) - 1)]
+
+
+def summarize_ms(samples):
+    values = sorted(samples)
+    summary = {'count': len(values)}
+    for p in (50, 90, 99):
+        v = percentile(values, p)
+        summary['p%d_ms' % p] = None if v is None else round(v * 1000, 2)
+    summary['max_ms'] = round(values[-1] * 1000, 2) if values else None
+    summary['mean_ms'] = round(sum(values) / len(values) * 1000, 2) if values else None
+    return summary
+
+
+class EndpointStats(object):
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies = []
+        self.errors = 0
+        self.statuses = {}
+        self.bytes = 0
+
+    def record(self, latency, status, length):
+        with self.lock:
+            self.latencies.append(latency)
+            self.statuses[status] = self.statuses.get(status, 0) + 1
+            self.bytes += length
+            if status >= 400:
+                self.errors += 1
+
+    def record_error(self, reason):
+        with self.lock:
+            self.errors += 1
+            self.statuses[reason] = self.statuses.get(reason, 0) + 1
+
+    def result(self, duration):
+        with self.lock:
+            requests = sum(self.statuses.values())
+            result = summarize_ms(self.latencies)
+            result.update({
+                'requests': requests,
+                'errors': self.errors,
+                'error_rate': round(float(self.errors) / requests, 4) if requests else 0.0,
+                'rate_per_s': round(requests / duration, 2),
+                'kbytes_per_s': round(self.bytes / duration / 1024, 1),
+                'statuses': dict((str(k), v) for k, v in self.statuses.items()),
+            })
+            return result
+
+
+class Poller(threading.Thread):
+    """Requests one endpoint on a keep-alive connection, reconnecting after errors."""
+
+    def __init__(self, host, port, spec, stats, stop):
+        threading.Thread.__init__(self)
+        self.daemon = True
+        self.host, self.port = host, port
+        self.method = spec.get('method', 'GET')
+        self.path = spec['path']
+        self.interval = float(spec.get('interval', 1.0))
+        self.burst = int(spec.get('burst', 1))
+        self.bodies = [json.dumps(b) for b in spec.get('bodies', [])]
+        self.stats = stats
+        self.stop = stop
+        self.conn = None
+        self.sent = 0
+
+    def request(self):
+        if self.conn is None:
+            self.conn = http.client.HTTPConnection(self.host, self.port, timeout=TIMEOUT)
+        body, headers = None, {}
+        if self.bodies:
+            body = self.bodies[self.sent % len(self.bodies)]
+            headers['Content-Type'] = 'application/json'
+        self.sent += 1
+
+        start = time.time()
+        try:
+            self.conn.request(self.method, self.path, body, headers)
+            resp = self.conn.getresponse()
+            data = resp.read()
+        except socket.timeout:
+            self.stats.record_error('timeout')
+        except (socket.error, http.client.HTTPException) as e:
+            self.stats.record_error(type(e).__name__)
+        else:
+            self.stats.record(time.time() - start, resp.status, len(data))
+            if not resp.will_close:
+                return
+        self.conn.close()
+        self.conn = None
+
+    def run(self):
+        next_at = time.time()
+        while not self.stop.is_set():
+            for _ in range(self.burst):
+                if self.stop.is_set():
+                    break
+                self.request()
+            # a slow server makes the poller fall behind, never catch up in a rush
+            next_at = max(next_at + self.interval, time.time())
+            self.stop.wait(next_at - time.time())
+        if self.conn is not None:
+            self.conn.close()
+
+
+class StreamReader(threading.Thread):
+    """Reads a multipart stream and times every part it delivers."""
+
+    def __init__(self, host, port, query, stats, stop):
+        threading.Thread.__init__(self)
+        self.daemon = True
+        self.host, self.port = host, port
+        self.path = STREAM_PATH + ('?' + query if query else '')
+        self.stats = stats
+        self.stop = stop
+        self.frames = 0
+        self.bytes = 0
+        self.gaps = []
+        self.first_frame = None
+        self.reconnects = 0
+        self.error = None
+        self.buf = b''
+
+    def _read_until(self, sock, marker):
+        while marker not in self.buf:
+            data = sock.recv(65536)
+            if not data:
+                raise EOFError('stream closed')
+            self.buf += data
+        head, self.buf = self.buf.split(marker, 1)
+        return head
+
+    def _read_exactly(self, sock, length):
+        while len(self.buf) < length:
+            data = sock.recv(max(65536, length - len(self.buf)))
+            if not data:
+                raise EOFError('stream closed')
+            self.buf += data
+        data, self.buf = self.buf[:length], self.buf[length:]
+        return data
+
+    def _stream(self):
+        start = time.time()
+        sock = socket.create_connection((self.host, self.port), TIMEOUT)
+        sock.settimeout(TIMEOUT)
+        self.buf = b''
+        try:
+            sock.sendall(('GET %s HTTP/1.1\r\nHost: %s\r\n\r\n' % (self.path, self.host)).encode())
+            status = self._read_until(sock, b'\r\n\r\n').split(b'\r\n', 1)[0].split()
+            if len(status) < 2 or status[1] != b'200':
+                self.stats.record_error('HTTP %s' % (status[1].decode() if len(status) > 1 else '?'))
+                self.reconnects += 1
+                self.stop.wait(1.0)
+                return
+            last = None
+            while not self.stop.is_set():
+                headers = self._read_until(sock, b'\r\n\r\n')
+                length = None
+                for line in headers.split(b'\r\n'):
+                    name, _, value = line.partition(b':')
+                    if name.strip().lower() == b'content-length':
+                        length = int(value)
+                if length is None:
+                    continue
+                self._read_exactly(sock, length)
+                now = time.time()
+                if last is None:
+                    # time to the first frame is the latency a viewer sees
+                    self.stats.record(now - start, 200, length)
+                    if self.first_frame is None:
+                        self.first_frame = now - start
+                else:
+                    self.gaps.append(now - last)
+                    with self.stats.lock:
+                        self.stats.bytes += length
+                last = now
+                self.frames += 1
+                self.bytes += length
+        finally:
+            sock.close()
+
+    def run(self):
+        while not self.stop.is_set():
+            try:
+                self._stream()
+            except (socket.error, EOFError, ValueError) as e:
+                if self.stop.is_set():
+                    break
+                self.error = str(e)
+                self.stats.record_error(type(e).__name__)
+                self.reconnects += 1
+                self.stop.wait(1.0)
+
+    def result(self, duration):
+        result = {
+            'frames': self.frames,
+            'fps': round(self.frames / duration, 2),
+            'kbytes_per_s': round(self.bytes / duration / 1024, 1),
+            'first_frame_ms': None if self.first_frame is None else round(self.first_frame * 1000, 2),
+            'reconnects': self.reconnects,
+            'frame_gap': summarize_ms(self.gaps),
+        }
+        if self.error:
+            result['last_error'] = self.error
+        return result
+
+
+def load_profile(name):
+    if name in PROFILES:
+        return PROFILES[name]
+    with open(name) as f:
+        return json.load(f)
+
+
+def discover_stream_port(host, port):
+    """Stream port the camera announces in its own mdns entry."""
+    try:
+        conn = http.client.HTTPConnection(host, port, timeout=TIMEOUT)
+        conn.request('GET', '/api/v1/mdns')
+        cams = json.loads(conn.getresponse().read().decode())
+        conn.close()
+        return int(cams[0]['txt']['stream_port'])
+    except (socket.error, http.client.HTTPException, ValueError, LookupError, TypeError):
+        return DEFAULT_STREAM_PORT
+
+
+def print_report(report):
+    print('%s, profile %s, %.1f s' % (report['target'], report['profile'], report['duration_s']))
+    print('%-12s %8s %7s %9s %9s %9s %9s %8s' % ('endpoint', 'requests', 'errors', 'p50 ms', 'p90 ms', 'p99 ms', 'max ms', 'req/s'))
+    fmt = lambda v: '-' if v is None else '%.1f' % v
+    for name, ep in sorted(report['endpoints'].items()):
+        print('%-12s %8u %7u %9s %9s %9s %9s %8.1f' % (name, ep['requests'], ep['errors'], fmt(ep['p50_ms']),
+                                                      fmt(ep['p90_ms']), fmt(ep['p99_ms']), fmt(ep['max_ms']), ep['rate_per_s']))
+    for i, client in enumerate(report['streams']):
+        print('stream %-5u %.1f fps, %u KB/s, first frame %s ms, gap p99 %s ms, %u reconnects' % (
+            i, client['fps'], client['kbytes_per_s'], fmt(client['first_frame_ms']), fmt(client['frame_gap']['p99_ms']),
+            client['reconnects']))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the camera HTTP API with a workload profile')
+    parser.add_argument('target', help='host[:port] of the camera API')
+    parser.add_argument('--profile', default='ui', help='one of %s, or a JSON file' % ', '.join(sorted(PROFILES)))
+    parser.add_argument('--duration', type=float, default=30, help='seconds to run')
+    parser.add_argument('--streams', type=int, help='stream clients, in place of the ones of the profile')
+    parser.add_argument('--stream-port', type=int, help='stream port, taken from /api/v1/mdns by default')
+    parser.add_argument('--json', help='file to write the results to, - for stdout')
+    parser.add_argument('--max-error-rate', type=float, default=0.01,
+                        help='exit with 1 when an endpoint fails more often than this')
+    args = parser.parse_args()
+
+    host, _, port = args.target.partition(':')
+    port = int(port) if port else DEFAULT_PORT
+    profile = load_profile(args.profile)
+    stream_port = args.stream_port or discover_stream_port(host, port)
+
+    stop = threading.Event()
+    endpoints = {}
+    pollers, readers = [], []
+    for spec in profile:
+        if spec['kind'] == 'stream':
+            clients = args.streams if args.streams is not None else spec.get('clients', 1)
+            stats = endpoints.setdefault('stream', EndpointStats())
+            readers += [StreamReader(host, stream_port, spec.get('query'), stats, stop) for _ in range(clients)]
+        elif spec['kind'] == 'poll':
+            name = spec.get('name', spec['path'].split('?')[0])
+            stats = endpoints.setdefault(name, EndpointStats())
+            pollers += [Poller(host, port, spec, stats, stop) for _ in range(spec.get('clients', 1))]
+        else:
+            parser.error('unknown workload kind %r' % spec['kind'])
+
+    start = time.time()
+    for worker in readers + pollers:
+        worker.start()
+    try:
+        stop.wait(args.duration)
+    except KeyboardInterrupt:
+        pass
+    stop.set()
+    duration = time.time() - start
+    for worker in readers + pollers:
+        worker.join(TIMEOUT)
+
+    report = {
+        'target': '%s:%d' % (host, port),
+        'stream_port': stream_port,
+        'profile': args.profile,
+        'started': time.strftime('%Y-%m-%dT%H:%M:%S', time.localtime(start)),
+        'duration_s': round(duration, 2),
+        'endpoints': dict((name, stats.result(duration)) for name, stats in endpoints.items()),
+        'streams': [reader.result(duration) for reader in readers],
+    }
+
+    print_report(report)
+    if args.json == '-':
+        json.dump(report, sys.stdout, indent=2, sort_keys=True)
+        print('')
+    elif args.json:
+        with open(args.json, 'w') as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+
+    failing = [name for name, ep in report['endpoints'].items() if ep['error_rate'] > args.max_error_rate]
+    if failing:
+        print('error rate above %g: %s' % (args.max_error_rate, ', '.join(sorted(failing))))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,180 @@
+#!/usr/bin/env python
+#
+# Reference receiver for the frames app_mcast.c sends to a multicast
+# group. FrameAssembler holds the reassembly, MulticastReceiver joins the
+# group and yields complete frames, the command line prints rates and can
+# save the frames.
+#
+# usage: mcast_receiver.py <group:port> [--iface <ip>] [--out <dir>] [--count <n>]
+#
+# The group:port is the mcast TXT record of the camera. Every JPEG is
+# split in datagrams, each with a header, big endian:
+#   version u8, header_len u8, datagram_seq u16,
+#   frame_seq u32, frame_len u32, offset u32,
+#   index u16, count u16, timestamp_ms u32
+# followed by bytes [offset, offset + payload) of the JPEG.
+#
+# A frame is delivered once all of its datagrams are in. Frames that can
+# no longer be shown in order, because a newer one completed first or too
+# many are pending, are dropped.
+
+import argparse
+import collections
+import os
+import socket
+import struct
+import sys
+import time
+
+VERSION = 1
+HEADER = struct.Struct('>BBHIIIHHI')
+# skipped datagram sequences remembered, to tell a late datagram from a duplicate
+MISSING_MAX = 256
+
+Frame = collections.namedtuple('Frame', 'seq timestamp_ms jpeg')
+
+
+def seq_before(a, b):
+    return a != b and ((b - a) & 0xffffffff) < 0x80000000
+
+
+class _Partial(object):
+    def __init__(self, length, count):
+        self.data = bytearray(length)
+        self.count = count
+        self.received = set()
+
+
+class FrameAssembler(object):
+    def __init__(self, max_pending=2):
+        self.max_pending = max_pending
+        self.pending = {}
+        self.last_seq = None
+        self.last_datagram = None
+        self.missing = set()
+        self.datagrams_lost = 0
+        self.frames_dropped = 0
+
+    def _drop(self, seq):
+        del self.pending[seq]
+        self.frames_dropped += 1
+
+    def feed(self, datagram):
+        """Takes one datagram, returns the Frame it completes or None."""
+        if len(datagram) < HEADER.size:
+            return None
+        (version, header_len, datagram_seq, seq, length, offset, index,
+         count, timestamp_ms) = HEADER.unpack_from(datagram)
+        payload = datagram[header_len:]
+        if (version != VERSION or header_len < HEADER.size or index >= count
+                or offset + len(payload) > length):
+            return None
+
+        if self.last_datagram is None:
+            self.last_datagram = datagram_seq
+        else:
+            gap = (datagram_seq - self.last_datagram) & 0xffff
+            if 0 < gap < 0x8000:
+                self.datagrams_lost += gap - 1
+                if len(self.missing) + gap - 1 > MISSING_MAX:
+                    self.missing.clear()
+                self.missing.update((self.last_datagram + i) & 0xffff for i in range(1, min(gap, MISSING_MAX + 1)))
+                self.last_datagram = datagram_seq
+            elif datagram_seq in self.missing:
+                # late, it was counted as lost when the sequence jumped over it
+                self.missing.discard(datagram_seq)
+                self.datagrams_lost -= 1
+
+        if self.last_seq is not None and not seq_before(self.last_seq, seq):
+            return None
+
+        part = self.pending.get(seq)
+        if part is None:
+            part = self.pending[seq] = _Partial(length, count)
+            while len(self.pending) > self.max_pending:
+                # furthest behind the new frame, in sequence order
+                oldest = max(self.pending, key=lambda s: (seq - s + 0x80000000) & 0xffffffff)
+                self._drop(oldest)
+            if seq not in self.pending:
+                return None
+
+        if index in part.received:
+            return None
+        part.data[offset:offset + len(payload)] = payload
+        part.received.add(index)
+        if len(part.received) < part.count:
+            return None
+
+        del self.pending[seq]
+        for older in [s for s in self.pending if seq_before(s, seq)]:
+            self._drop(older)
+        self.last_seq = seq
+        return Frame(seq, timestamp_ms, bytes(part.data))
+
+
+class MulticastReceiver(object):
+    def __init__(self, group, port, iface='0.0.0.0', max_pending=2):
+        self.assembler = FrameAssembler(max_pending)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+        self.sock.bind(('', port))
+        mreq = socket.inet_aton(group) + socket.inet_aton(iface)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+
+    def frames(self):
+        while True:
+            frame = self.assembler.feed(self.sock.recv(65536))
+            if frame is not None:
+                yield frame
+
+    def close(self):
+        self.sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Receive multicast frames of a camera')
+    parser.add_argument('address', help='group:port, as in the mcast TXT record')
+    parser.add_argument('--iface', default='0.0.0.0', help='IP of the interface to join on')
+    parser.add_argument('--out', help='directory to save the frames to')
+    parser.add_argument('--count', type=int, default=0, help='stop after this many frames')
+    args = parser.parse_args()
+
+    group, port = args.address.rsplit(':', 1)
+    receiver = MulticastReceiver(group, int(port), args.iface)
+    assembler = receiver.assembler
+    if args.out and not os.path.isdir(args.out):
+        os.makedirs(args.out)
+
+    received = 0
+    window_frames, window_bytes, window_start = 0, 0, time.time()
+    try:
+        for frame in receiver.frames():
+            received += 1
+            window_frames += 1
+            window_bytes += len(frame.jpeg)
+            if args.out:
+                with open(os.path.join(args.out, 'frame_%08u.jpg' % frame.seq), 'wb') as f:
+                    f.write(frame.jpeg)
+
+            now = time.time()
+            if now - window_start >= 1:
+                print('%.1f fps, %u KB/s, %u frames dropped, %u datagrams lost' % (
+                    window_frames / (now - window_start), window_bytes / (now - window_start) / 1024,
+                    assembler.frames_dropped, assembler.datagrams_lost))
+                window_frames, window_bytes, window_start = 0, 0, now
+
+            if args.count and received >= args.count:
+                break
+    except KeyboardInterrupt:
+        pass
+    finally:
+        receiver.close()
+
+    print('%u frames received, %u dropped, %u datagrams lost' % (
+        received, assembler.frames_dropped, assembler.datagrams_lost))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,60 @@
+#!/usr/bin/env python
+#
+# Stages the built front-end for www_pack.py, storing a gzip
+# copy next to every compressible asset.
+#
+# usage: www_compress.py <dist dir> <stage dir>
+
+import gzip
+import io
+import os
+import shutil
+import sys
+
+COMPRESSIBLE = ('.html', '.js', '.css', '.svg', '.json', '.ico', '.txt', '.map')
+# below this ratio the gzip copy is not worth the flash it takes
+MIN_SAVING = 0.9
+
+
+def gzip_bytes(data):
+    out = io.BytesIO()
+    # mtime 0 keeps the partition image reproducible
+    with gzip.GzipFile(filename='', mode='wb', compresslevel=9, fileobj=out, mtime=0) as f:
+        f.write(data)
+    return out.getvalue()
+
+
+def main(src, dst):
+    if os.path.isdir(dst):
+        shutil.rmtree(dst)
+    shutil.copytree(src, dst)
+
+    raw_total = 0
+    sent_total = 0
+    for root, _, files in os.walk(dst):
+        for name in files:
+            path = os.path.join(root, name)
+            with open(path, 'rb') as f:
+                data = f.read()
+            raw_total += len(data)
+
+            if not name.endswith(COMPRESSIBLE):
+                sent_total += len(data)
+                continue
+
+            packed = gzip_bytes(data)
+            if len(packed) > len(data) * MIN_SAVING:
+                sent_total += len(data)
+                continue
+
+            with open(path + '.gz', 'wb') as f:
+                f.write(packed)
+            sent_total += len(packed)
+
+    print('www: %d bytes raw, %d bytes sent to gzip clients' % (raw_total, sent_total))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.exit('usage: %s <dist dir> <stage dir>' % sys.argv[0])
+    main(sys.argv[1], sys.argv[2])
@@ -0,0 +1,110 @@
+#!/usr/bin/env python
+#
+# Packs a staged front-end (see www_compress.py) into the read-only image
+# flashed to the www partition and served from mmapped flash by app_www.c.
+#
+# usage: www_pack.py <stage dir> <image> [--max-size <bytes>]
+#
+# Layout, little endian:
+#   header   magic u32, count u32, image_len u32, reserved u32
+#   index    count entries sorted by path bytes:
+#            path_off u32, path_len u16, flags u16,
+#            data_off u32, data_len u32, gz_off u32, gz_len u32, etag u32
+#   paths    path strings, not NUL terminated
+#   data     file contents, each aligned to 4 bytes
+#
+# Offsets are relative to the start of the image. gz_len is 0 when the
+# asset has no gzip copy.
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = 0x31575757  # "WWW1"
+HEADER = struct.Struct('<IIII')
+ENTRY = struct.Struct('<IHHIIIII')
+
+FLAG_IMMUTABLE = 0x0001
+
+# Vue CLI names bundles <name>.<8 hex digits>.<ext>
+HASHED_NAME = re.compile(r'\.[0-9a-f]{8}\.[^./]+$')
+
+
+def fnv1a(data):
+    h = 2166136261
+    for b in bytearray(data):
+        h = ((h ^ b) * 16777619) & 0xffffffff
+    return h
+
+
+def align4(n):
+    return (n + 3) & ~3
+
+
+def collect(stage):
+    assets = {}
+    for root, _, files in os.walk(stage):
+        for name in files:
+            if name.endswith('.gz'):
+                continue
+            path = os.path.join(root, name)
+            url = '/' + os.path.relpath(path, stage).replace(os.sep, '/')
+            with open(path, 'rb') as f:
+                data = f.read()
+            gz = b''
+            if os.path.isfile(path + '.gz'):
+                with open(path + '.gz', 'rb') as f:
+                    gz = f.read()
+            assets[url.encode('utf-8')] = (data, gz)
+    return assets
+
+
+def pack(assets):
+    paths = sorted(assets)
+    count = len(paths)
+
+    paths_off = HEADER.size + ENTRY.size * count
+    data_off = align4(paths_off + sum(len(p) for p in paths))
+
+    index = b''
+    path_blob = b''
+    data_blob = b''
+    for path in paths:
+        data, gz = assets[path]
+        flags = FLAG_IMMUTABLE if HASHED_NAME.search(path.decode('utf-8')) else 0
+
+        raw_at = data_off + len(data_blob)
+        data_blob += data + b'\0' * (align4(len(data)) - len(data))
+        gz_at = data_off + len(data_blob) if gz else 0
+        data_blob += gz + b'\0' * (align4(len(gz)) - len(gz))
+
+        index += ENTRY.pack(paths_off + len(path_blob), len(path), flags,
+                            raw_at, len(data), gz_at, len(gz), fnv1a(data))
+        path_blob += path
+
+    path_blob += b'\0' * (data_off - paths_off - len(path_blob))
+    image_len = data_off + len(data_blob)
+
+    return HEADER.pack(MAGIC, count, image_len, 0) + index + path_blob + data_blob
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Pack web assets for the www partition')
+    parser.add_argument('stage')
+    parser.add_argument('image')
+    parser.add_argument('--max-size', type=lambda v: int(v, 0), default=0)
+    args = parser.parse_args()
+
+    image = pack(collect(args.stage))
+    if args.max_size and len(image) > args.max_size:
+        sys.exit('www image is %d bytes, the partition holds %d' % (len(image), args.max_size))
+
+    with open(args.image, 'wb') as f:
+        f.write(image)
+    print('www: packed %d bytes into %s' % (len(image), args.image))
+
+
+if __name__ == '__main__':
+    main()